@@ -207,10 +207,11 @@ static DualStreamingKernelArgs initilize_buffers(Units::UnitMainMemoryBase* main
 	args.framebuffer_size = args.framebuffer_width * args.framebuffer_height;
 	heap_address = align_to(page_size, heap_address);
 	args.framebuffer = reinterpret_cast<uint32_t*>(heap_address);
+	RegionMap::get_instance().add_region("framebuffer", heap_address, args.framebuffer_size * sizeof(uint32_t));
 	heap_address += args.framebuffer_size * sizeof(uint32_t);
 
 	std::vector<rtm::Hit> hits(args.framebuffer_size, {T_MAX, rtm::vec2(0.0), ~0u});
-	args.hit_records = write_vector(main_memory, page_size, hits, heap_address);
+	args.hit_records = write_vector(main_memory, page_size, hits, heap_address, "hit_records");
 
 	args.light_dir = rtm::normalize(rtm::vec3(4.5f, 42.5f, 5.0f));
 
@@ -230,7 +231,7 @@ static DualStreamingKernelArgs initilize_buffers(Units::UnitMainMemoryBase* main
 	std::vector<rtm::Ray> rays(args.framebuffer_size);
 	if(args.pregen_rays)
 		pregen_rays(args.framebuffer_width, args.framebuffer_height, args.camera, bvh2, mesh, sim_config.get_int("pregen_bounce"), rays);
-	args.rays = write_vector(main_memory, CACHE_BLOCK_SIZE, rays, heap_address);
+	args.rays = write_vector(main_memory, CACHE_BLOCK_SIZE, rays, heap_address, "rays");
 
 #if DS_USE_COMPRESSED_WIDE_BVH
 	rtm::WBVH wbvh(bvh2, mesh, build_objects);
@@ -239,20 +240,20 @@ static DualStreamingKernelArgs initilize_buffers(Units::UnitMainMemoryBase* main
 	rtm::NVCWBVH cwbvh(wbvh);
 
 	rtm::CompressedWideTreeletBVH cwtbvh(cwbvh, mesh);
-	args.treelets = write_vector(main_memory, page_size, cwtbvh.treelets, heap_address);
+	args.treelets = write_vector(main_memory, page_size, cwtbvh.treelets, heap_address, "treelets");
 	args.num_treelets = cwtbvh.treelets.size();
 #else
 	rtm::WBVH wbvh(bvh2, build_objects);
 	mesh.reorder(build_objects);
 
 	rtm::WideTreeletBVH wtbvh(wbvh, mesh);
-	args.treelets = write_vector(main_memory, page_size, wtbvh.treelets, heap_address);
+	args.treelets = write_vector(main_memory, page_size, wtbvh.treelets, heap_address, "treelets");
 	args.num_treelets = wtbvh.treelets.size();
 #endif
 
 	std::vector<rtm::Triangle> tris;
 	mesh.get_triangles(tris);
-	args.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address);
+	args.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address, "tris");
 
 	main_memory->direct_write(&args, sizeof(DualStreamingKernelArgs), DS_KERNEL_ARGS_ADDRESS);
 	return args;
@@ -351,6 +352,7 @@ static void run_sim_dual_streaming(const SimulationConfig& sim_config)
 	uint num_sfus = static_cast<uint>(ISA::RISCV::InstrType::NUM_TYPES) * num_tms;
 
 	Simulator simulator;
+	configure_simulator(simulator, sim_config);
 	std::vector<Units::UnitTP*> tps;
 	std::vector<Units::UnitSFU*> sfus;
 	std::vector<Units::UnitThreadScheduler*> thread_schedulers;
@@ -644,6 +646,13 @@ static void run_sim_dual_streaming(const SimulationConfig& sim_config)
 		printf(" L2$ Hit Rate: %8.1f%%\n", 100.0 * l2_delta_log.hits / l2_delta_log.get_total());
 		printf("L1d$ Hit Rate: %8.1f%%\n", 100.0 * l1d_delta_log.hits / l1d_delta_log.get_total());
 		printf("                             \n");
+		dram_delta_log.print_short();
+		printf("                             \n");
+		dram_delta_log.regions.print_short("DRAM");
+		sb_delta_log.regions.print_short("Scene");
+		l2_delta_log.regions.print_short(" L2$");
+		l1d_delta_log.regions.print_short("L1d$");
+		printf("                             \n");
 	});
 	auto stop = std::chrono::high_resolution_clock::now();
 
@@ -658,6 +667,7 @@ static void run_sim_dual_streaming(const SimulationConfig& sim_config)
 	print_header("DRAM");
 	delta_log(dram_log, dram);
 	dram_log.print(frame_cycles);
+	dram_log.regions.print(false);
 
 	print_header("SRAM");
 	delta_log(sram_log, sram);
@@ -670,16 +680,19 @@ static void run_sim_dual_streaming(const SimulationConfig& sim_config)
 	print_header("Scene Buffer");
 	delta_log(sb_log, scene_buffer);
 	sb_log.print(frame_cycles);
+	sb_log.regions.print(false);
 	total_power += sb_log.print_power(scene_buffer_power_config, frame_time);
 
 	print_header("L2$");
 	delta_log(l2_log, l2);
 	l2_log.print(frame_cycles);
+	l2_log.regions.print();
 	total_power += l2_log.print_power(l2_power_config, frame_time);
 
 	print_header("L1d$");
 	delta_log(l1d_log, l1ds);
 	l1d_log.print(frame_cycles);
+	l1d_log.regions.print();
 	total_power += l1d_log.print_power(l1d_power_config, frame_time);
 
 	print_header("TP");
@@ -707,8 +720,9 @@ static void run_sim_dual_streaming(const SimulationConfig& sim_config)
 	printf("Mrays/J: %.2f\n", (float)ss_log.rays / total_energy / 1'000'000);
 
 	print_header("Simulation Summary");
-	printf("Simulation rate: %.2f KHz\n", frame_cycles / simulation_time / 1000.0);
+	print_simulation_rate(simulator, sim_config, frame_cycles, simulation_time);
 	printf("Simulation time: %.0f s\n", simulation_time);
+	print_simulation_profile(simulator, sim_config);
 
 	print_header("Treelet Histogram");
 
@@ -101,6 +101,7 @@ static RICKernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, p
 	args.framebuffer_size = args.framebuffer_width * args.framebuffer_height;
 	heap_address = align_to(page_size, heap_address);
 	args.framebuffer = reinterpret_cast<uint32_t*>(heap_address);
+	RegionMap::get_instance().add_region("framebuffer", heap_address, args.framebuffer_size * sizeof(uint32_t));
 	heap_address += args.framebuffer_size * sizeof(uint32_t);
 
 	args.light_dir = rtm::normalize(rtm::vec3(4.5f, 42.5f, 5.0f));
@@ -128,7 +129,7 @@ static RICKernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, p
 		ray_states[i].hit.id = ~0u;
 	}
 
-	args.ray_states = write_vector(main_memory, CACHE_BLOCK_SIZE, ray_states, heap_address);
+	args.ray_states = write_vector(main_memory, CACHE_BLOCK_SIZE, ray_states, heap_address, "ray_states");
 
 	rtm::WBVH wbvh(bvh2, mesh, build_objects);
 	mesh.reorder(build_objects);
@@ -136,12 +137,12 @@ static RICKernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, p
 	rtm::NVCWBVH cwbvh(wbvh);
 
 	rtm::CompressedWideTreeletBVH cwtbvh(cwbvh, mesh);
-	args.treelets = write_vector(main_memory, page_size, cwtbvh.treelets, heap_address);
+	args.treelets = write_vector(main_memory, page_size, cwtbvh.treelets, heap_address, "treelets");
 	args.num_treelets = cwtbvh.treelets.size();
 
 	std::vector<rtm::Triangle> tris;
 	mesh.get_triangles(tris);
-	args.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address);
+	args.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address, "tris");
 
 	main_memory->direct_write(&args, sizeof(RICKernelArgs), RIC_KERNEL_ARGS_ADDRESS);
 	return args;
@@ -228,6 +229,7 @@ static void run_sim_ric(const SimulationConfig& sim_config)
 	uint num_sfus = static_cast<uint>(ISA::RISCV::InstrType::NUM_TYPES) * num_tms;
 
 	Simulator simulator;
+	configure_simulator(simulator, sim_config);
 	std::vector<Units::UnitTP*> tps;
 	std::vector<Units::UnitSFU*> sfus;
 	std::vector<Units::UnitThreadScheduler*> thread_schedulers;
@@ -260,7 +262,6 @@ static void run_sim_ric(const SimulationConfig& sim_config)
 	paddr_t heap_address = elf.load(dram._data_u8);
 	RICKernelArgs kernel_args = initilize_buffers(&dram, heap_address, sim_config, partition_stride);
 	heap_address = align_to(partition_stride * num_partitions, heap_address);
-	std::pair<paddr_t, paddr_t> treelet_range = {(paddr_t)kernel_args.treelets, (paddr_t)kernel_args.treelets + kernel_args.num_treelets * sizeof(SceneSegment)};
 
 	std::set<uint> unused_dram_ports;
 	for(uint i = 0; i < dram_ports_per_controller; ++i)
@@ -449,6 +450,8 @@ static void run_sim_ric(const SimulationConfig& sim_config)
 		printf("DRAM Write: %8.1f bytes/cycle  \n", (float)dram_delta_log.bytes_written / delta);
 		printf("DRAM  Read: %8.1f bytes/cycle  \n", (float)dram_delta_log.bytes_read / delta);
 		printf("                               \n");
+		dram_delta_log.print_short();
+		printf("                               \n");
 		printf("  L2$ Read: %8.1f bytes/cycle  \n", (float)l2_delta_log.bytes_read / delta);
 		printf(" L1d$ Read: %8.1f bytes/cycle  \n", (float)l1d_delta_log.bytes_read / delta);
 		printf("                               \n");
@@ -474,15 +477,18 @@ static void run_sim_ric(const SimulationConfig& sim_config)
 	print_header("DRAM");
 	delta_log(dram_log, dram);
 	dram_log.print(frame_cycles);
+	dram_log.regions.print(false);
 
 	print_header("L2$");
 	delta_log(l2_log, l2);
 	l2_log.print(frame_cycles);
+	l2_log.regions.print();
 	total_power += l2_log.print_power(l2_power_config, frame_time);
 
 	print_header("L1d$");
 	delta_log(l1d_log, l1ds);
 	l1d_log.print(frame_cycles);
+	l1d_log.regions.print();
 	total_power += l1d_log.print_power(l1d_power_config, frame_time);
 
 	print_header("TP");
@@ -517,50 +523,9 @@ static void run_sim_ric(const SimulationConfig& sim_config)
 	printf("Mrays/J: %.2f\n", (float)rc_log.rays / total_energy / 1'000'000);
 
 	print_header("Simulation Summary");
-	printf("Simulation rate: %.2f KHz\n", frame_cycles / simulation_time / 1000.0);
+	print_simulation_rate(simulator, sim_config, frame_cycles, simulation_time);
 	printf("Simulation time: %.0f s\n", simulation_time);
-
-	print_header("Treelet Histogram");
-
-#if 1
-	uint treelet_counts[16];
-	std::map<uint, uint64_t> treelet_histos[16];
-
-	for(uint i = 0; i < 16; ++i)
-		treelet_counts[i] = 0;
-
-	for(auto& a : l1d_log.profile_counters)
-	{
-		if(a.first >= treelet_range.first && a.first < treelet_range.second)
-		{
-			uint treelet_id = (a.first - (paddr_t)kernel_args.treelets) / rtm::CompressedWideTreeletBVH::Treelet::SIZE;
-			paddr_t treelet_addr = (paddr_t)kernel_args.treelets + treelet_id * rtm::CompressedWideTreeletBVH::Treelet::SIZE;
-			rtm::WideTreeletBVH::Treelet::Header header;
-			dram.direct_read(&header, sizeof(rtm::WideTreeletBVH::Treelet::Header), treelet_addr);
-			uint offset = a.first - treelet_addr;
-
-			treelet_histos[header.depth][offset] += a.second;
-
-			if(offset == 64)
-				treelet_counts[header.depth]++;
-		}
-	}
-
-	for(uint i = 0; i < 16; ++i)
-	{
-		if(treelet_counts[i])
-		{
-			printf("Depth %d (%d)\n", i, treelet_counts[i]);
-			uint64_t total = 0;
-			total += treelet_histos[i][64];
-			for(auto& a : treelet_histos[i])
-			{
-				printf("\t%6d:%.2f(%.2f%%)\n", a.first / 64, (double)a.second / treelet_counts[i], 100.0 * a.second / total);
-			}
-			printf("\n");
-		}
-	}
-#endif
+	print_simulation_profile(simulator, sim_config);
 
 	stbi_flip_vertically_on_write(true);
 	dram.dump_as_png_uint8((paddr_t)kernel_args.framebuffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, "out.png");
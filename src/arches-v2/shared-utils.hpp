@@ -5,8 +5,10 @@
 
 #include "units/unit-dram.hpp"
 #include "units/unit-dram-ramulator.hpp"
+#include "units/unit-dram-fast.hpp"
 #include "units/unit-cache.hpp"
 #include "units/unit-crossbar.hpp"
+#include "units/unit-noc.hpp"
 #include "units/unit-buffer.hpp"
 #include "units/unit-atomic-reg-file.hpp"
 #include "units/unit-tile-scheduler.hpp"
@@ -14,6 +16,7 @@
 #include "units/unit-tp.hpp"
 
 #include "util/elf.hpp"
+#include "util/memory-map.hpp"
 #include "isa/riscv.hpp"
 #include "rtm/rtm.hpp"
 
@@ -30,35 +33,37 @@ std::string get_project_folder_path()
 }
 
 template <typename T>
-static T* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment, T* data, size_t size, paddr_t& heap_address)
+static T* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment, T* data, size_t size, paddr_t& heap_address, const char* region_name = nullptr)
 {
 	paddr_t array_address = align_to(alignment, heap_address);
 	heap_address = array_address + size * sizeof(T);
 	main_memory->direct_write(data, size * sizeof(T), array_address);
+	if(region_name) RegionMap::get_instance().add_region(region_name, array_address, size * sizeof(T));
 	return reinterpret_cast<T*>(array_address);
 }
 
 template <typename T>
-static T* write_vector(Units::UnitMainMemoryBase* main_memory, size_t alignment, std::vector<T> v, paddr_t& heap_address)
+static T* write_vector(Units::UnitMainMemoryBase* main_memory, size_t alignment, std::vector<T> v, paddr_t& heap_address, const char* region_name = nullptr)
 {
-	return write_array(main_memory, alignment, v.data(), v.size(), heap_address);
+	return write_array(main_memory, alignment, v.data(), v.size(), heap_address, region_name);
 }
 
 template <typename T>
-static T* write_array(uint8_t* main_memory, size_t alignment, T* data, size_t size, paddr_t& heap_address)
+static T* write_array(uint8_t* main_memory, size_t alignment, T* data, size_t size, paddr_t& heap_address, const char* region_name = nullptr)
 {
 	paddr_t array_address = align_to(alignment, heap_address);
 	heap_address = array_address + size * sizeof(T);
 	memcpy(main_memory + array_address, data, size * sizeof(T));
+	if(region_name) RegionMap::get_instance().add_region(region_name, array_address, size * sizeof(T));
 	return reinterpret_cast<T*>(array_address);
 }
 
 template <typename T>
-static T* write_vector(uint8_t* main_memory, size_t alignment, std::vector<T> v, paddr_t& heap_address)
+static T* write_vector(uint8_t* main_memory, size_t alignment, std::vector<T> v, paddr_t& heap_address, const char* region_name = nullptr)
 {
 
 
-	return write_array(main_memory, alignment, v.data(), v.size(), heap_address);
+	return write_array(main_memory, alignment, v.data(), v.size(), heap_address, region_name);
 }
 
 template <class T, class L>
@@ -181,6 +186,21 @@ public:
 	{
 		//Simulation
 		set_param("logging_interval", 10000);
+		set_param("sim_engine", "tbb");
+		set_param("sim_threads", 0);
+		set_param("sim_skip_idle", 1);
+		set_param("sim_time_skip", 1);
+		set_param("sim_rebalance", 1);
+		set_param("sim_rebalance_window", 1024);
+		set_param("sim_rebalance_period", 65536);
+		set_param("sim_baseline_rate", 0.0f);
+		set_param("sim_profile", 0);
+		set_param("sim_profile_json", "sim-profile.json");
+		set_param("sim_checkpoint_cycle", 0);
+		set_param("sim_checkpoint_path", "checkpoint.bin");
+		set_param("sim_restore_path", "");
+		set_param("sim_sample_period", 0);
+		set_param("sim_sample_warmup", 1);
 
 		//Arch
 		set_param("arch_name", "TRaX");
@@ -189,14 +209,36 @@ public:
 		set_param("num_tps", 128);
 		set_param("num_rt_cores", 1);
 		set_param("max_rays", 128);
+		set_param("cache_stores", 0);
+		set_param("dram_calibrate", 0);
+
+		set_param("partition_hash", "modulo");
+		set_param("slice_hash", "modulo");
+
+		set_param("noc_topology", "crossbar");
+		set_param("noc_routers", 16);
+		set_param("noc_mesh_width", 4);
+		set_param("noc_router_latency", 2);
+		set_param("noc_link_width", 32);
+		set_param("noc_vcs", 2);
+		set_param("noc_vc_depth", 8);
 
 		set_param("l2_size", 72 << 20);
 		set_param("l2_associativity", 18);
 		set_param("l2_in_order", 0);
+		set_param("l2_policy", "");
+		set_param("l2_reuse_profile", 0.0f);
+		set_param("l2_compression", 0);
 
 		set_param("l1_size", 128 << 10);
 		set_param("l1_associativity", 16);
 		set_param("l1_in_order", 0);
+		set_param("l1_policy", "");
+		set_param("l1_bvh_prefetch", 0);
+		set_param("l1_stream_prefetch", 0);
+		set_param("l1_reuse_profile", 0.0f);
+		set_param("l1_compression", 0);
+		set_param("l1_bank_hash", "modulo");
 
 		//Workload
 		set_param("scene_name", "sponza");
@@ -344,4 +386,218 @@ public:
 	}
 };
 
+static void configure_simulator(Simulator& simulator, const SimulationConfig& sim_config)
+{
+	std::string engine = sim_config.get_string("sim_engine");
+	if(engine == "pool")     simulator.engine = Simulator::Engine::WORKER_POOL;
+	else if(engine == "tbb") simulator.engine = Simulator::Engine::TBB;
+	else printf("Invalid Simulation Engine!: %s\n", engine.c_str()), _assert(false);
+
+	simulator.num_threads = sim_config.get_int("sim_threads");
+	simulator.skip_idle_units = sim_config.get_int("sim_skip_idle");
+	simulator.skip_to_next_event = sim_config.get_int("sim_time_skip");
+	simulator.rebalance_groups = sim_config.get_int("sim_rebalance");
+	simulator.rebalance_window = sim_config.get_int("sim_rebalance_window");
+	simulator.rebalance_period = sim_config.get_int("sim_rebalance_period");
+	simulator.profile_units = sim_config.get_int("sim_profile");
+	simulator.checkpoint_cycle = sim_config.get_int("sim_checkpoint_cycle");
+	simulator.checkpoint_path = sim_config.get_string("sim_checkpoint_path");
+	simulator.restore_path = sim_config.get_string("sim_restore_path");
+}
+
+//Replacement policy named by param or the arch's own policy when it is left empty
+static Units::UnitCacheBase::Policy get_cache_policy(const SimulationConfig& sim_config, const std::string& param, Units::UnitCacheBase::Policy policy)
+{
+	std::string name = sim_config.get_string(param);
+	if(name.empty())             return policy;
+	if(name == "lru")            return Units::UnitCacheBase::Policy::LRU;
+	if(name == "lru_random")     return Units::UnitCacheBase::Policy::LRU_RANDOM;
+	if(name == "srrip")          return Units::UnitCacheBase::Policy::SRRIP;
+	if(name == "brrip")          return Units::UnitCacheBase::Policy::BRRIP;
+	if(name == "drrip")          return Units::UnitCacheBase::Policy::DRRIP;
+	if(name == "ship")           return Units::UnitCacheBase::Policy::SHIP;
+	if(name == "bvh_hint")       return Units::UnitCacheBase::Policy::BVH_HINT;
+
+	printf("Invalid Replacement Policy!: %s\n", name.c_str());
+	_assert(false);
+	return policy;
+}
+
+//Address interleaving named by param: modulo, xor, prime or matrix: followed by one comma separated mask per index bit
+static AddressHash::Configuration get_address_hash(const SimulationConfig& sim_config, const std::string& param)
+{
+	std::string name = sim_config.get_string(param);
+	AddressHash::Configuration config;
+	if(name == "modulo")              config.function = AddressHash::Function::MODULO;
+	else if(name == "xor")            config.function = AddressHash::Function::XOR_FOLD;
+	else if(name == "prime")          config.function = AddressHash::Function::PRIME;
+	else if(name.rfind("matrix:", 0) == 0)
+	{
+		config.function = AddressHash::Function::MATRIX;
+		for(size_t start = 7; start < name.size();)
+		{
+			size_t end = std::min(name.find(',', start), name.size());
+			config.matrix.push_back(std::stoull(name.substr(start, end - start), nullptr, 0));
+			start = end + 1;
+		}
+	}
+	else
+	{
+		printf("Invalid Address Hash!: %s\n", name.c_str());
+		_assert(false);
+	}
+	return config;
+}
+
+//Network between the L1s and the L2 partitions, the ideal crossbar or a mesh or ring NoC picked by noc_topology
+static Units::UnitPartitionInterconnect* new_partition_interconnect(const Units::UnitCrossbar::Configuration& xbar_config, const SimulationConfig& sim_config)
+{
+	std::string topology = sim_config.get_string("noc_topology");
+	if(topology == "crossbar") return _new Units::UnitCrossbar(xbar_config);
+
+	Units::UnitNoC::Configuration noc_config(xbar_config);
+	if(topology == "mesh")      noc_config.topology = Units::UnitNoC::Topology::MESH;
+	else if(topology == "ring") noc_config.topology = Units::UnitNoC::Topology::RING;
+	else printf("Invalid NoC Topology!: %s\n", topology.c_str()), _assert(false);
+
+	noc_config.num_routers = sim_config.get_int("noc_routers");
+	noc_config.mesh_width = sim_config.get_int("noc_mesh_width");
+	noc_config.router_latency = sim_config.get_int("noc_router_latency");
+	noc_config.link_width = sim_config.get_int("noc_link_width");
+	noc_config.num_vcs = sim_config.get_int("noc_vcs");
+	noc_config.vc_depth = sim_config.get_int("noc_vc_depth");
+	return _new Units::UnitNoC(noc_config);
+}
+
+//Prints the simulation rate along with the speedup over sim_baseline_rate (KHz) when one is provided
+static void print_simulation_rate(const Simulator& simulator, const SimulationConfig& sim_config, cycles_t cycles, double simulation_time)
+{
+	double rate = cycles / simulation_time / 1000.0;
+	float baseline_rate = sim_config.get_float("sim_baseline_rate");
+	if(baseline_rate > 0.0f) printf("Simulation rate: %.2f KHz (%.2fx)\n", rate, rate / baseline_rate);
+	else                     printf("Simulation rate: %.2f KHz\n", rate);
+	printf("Simulation engine: %s (%d threads)\n", simulator.engine_name(), simulator.engine_threads());
+	printf("Active units: %.2f%%\n", 100.0 * simulator.active_unit_ratio());
+	if(cycles > 0) printf("Skipped cycles: %lld (%.2f%%)\n", simulator.skipped_cycles, 100.0 * simulator.skipped_cycles / cycles);
+	if(simulator.num_rebalances > 0) printf("Group imbalance: %.2fx -> %.2fx (%d rebalances)\n", simulator.initial_imbalance, simulator.last_imbalance, simulator.num_rebalances);
+}
+
+//SMARTS style sampled simulation on top of the logging interval. Every sim_sample_period intervals the simulator fast
+//forwards functionally, runs sim_sample_warmup intervals in detail to refill the queues and pipelines, then measures one
+//interval. Functional execution still counts instructions so totals are extrapolated from the measured CPI.
+class SimulationSampler
+{
+public:
+	enum class Phase
+	{
+		FAST_FORWARD,
+		WARMUP,
+		MEASURE,
+	};
+
+	struct Sample
+	{
+		double cycles;
+		double instructions;
+		double dram_bytes;
+	};
+
+private:
+	Simulator& _simulator;
+	uint _period;
+	uint _warmup;
+	uint _interval{0};
+	std::vector<Sample> _samples;
+
+	//mean of a per sample ratio and the half width of its 95% confidence interval
+	template<typename F>
+	void _estimate(F ratio, double& mean, double& half_width) const
+	{
+		double sum = 0.0, sum_sq = 0.0;
+		for(const Sample& sample : _samples)
+		{
+			double value = ratio(sample);
+			sum += value;
+			sum_sq += value * value;
+		}
+
+		double n = _samples.size();
+		mean = sum / n;
+		double variance = std::max(0.0, (sum_sq - sum * mean) / (n - 1.0));
+		half_width = 1.96 * std::sqrt(variance / n);
+	}
+
+public:
+	SimulationSampler(Simulator& simulator, const SimulationConfig& sim_config) : _simulator(simulator),
+		_period(sim_config.get_int("sim_sample_period")), _warmup(sim_config.get_int("sim_sample_warmup"))
+	{
+		if(_period != 0 && _period < _warmup + 2) printf("Sample period too short for the warmup!\n"), _assert(false);
+		_simulator.fast_forward = phase() == Phase::FAST_FORWARD;
+	}
+
+	bool enabled() const { return _period != 0; }
+
+	//phase of the interval currently being simulated
+	Phase phase() const
+	{
+		if(!enabled()) return Phase::MEASURE;
+
+		uint position = _interval % _period;
+		if(position + 1 == _period) return Phase::MEASURE;
+		if(position + 1 + _warmup >= _period) return Phase::WARMUP;
+		return Phase::FAST_FORWARD;
+	}
+
+	//Called by the interval logger with the counters of the interval that just ended
+	void end_interval(const Sample& interval)
+	{
+		if(!enabled()) return;
+
+		//the tail of the run can measure an interval after every thread halted
+		if(phase() == Phase::MEASURE && interval.instructions > 0.0) _samples.push_back(interval);
+		_interval++;
+		_simulator.fast_forward = phase() == Phase::FAST_FORWARD;
+	}
+
+	void print(double instructions, double rays, double clock_rate) const
+	{
+		printf("Samples: %lld (%d of every %d intervals in detail)\n", (uint64_t)_samples.size(), _warmup + 1, _period);
+		if(_samples.size() < 2)
+		{
+			printf("Not enough samples to extrapolate\n");
+			return;
+		}
+
+		double cpi, cpi_error;
+		_estimate([](const Sample& sample) { return sample.cycles / sample.instructions; }, cpi, cpi_error);
+
+		double bandwidth, bandwidth_error;
+		_estimate([](const Sample& sample) { return sample.dram_bytes / sample.cycles; }, bandwidth, bandwidth_error);
+
+		double cycles = instructions * cpi;
+		double frame_time = cycles / clock_rate;
+		double relative_error = cpi_error / cpi;
+		printf("Cycles: %.0f (+/- %.2f%%)\n", cycles, 100.0 * relative_error);
+		printf("Frame time: %.3g ms (+/- %.2f%%)\n", frame_time * 1000.0, 100.0 * relative_error);
+		printf("MRays/s: %.0f (+/- %.2f%%)\n", rays / frame_time / 1'000'000.0, 100.0 * relative_error);
+		printf("DRAM Read: %.1f GB/s (+/- %.1f)\n", bandwidth * clock_rate / 1e9, bandwidth_error * clock_rate / 1e9);
+		printf("Confidence: 95%%\n");
+	}
+};
+
+static void print_simulation_profile(const Simulator& simulator, const SimulationConfig& sim_config)
+{
+	if(!simulator.profile_units) return;
+
+	print_header("Simulation Profile");
+	simulator.print_unit_profile();
+
+	std::string json_path = sim_config.get_string("sim_profile_json");
+	if(!json_path.empty())
+	{
+		simulator.write_unit_profile_json(json_path);
+		printf("Profile written to %s\n", json_path.c_str());
+	}
+}
+
 }
@@ -0,0 +1,28 @@
+#include "checkpoint.hpp"
+
+#include <fstream>
+
+namespace Arches {
+
+bool Checkpoint::write_file(const std::string& path) const
+{
+	std::ofstream file_stream(path, std::ios::binary);
+	if(!file_stream.good()) return false;
+
+	file_stream.write((const char*)_data.data(), _data.size());
+	return file_stream.good();
+}
+
+bool Checkpoint::read_file(const std::string& path)
+{
+	std::ifstream file_stream(path, std::ios::binary | std::ios::ate);
+	if(!file_stream.good()) return false;
+
+	_data.resize(file_stream.tellg());
+	file_stream.seekg(0);
+	file_stream.read((char*)_data.data(), _data.size());
+	_offset = 0;
+	return file_stream.good();
+}
+
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include "stdafx.hpp"
+
+namespace Arches {
+
+//Binary archive used to save and restore simulator state. The same checkpoint() function transfers a unit's state in
+//both directions so save and restore can't drift apart. Trivially copyable values are copied as bytes, anything else
+//has to provide template<typename CP> void checkpoint(CP&) or be one of the containers below. Pointers can't be saved
+//since a restore happens in a new process, state that holds them is rebuilt from saved indices instead.
+class Checkpoint
+{
+public:
+	enum class Mode : uint8_t
+	{
+		SAVE,
+		RESTORE,
+	};
+
+private:
+	Mode _mode;
+	std::vector<uint8_t> _data;
+	size_t _offset{0};
+
+	//exposes the underlying container of the std container adaptors
+	template<typename A>
+	struct AdaptorAccess : A
+	{
+		static typename A::container_type& container(A& adaptor) { return adaptor.*(&AdaptorAccess::c); }
+	};
+
+public:
+	Checkpoint(Mode mode) : _mode(mode) {}
+
+	bool saving() const { return _mode == Mode::SAVE; }
+	bool restoring() const { return _mode == Mode::RESTORE; }
+
+	std::vector<uint8_t>& data() { return _data; }
+	bool at_end() const { return _offset == _data.size(); }
+
+	void io_bytes(void* data, size_t size)
+	{
+		if(saving())
+		{
+			_data.insert(_data.end(), (uint8_t*)data, (uint8_t*)data + size);
+		}
+		else
+		{
+			_assert(_offset + size <= _data.size());
+			std::memcpy(data, _data.data() + _offset, size);
+			_offset += size;
+		}
+	}
+
+	template<typename T>
+	void io(T& value)
+	{
+		static_assert(!std::is_pointer_v<T>, "Pointers can't be checkpointed");
+		if constexpr(requires { value.checkpoint(*this); })
+		{
+			value.checkpoint(*this);
+		}
+		else
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Type needs a checkpoint() function");
+			io_bytes(&value, sizeof(T));
+		}
+	}
+
+	template<typename T, size_t N>
+	void io(T(&values)[N])
+	{
+		for(size_t i = 0; i < N; ++i)
+			io(values[i]);
+	}
+
+	template<typename T, typename A>
+	void io(std::vector<T, A>& values)
+	{
+		uint64_t size = values.size();
+		io(size);
+		if constexpr(std::is_default_constructible_v<T>)
+		{
+			if(restoring()) values.resize(size);
+		}
+		else _assert(size == values.size());
+
+		if constexpr(std::is_trivially_copyable_v<T> && !requires(T t) { t.checkpoint(*this); })
+		{
+			if(size) io_bytes(values.data(), sizeof(T) * size);
+		}
+		else
+		{
+			for(T& value : values)
+				io(value);
+		}
+	}
+
+	template<typename T, typename A>
+	void io(std::deque<T, A>& values)
+	{
+		uint64_t size = values.size();
+		io(size);
+		if(restoring()) values.resize(size);
+		for(T& value : values)
+			io(value);
+	}
+
+	template<typename T, typename C>
+	void io(std::queue<T, C>& queue)
+	{
+		io(AdaptorAccess<std::queue<T, C>>::container(queue));
+	}
+
+	template<typename T, typename C>
+	void io(std::stack<T, C>& stack)
+	{
+		io(AdaptorAccess<std::stack<T, C>>::container(stack));
+	}
+
+	//the underlying container is saved in heap order so no re-heapify is needed
+	template<typename T, typename C, typename P>
+	void io(std::priority_queue<T, C, P>& queue)
+	{
+		io(AdaptorAccess<std::priority_queue<T, C, P>>::container(queue));
+	}
+
+	template<typename A, typename B>
+	void io(std::pair<A, B>& pair)
+	{
+		io(pair.first);
+		io(pair.second);
+	}
+
+	template<typename K, typename V, typename P, typename A>
+	void io(std::map<K, V, P, A>& map)
+	{
+		uint64_t size = map.size();
+		io(size);
+		if(saving())
+		{
+			for(auto& a : map)
+			{
+				K key = a.first;
+				io(key);
+				io(a.second);
+			}
+		}
+		else
+		{
+			map.clear();
+			for(uint64_t i = 0; i < size; ++i)
+			{
+				K key;
+				io(key);
+				io(map[key]);
+			}
+		}
+	}
+
+	template<typename K, typename P, typename A>
+	void io(std::set<K, P, A>& set)
+	{
+		uint64_t size = set.size();
+		io(size);
+		if(saving())
+		{
+			for(K key : set)
+				io(key);
+		}
+		else
+		{
+			set.clear();
+			for(uint64_t i = 0; i < size; ++i)
+			{
+				K key;
+				io(key);
+				set.insert(key);
+			}
+		}
+	}
+
+	void io(std::string& string)
+	{
+		uint64_t size = string.size();
+		io(size);
+		if(restoring()) string.resize(size);
+		if(size) io_bytes(string.data(), size);
+	}
+
+	bool write_file(const std::string& path) const;
+	bool read_file(const std::string& path);
+};
+
+}
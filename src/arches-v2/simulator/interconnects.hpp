@@ -4,6 +4,10 @@
 #include "util/arbitration.hpp"
 #include "util/alignment-allocator.hpp"
 #include "util/bit-manipulation.hpp"
+#include "util/ring-buffer.hpp"
+#include "units/unit-base.hpp"
+#include "checkpoint.hpp"
+#include "transaction-pool.hpp"
 
 namespace Arches {
 
@@ -11,62 +15,71 @@ template <typename T>
 class FIFO
 {
 private:
-	std::vector<T> _data;
-	uint           _head;
-	uint           _size;
+	RingBuffer<T> _data;
 
 public:
-	FIFO(uint size) : _data(size)
-	{
-		_head = 0;
-		_size = 0;
-	}
+	FIFO(uint size) : _data(size) {}
 
 	bool is_write_valid()
 	{
-		return _size < _data.size();
+		return !_data.full();
 	}
 
 	void write(const T& entry)
 	{
 		_assert(is_write_valid());
-		uint tail = (_head + _size) % _data.size();
-		_data[tail] = entry;
-		_size++;
+		_data.push(entry);
 	}
 
 	bool is_read_valid()
 	{
-		return _size > 0;
+		return !_data.empty();
 	}
 
 	T& peek()
 	{
 		_assert(is_read_valid());
-		return _data[_head];
+		return _data.front();
 	}
 
 	T read()
 	{
 		const T t = peek();
-		if(++_head >= _data.size()) _head = 0;
-		--_size;
+		_data.pop();
 		return t;
 	}
-};
 
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		checkpoint.io(_data);
+	}
+};
 
+//Timing wheel of latency slots. Entries are stamped with the cycle they become readable and at most one is written per
+//cycle, so stamps only grow and a ring of latency entries holds everything that can be in flight.
 template <typename T>
 class LatencyFIFO
 {
 private:
-	std::queue<std::pair<cycles_t, T>> _queue;
+	struct Entry
+	{
+		cycles_t ready_cycle;
+		T value;
+
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(ready_cycle);
+			checkpoint.io(value);
+		}
+	};
+
+	RingBuffer<Entry> _wheel;
 	cycles_t _current_cycle;
 	cycles_t _latency;
 	bool _write_valid;
 
 public:
-	LatencyFIFO(uint latency)
+	LatencyFIFO(uint latency) : _wheel(latency)
 	{
 		_current_cycle = 0;
 		_latency = latency;
@@ -75,7 +88,7 @@ public:
 
 	bool empty()
 	{
-		return _queue.empty();
+		return _wheel.empty();
 	}
 
 	uint lantecy()
@@ -91,34 +104,103 @@ public:
 
 	bool is_write_valid() const
 	{
-		return _write_valid && _queue.size() < _latency;
+		return _write_valid && !_wheel.full();
 	}
 
 	void write(const T& entry)
 	{
 		_assert(is_write_valid());
-		_queue.push({_current_cycle + _latency, entry});
+		_wheel.push({_current_cycle + _latency, entry});
 		_write_valid = false;
 	}
 
 	bool is_read_valid()
 	{
-		return !_queue.empty() && _current_cycle >= _queue.front().first;
+		return !_wheel.empty() && _current_cycle >= _wheel.front().ready_cycle;
 	}
 
 	T& peek()
 	{
 		_assert(is_read_valid());
-		return _queue.front().second;
+		return _wheel.front().value;
+	}
+
+	//Number of clock() calls until the head becomes readable
+	cycles_t cycles_until_read_valid() const
+	{
+		_assert(!_wheel.empty());
+		return std::max<cycles_t>(_wheel.front().ready_cycle - _current_cycle, 0);
+	}
+
+	//Ages the entries as if clock() had been called for each skipped cycle
+	void skip(cycles_t cycles)
+	{
+		_write_valid = true;
+		_current_cycle += cycles;
 	}
 
 	T read()
 	{
 		_assert(is_read_valid());
 		T t = peek();
-		_queue.pop();
+		_wheel.pop();
 		return t;
 	}
+
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		checkpoint.io(_wheel);
+		checkpoint.io(_current_cycle);
+		checkpoint.io(_write_valid);
+	}
+};
+
+//Bitmask of the non-empty fifos of a network so clocks visit only the ports with traffic. Sources on any thread set bits
+//on write, the owner clears them on clock() once a fifo drains.
+template<uint MAX_SIZE>
+class OccupancyMask
+{
+private:
+	static constexpr uint NUM_WORDS = (MAX_SIZE + 63) / 64;
+	std::atomic<uint64_t> _words[NUM_WORDS];
+
+public:
+	OccupancyMask()
+	{
+		for(uint i = 0; i < NUM_WORDS; ++i)
+			_words[i].store(0, std::memory_order_relaxed);
+	}
+
+	OccupancyMask(const OccupancyMask& other) { *this = other; }
+
+	OccupancyMask& operator=(const OccupancyMask& other)
+	{
+		for(uint i = 0; i < NUM_WORDS; ++i)
+			_words[i].store(other._words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		return *this;
+	}
+
+	//busy fifos usually already have their bit so check before paying for the atomic
+	void set(uint index)
+	{
+		uint64_t bit = 0x1ull << (index % 64);
+		if(!(_words[index / 64].load(std::memory_order_relaxed) & bit))
+			_words[index / 64].fetch_or(bit, std::memory_order_relaxed);
+	}
+
+	void reset(uint index)
+	{
+		_words[index / 64].fetch_and(~(0x1ull << (index % 64)), std::memory_order_relaxed);
+	}
+
+	//visits the set bits in increasing order, bits can be reset from f
+	template<typename F>
+	void for_each(F f) const
+	{
+		for(uint i = 0; i < NUM_WORDS; ++i)
+			for(uint64_t word = _words[i].load(std::memory_order_relaxed); word; word &= word - 1)
+				f(i * 64 + ctz(word));
+	}
 };
 
 template<typename T, uint MAX_SIZE = 256>
@@ -129,6 +211,15 @@ protected:
 	uint8_t _output_pending[MAX_SIZE];
 	const uint _num_sources;
 	const uint _num_sinks;
+	Units::UnitBase* _owner{nullptr};
+
+	static constexpr uint MAX_PORTS = MAX_SIZE;
+
+	void _on_write()
+	{
+		Simulator::port_writes++;
+		if(_owner) _owner->wake();
+	}
 
 public:
 	Interconnect(uint sources, uint sinks) : _num_sources(sources), _num_sinks(sinks)
@@ -145,6 +236,9 @@ public:
 	uint num_sources() const { return _num_sources; }
 	uint num_sinks() const { return _num_sinks; }
 
+	//Units using the sleep/wake protocol register as the owner of their input networks so writes wake them
+	void set_owner(Units::UnitBase* owner) { _owner = owner; }
+
 	//Owner interface
 	virtual void clock() = 0;
 
@@ -164,6 +258,12 @@ public:
 		return !_input_pending[source_index];
 	}
 	virtual void write(const T& transaction, uint source_index) = 0;
+
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		checkpoint.io_bytes(_input_pending, _num_sources);
+		checkpoint.io_bytes(_output_pending, _num_sinks);
+	}
 };
 
 template<typename T>
@@ -177,6 +277,8 @@ public:
 
 	void clock() override
 	{
+		PROFILE_SECTION(INTERCONNECT);
+
 		//copy states from input to output
 		for(uint i = 0; i < _transactions.size(); ++i)
 			Interconnect<T>::_output_pending[i] = Interconnect<T>::_input_pending[i];
@@ -201,30 +303,43 @@ public:
 		_assert(Interconnect<T>::is_write_valid(source_index));
 		Interconnect<T>::_input_pending[source_index] = 1;
 		_transactions[source_index] = transaction;
+		Interconnect<T>::_on_write();
+	}
+
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		Interconnect<T>::checkpoint(checkpoint);
+		checkpoint.io(_transactions);
 	}
 };
 
 constexpr uint default_fifo_depth = 8;
+constexpr uint default_allocator_iterations = 2;
 
 template<typename T>
 class FIFOArray : public Interconnect<T>
 {
 private:
-	std::vector<std::queue<T>> _fifos;
+	std::vector<RingBuffer<T>> _fifos;
 	uint _fifo_depth;
+	uint _occupancy{0};
 
 public:
-	FIFOArray(uint size, uint fifo_depth = default_fifo_depth) : Interconnect<T>(size, size), _fifos(size), _fifo_depth(fifo_depth)
+	FIFOArray(uint size, uint fifo_depth = default_fifo_depth) : Interconnect<T>(size, size), _fifos(size, RingBuffer<T>(fifo_depth)), _fifo_depth(fifo_depth)
 	{
 	}
 
 	void clock() override
 	{
+		PROFILE_SECTION(INTERCONNECT);
+
 		//copy states from input to output
+		_occupancy = 0;
 		for(uint i = 0; i < _fifos.size(); ++i)
 		{
 			Interconnect<T>::_input_pending[i] = _fifos[i].size() >= _fifo_depth;
 			Interconnect<T>::_output_pending[i] = _fifos[i].size() > 0;
+			_occupancy += _fifos[i].size();
 		}
 	}
 
@@ -247,44 +362,140 @@ public:
 		_assert(Interconnect<T>::is_write_valid(source_index));
 		Interconnect<T>::_input_pending[source_index] = 1;
 		_fifos[source_index].push(transaction);
+		Interconnect<T>::_on_write();
+	}
+
+	//Counted on clock() by the owner since sources and sinks on other threads touch the fifos between clocks. Writes after
+	//the last clock wake the owner and reads only make this conservative.
+	bool empty() const { return _occupancy == 0; }
+
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		Interconnect<T>::checkpoint(checkpoint);
+		checkpoint.io(_fifos);
+		checkpoint.io(_occupancy);
 	}
 };
 
 template <typename T>
 using I = Interconnect<T>;
 
+//Fifos hold handles into the transaction pool, the payload is copied in on write and out on read and only the handle
+//moves between fifos
 template<typename T>
 class BufferedInterconnect : public I<T>
 {
 protected:
-	std::vector<std::queue<T>> _source_fifos;
-	std::vector<std::queue<T>> _sink_fifos;
+	typedef TransactionPool<T> Pool;
+	typedef typename Pool::Handle Handle;
+
+	std::vector<RingBuffer<Handle>> _source_fifos;
+	std::vector<RingBuffer<Handle>> _sink_fifos;
 	const uint _source_fifo_depth;
 	const uint _sink_fifo_depth;
+	uint _occupancy{0};
+	OccupancyMask<I<T>::MAX_PORTS> _source_mask;
+	OccupancyMask<I<T>::MAX_PORTS> _sink_mask;
+
+	const T& _source_head(uint source_index)
+	{
+		return Pool::get(_source_fifos[source_index].front());
+	}
+
+	//Moves the head of a source fifo into a sink fifo. Only called from clock().
+	void _transfer(uint source_index, uint sink_index)
+	{
+		_sink_fifos[sink_index].push(_source_fifos[source_index].front());
+		_source_fifos[source_index].pop();
+		_sink_mask.set(sink_index);
+	}
+
+	//fifos are saved as transactions since handles don't survive a restore
+	void _checkpoint_fifos(Checkpoint& checkpoint, std::vector<RingBuffer<Handle>>& fifos)
+	{
+		for(RingBuffer<Handle>& fifo : fifos)
+		{
+			uint size = fifo.size();
+			checkpoint.io(size);
+			if(checkpoint.saving())
+			{
+				for(uint i = 0; i < size; ++i)
+					checkpoint.io(Pool::get(fifo[i]));
+			}
+			else
+			{
+				_assert(size <= fifo.capacity());
+				_free_fifo(fifo);
+				for(uint i = 0; i < size; ++i)
+				{
+					T transaction;
+					checkpoint.io(transaction);
+					fifo.push(Pool::allocate(transaction));
+				}
+			}
+		}
+	}
+
+	void _free_fifo(RingBuffer<Handle>& fifo)
+	{
+		for(; !fifo.empty(); fifo.pop())
+			Pool::free(fifo.front());
+	}
+
+	void _rebuild_masks()
+	{
+		for(uint i = 0; i < _source_fifos.size(); ++i)
+			if(_source_fifos[i].empty()) _source_mask.reset(i);
+			else                         _source_mask.set(i);
+
+		for(uint i = 0; i < _sink_fifos.size(); ++i)
+			if(_sink_fifos[i].empty()) _sink_mask.reset(i);
+			else                       _sink_mask.set(i);
+	}
 
 public:
 	BufferedInterconnect(uint sources, uint sinks, uint source_fifo_depth = default_fifo_depth, uint sink_fifo_depth = default_fifo_depth) : 
-		I<T>(sources, sinks), _source_fifos(sources), _sink_fifos(sinks), _source_fifo_depth(source_fifo_depth), _sink_fifo_depth(sink_fifo_depth) {}
+		I<T>(sources, sinks), _source_fifos(sources, RingBuffer<Handle>(source_fifo_depth)), _sink_fifos(sinks, RingBuffer<Handle>(sink_fifo_depth)), _source_fifo_depth(source_fifo_depth), _sink_fifo_depth(sink_fifo_depth) {}
 
+	virtual ~BufferedInterconnect()
+	{
+		for(RingBuffer<Handle>& fifo : _source_fifos) _free_fifo(fifo);
+		for(RingBuffer<Handle>& fifo : _sink_fifos) _free_fifo(fifo);
+	}
+
+	//Only fifos with a mask bit are visited. Ports outside the masks are empty and had their pending flags cleared by
+	//the clock that drained them or the read that emptied them.
 	virtual void clock() override
 	{
-		for(uint i = 0; i < _source_fifos.size(); ++i)
-			I<T>::_input_pending[i] = _source_fifos[i].size() >= _source_fifo_depth;
+		_occupancy = 0;
+		_source_mask.for_each([&](uint i)
+		{
+			uint size = _source_fifos[i].size();
+			I<T>::_input_pending[i] = size >= _source_fifo_depth;
+			_occupancy += size;
+			if(size == 0) _source_mask.reset(i);
+		});
 
-		for(uint i = 0; i < _sink_fifos.size(); ++i)
-			I<T>::_output_pending[i] = _sink_fifos[i].size() > 0;
+		_sink_mask.for_each([&](uint i)
+		{
+			uint size = _sink_fifos[i].size();
+			I<T>::_output_pending[i] = size > 0;
+			_occupancy += size;
+			if(size == 0) _sink_mask.reset(i);
+		});
 	}
 
 	const T& peek(uint sink_index) override
 	{
 		_assert(I<T>::is_read_valid(sink_index));
-		return _sink_fifos[sink_index].front();
+		return Pool::get(_sink_fifos[sink_index].front());
 	}
 
 	const T read(uint sink_index) override
 	{
 		const T t = peek(sink_index);
 		I<T>::_output_pending[sink_index] = 0;
+		Pool::free(_sink_fifos[sink_index].front());
 		_sink_fifos[sink_index].pop();
 		return t;
 	}
@@ -293,7 +504,22 @@ public:
 	{
 		_assert(Interconnect<T>::is_write_valid(source_index));
 		I<T>::_input_pending[source_index] = 1;
-		_source_fifos[source_index].push(transaction);
+		_source_fifos[source_index].push(Pool::allocate(transaction));
+		_source_mask.set(source_index);
+		I<T>::_on_write();
+	}
+
+	//Counted on clock() by the owner since sources and sinks on other threads touch the fifos between clocks. Writes after
+	//the last clock wake the owner and reads only make this conservative.
+	bool empty() const { return _occupancy == 0; }
+
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		I<T>::checkpoint(checkpoint);
+		_checkpoint_fifos(checkpoint, _source_fifos);
+		_checkpoint_fifos(checkpoint, _sink_fifos);
+		checkpoint.io(_occupancy);
+		if(checkpoint.restoring()) _rebuild_masks();
 	}
 };
 
@@ -304,8 +530,9 @@ template<typename T, typename ARB = RoundRobinArbiter<uint128_t>>
 class Cascade : public BI<T>
 {
 private:
-	size_t _cascade_ratio;
+	uint _cascade_ratio;
 	std::vector<ARB> _arbiters;
+	std::vector<uint> _active_sinks; //sinks with a non-empty source this clock
 
 public:
 	Cascade(uint sources, uint sinks, uint source_fifo_depth = default_fifo_depth, uint sink_fifo_depth = default_fifo_depth) :
@@ -314,41 +541,53 @@ public:
 		_arbiters(sinks, _cascade_ratio)
 	{
 		_assert(sources >= sinks);
+		_active_sinks.reserve(sinks);
 	}
 
 	void clock() override
 	{
-		for(uint source_index = 0; source_index < I<T>::num_sources(); ++source_index)
+		PROFILE_SECTION(INTERCONNECT);
+
+		//sources are visited in order so each sink's sources are contiguous
+		_active_sinks.clear();
+		BI<T>::_source_mask.for_each([&](uint source_index)
 		{
-			if(BI<T>::_source_fifos[source_index].empty()) continue;
+			if(BI<T>::_source_fifos[source_index].empty()) return;
 
 			uint cascade_index = source_index / _cascade_ratio;
 			uint cascade_source_index = source_index % _cascade_ratio;
 
 			_arbiters[cascade_index].add(cascade_source_index);
-		}
+			if(_active_sinks.empty() || _active_sinks.back() != cascade_index)
+				_active_sinks.push_back(cascade_index);
+		});
 
-		for(uint sink_index = 0; sink_index < I<T>::num_sinks(); ++sink_index)
+		for(uint sink_index : _active_sinks)
 		{
-			if((BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) || !_arbiters[sink_index].num_pending()) continue;
+			if(BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) continue;
 
 			uint cascade_source_index = _arbiters[sink_index].get_index();
 			uint source_index = sink_index * _cascade_ratio + cascade_source_index;
 
-			BI<T>::_sink_fifos[sink_index].push(BI<T>::_source_fifos[source_index].front());
-			BI<T>::_source_fifos[source_index].pop();
+			BI<T>::_transfer(source_index, sink_index);
 			_arbiters[sink_index].remove(cascade_source_index);
 		}
 
 		BI<T>::clock();
 	}
+
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		BI<T>::checkpoint(checkpoint);
+		checkpoint.io(_arbiters);
+	}
 };
 
 template<typename T>
 class Decascade : public BI<T>
 {
 private:
-	size_t _cascade_ratio;
+	uint _cascade_ratio;
 
 public:
 	Decascade(uint sources, uint sinks, uint source_fifo_depth = default_fifo_depth, uint sink_fifo_depth = default_fifo_depth) :
@@ -362,139 +601,174 @@ public:
 
 	void clock() override
 	{
-		for(uint source_index = 0; source_index < I<T>::num_sources(); ++source_index)
+		PROFILE_SECTION(INTERCONNECT);
+
+		BI<T>::_source_mask.for_each([&](uint source_index)
 		{
-			if(BI<T>::_source_fifos[source_index].empty()) continue;
+			if(BI<T>::_source_fifos[source_index].empty()) return;
 
-			uint sink_index = get_sink(BI<T>::_source_fifos[source_index].front());
+			uint sink_index = get_sink(BI<T>::_source_head(source_index));
 			_assert(sink_index / _cascade_ratio == source_index);
 
-			if(BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) continue;
-			BI<T>::_sink_fifos[sink_index].push(BI<T>::_source_fifos[source_index].front());
-			BI<T>::_source_fifos[source_index].pop();
-		}
+			if(BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) return;
+			BI<T>::_transfer(source_index, sink_index);
+		});
 
 		BI<T>::clock();
 	}
 };
 
-template<typename T, typename ARB = RoundRobinArbiter<uint128_t>>
+template<typename T, typename ALLOC = ISLIPAllocator<uint128_t>>
 class CrossBar : public BI<T>
 {
 private:
-	std::vector<ARB> _arbiters;
+	ALLOC _allocator;
+	std::vector<uint> _requesting_sources; //sources that requested this clock in increasing order
 
 public:
-	CrossBar(uint sources, uint sinks, uint source_fifo_depth = default_fifo_depth, uint sink_fifo_depth = default_fifo_depth) :
+	CrossBar(uint sources, uint sinks, uint source_fifo_depth = default_fifo_depth, uint sink_fifo_depth = default_fifo_depth, uint allocator_iterations = default_allocator_iterations) :
 		BI<T>(sources, sinks, source_fifo_depth, sink_fifo_depth),
-		_arbiters(sinks, sources)
+		_allocator(sources, sinks, allocator_iterations)
 	{
+		_requesting_sources.reserve(sources);
 	}
 
 	virtual uint get_sink(const T& transaction) = 0;
 
 	void clock() override
 	{
-		//this should probably implment i-slip but for now we will just clock it at double rate
-		for(uint i = 0; i < 2; ++i)
+		PROFILE_SECTION(INTERCONNECT);
+
+		//every source requests the sink of its head transaction if that sink has room
+		_requesting_sources.clear();
+		BI<T>::_source_mask.for_each([&](uint source_index)
 		{
-			for(uint source_index = 0; source_index < Interconnect<T>::num_sources(); ++source_index)
-			{
-				if(BI<T>::_source_fifos[source_index].empty()) continue;
+			if(BI<T>::_source_fifos[source_index].empty()) return;
 
-				uint sink_index = get_sink(BI<T>::_source_fifos[source_index].front());
-				_arbiters[sink_index].add(source_index);
-			}
+			uint sink_index = get_sink(BI<T>::_source_head(source_index));
+			if(BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) return;
 
-			for(uint sink_index = 0; sink_index < Interconnect<T>::num_sinks(); ++sink_index)
-			{
-				if((BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) || !_arbiters[sink_index].num_pending()) continue;
+			_requesting_sources.push_back(source_index);
+			_allocator.request(source_index, sink_index);
+		});
 
-				uint source_index = _arbiters[sink_index].get_index();
+		if(!_requesting_sources.empty()) _allocator.allocate();
 
-				_arbiters[sink_index].remove(source_index);
-				BI<T>::_sink_fifos[sink_index].push(BI<T>::_source_fifos[source_index].front());
-				BI<T>::_source_fifos[source_index].pop();
-			}
-
-			BI<T>::clock();
+		for(uint source_index : _requesting_sources)
+		{
+			uint sink_index = _allocator.match(source_index);
+			if(sink_index != ~0u) BI<T>::_transfer(source_index, sink_index);
 		}
+
+		BI<T>::clock();
+	}
+
+	typedef typename ALLOC::Log AllocatorLog;
+	const AllocatorLog& allocator_log() const { return _allocator.log; }
+
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		BI<T>::checkpoint(checkpoint);
+		checkpoint.io(_allocator);
 	}
 };
 
 
-template<typename T, typename ARB = RoundRobinArbiter<uint128_t>>
+//Sources are cascaded in groups onto the crossbar inputs and crossbar outputs fan out to groups of sinks. A group with
+//heads for several outputs requests all of them, which gives the allocator the choice a virtual output queue would.
+template<typename T, typename ALLOC = ISLIPAllocator<uint128_t>>
 class CasscadedCrossBar : public BI<T>
 {
 protected:
 	uint _source_crossbar_width, _sink_crossbar_width;
-	size_t _input_cascade_ratio;
+	uint _input_cascade_ratio;
 	std::vector<RoundRobinArbiter<uint64_t>> _cascade_arbiters;
-	std::vector<ARB> _crossbar_arbiters;
-	size_t _output_cascade_ratio;
+	ALLOC _allocator;
+	uint _output_cascade_ratio;
+	std::vector<uint> _source_sinks; //sink requested by each source this clock
+	std::vector<uint> _requesting_sources; //in increasing order so each group's sources are contiguous
 
 public:
-	CasscadedCrossBar(uint sources, uint sinks, uint source_crossbar_width = 64, uint sink_crossbar_width = 64, uint source_fifo_depth = default_fifo_depth, uint sink_fifo_depth = default_fifo_depth) :
+	CasscadedCrossBar(uint sources, uint sinks, uint source_crossbar_width = 64, uint sink_crossbar_width = 64, uint source_fifo_depth = default_fifo_depth, uint sink_fifo_depth = default_fifo_depth, uint allocator_iterations = default_allocator_iterations) :
 		BI<T>(sources, sinks, source_fifo_depth, sink_fifo_depth),
 		_source_crossbar_width(std::min(source_crossbar_width, sources)),
 		_sink_crossbar_width(std::min(sink_crossbar_width, sinks)),
 		_input_cascade_ratio((sources + _source_crossbar_width - 1) / _source_crossbar_width),
 		_cascade_arbiters(_source_crossbar_width, _input_cascade_ratio),
-		_crossbar_arbiters(_sink_crossbar_width, _source_crossbar_width),
-		_output_cascade_ratio((sinks + _sink_crossbar_width - 1) / _sink_crossbar_width)
+		_allocator(_source_crossbar_width, _sink_crossbar_width, allocator_iterations),
+		_output_cascade_ratio((sinks + _sink_crossbar_width - 1) / _sink_crossbar_width),
+		_source_sinks(sources, ~0u)
 	{
 		_assert(sources >= _source_crossbar_width);
 		_assert(sinks >= _sink_crossbar_width);
+		_requesting_sources.reserve(sources);
 	}
 
 	virtual uint get_sink(const T& transaction) = 0;
 
 	void clock() override
 	{
-		//this should probably implment i-slip but for now we will just clock it at double rate
-		for(uint i = 0; i < 2; ++i)
-		{
-			for(uint source_index = 0; source_index < Interconnect<T>::num_sources(); ++source_index)
-			{
-				if(BI<T>::_source_fifos[source_index].empty()) continue;
+		PROFILE_SECTION(INTERCONNECT);
 
-				uint cascade_index = source_index / _input_cascade_ratio;
-				uint cascade_source_index = source_index % _input_cascade_ratio;
+		_requesting_sources.clear();
+		BI<T>::_source_mask.for_each([&](uint source_index)
+		{
+			if(BI<T>::_source_fifos[source_index].empty()) return;
 
-				_cascade_arbiters[cascade_index].add(cascade_source_index);
-			}
+			uint sink_index = get_sink(BI<T>::_source_head(source_index));
+			if(BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) return;
 
-			for(uint cascade_index = 0; cascade_index < _cascade_arbiters.size(); ++cascade_index)
-			{
-				if(!_cascade_arbiters[cascade_index].num_pending()) continue;
+			_source_sinks[source_index] = sink_index;
+			_requesting_sources.push_back(source_index);
+			_allocator.request(source_index / _input_cascade_ratio, sink_index / _output_cascade_ratio);
+		});
 
-				uint cascade_source_index = _cascade_arbiters[cascade_index].get_index();
-				uint source_index = cascade_index * _input_cascade_ratio + cascade_source_index;
-				uint sink_index = get_sink(BI<T>::_source_fifos[source_index].front());
-				uint crossbar_index = sink_index / _output_cascade_ratio;
-
-				_crossbar_arbiters[crossbar_index].add(cascade_index);
-			}
+		if(_requesting_sources.empty())
+		{
+			BI<T>::clock();
+			return;
+		}
 
-			for(uint crossbar_index = 0; crossbar_index < _crossbar_arbiters.size(); ++crossbar_index)
-			{
-				if(!_crossbar_arbiters[crossbar_index].num_pending()) continue;
+		_allocator.allocate();
 
-				uint cascade_index = _crossbar_arbiters[crossbar_index].get_index();
-				uint cascade_source_index = _cascade_arbiters[cascade_index].get_index();
-				uint source_index = cascade_index * _input_cascade_ratio + cascade_source_index;
-				uint sink_index = get_sink(BI<T>::_source_fifos[source_index].front());
+		for(uint group_begin = 0, group_end; group_begin < _requesting_sources.size(); group_begin = group_end)
+		{
+			uint cascade_index = _requesting_sources[group_begin] / _input_cascade_ratio;
+			uint first_source = cascade_index * _input_cascade_ratio;
+			uint end_source = first_source + _input_cascade_ratio;
+			for(group_end = group_begin + 1; group_end < _requesting_sources.size(); ++group_end)
+				if(_requesting_sources[group_end] >= end_source) break;
+
+			uint crossbar_index = _allocator.match(cascade_index);
+			if(crossbar_index == ~0u) continue;
+
+			//round robin between the sources of the group headed for the matched output
+			RoundRobinArbiter<uint64_t>& arbiter = _cascade_arbiters[cascade_index];
+			for(uint i = group_begin; i < group_end; ++i)
+				if(_source_sinks[_requesting_sources[i]] / _output_cascade_ratio == crossbar_index)
+					arbiter.add(_requesting_sources[i] - first_source);
+
+			uint cascade_source_index = arbiter.get_index();
+			for(uint i = group_begin; i < group_end; ++i)
+				if(_requesting_sources[i] - first_source != cascade_source_index)
+					arbiter.remove(_requesting_sources[i] - first_source);
+			arbiter.remove(cascade_source_index);
+
+			uint source_index = first_source + cascade_source_index;
+			BI<T>::_transfer(source_index, _source_sinks[source_index]);
+		}
 
-				if(BI<T>::_sink_fifos[sink_index].size() >= BI<T>::_sink_fifo_depth) continue;
+		BI<T>::clock();
+	}
 
-				_crossbar_arbiters[crossbar_index].remove(cascade_index);
-				_cascade_arbiters[cascade_index].remove(cascade_source_index);
-				BI<T>::_sink_fifos[sink_index].push(BI<T>::_source_fifos[source_index].front());
-				BI<T>::_source_fifos[source_index].pop();
-			}
+	typedef typename ALLOC::Log AllocatorLog;
+	const AllocatorLog& allocator_log() const { return _allocator.log; }
 
-			BI<T>::clock();
-		}
+	void checkpoint(Checkpoint& checkpoint)
+	{
+		BI<T>::checkpoint(checkpoint);
+		checkpoint.io(_cascade_arbiters);
+		checkpoint.io(_allocator);
 	}
 };
 
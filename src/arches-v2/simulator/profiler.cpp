@@ -0,0 +1,113 @@
+#include "profiler.hpp"
+
+#include "units/unit-base.hpp"
+
+#include <typeindex>
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
+namespace Arches {
+
+static const char* phase_names[] = {"rise", "fall"};
+static const char* section_names[] = {"interconnect", "ramulator"};
+
+std::string Profiler::class_name(const std::type_info& type)
+{
+#ifdef __GNUC__
+	int status = 0;
+	char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+	std::string name = status == 0 ? demangled : type.name();
+	std::free(demangled);
+#else
+	std::string name = type.name();
+	if(name.rfind("class ", 0) == 0) name = name.substr(6);
+#endif
+
+	//drop the namespaces but keep template arguments
+	size_t template_start = name.find('<');
+	size_t name_start = name.rfind("::", template_start);
+	if(name_start != std::string::npos) name = name.substr(name_start + 2);
+	return name;
+}
+
+std::vector<Profiler::ClassProfile> Profiler::_aggregate(const std::vector<Units::UnitBase*>& units, const std::vector<UnitProfile>& profiles)
+{
+	std::map<std::type_index, uint> class_indices;
+	std::vector<ClassProfile> classes;
+	for(uint i = 0; i < units.size() && i < profiles.size(); ++i)
+	{
+		std::type_index type = typeid(*units[i]);
+		if(class_indices.find(type) == class_indices.end())
+		{
+			class_indices[type] = classes.size();
+			classes.emplace_back();
+			classes.back().name = class_name(typeid(*units[i]));
+		}
+
+		ClassProfile& class_profile = classes[class_indices[type]];
+		class_profile.num_units++;
+		for(uint j = 0; j < (uint)Phase::NUM_PHASES; ++j)
+		{
+			class_profile.profile.phase_ticks[j] += profiles[i].phase_ticks[j];
+			class_profile.profile.phase_calls[j] += profiles[i].phase_calls[j];
+		}
+		for(uint j = 0; j < (uint)Section::NUM_SECTIONS; ++j)
+			class_profile.profile.section_ticks[j] += profiles[i].section_ticks[j];
+	}
+
+	std::sort(classes.begin(), classes.end(), [](const ClassProfile& a, const ClassProfile& b) { return a.total_ticks() > b.total_ticks(); });
+	return classes;
+}
+
+void Profiler::print(const std::vector<Units::UnitBase*>& units, const std::vector<UnitProfile>& profiles, double ticks_per_second, FILE* stream)
+{
+	std::vector<ClassProfile> classes = _aggregate(units, profiles);
+
+	uint64_t total_ticks = 0;
+	for(const ClassProfile& class_profile : classes)
+		total_ticks += class_profile.total_ticks();
+	if(total_ticks == 0) return;
+
+	fprintf(stream, "%-40s %6s %9s %9s %9s %7s %9s %9s\n", "Unit", "Count", "Rise(s)", "Fall(s)", "Total(s)", "Share", "ns/Clock", "Sections");
+	for(const ClassProfile& class_profile : classes)
+	{
+		const UnitProfile& profile = class_profile.profile;
+		uint64_t ticks = class_profile.total_ticks();
+		uint64_t calls = profile.phase_calls[(uint)Phase::RISE] + profile.phase_calls[(uint)Phase::FALL];
+
+		fprintf(stream, "%-40s %6d %9.2f %9.2f %9.2f %6.2f%% %9.1f", class_profile.name.c_str(), class_profile.num_units,
+			profile.phase_ticks[(uint)Phase::RISE] / ticks_per_second, profile.phase_ticks[(uint)Phase::FALL] / ticks_per_second,
+			ticks / ticks_per_second, 100.0 * ticks / total_ticks, calls ? 1e9 * ticks / ticks_per_second / calls : 0.0);
+
+		for(uint j = 0; j < (uint)Section::NUM_SECTIONS; ++j)
+			if(profile.section_ticks[j])
+				fprintf(stream, " %s: %.1f%%", section_names[j], 100.0 * profile.section_ticks[j] / ticks);
+		fprintf(stream, "\n");
+	}
+}
+
+void Profiler::write_json(const std::vector<Units::UnitBase*>& units, const std::vector<UnitProfile>& profiles, double ticks_per_second, const std::string& path)
+{
+	FILE* stream = fopen(path.c_str(), "w");
+	if(!stream) return;
+
+	std::vector<ClassProfile> classes = _aggregate(units, profiles);
+
+	fprintf(stream, "{\n\t\"ticks_per_second\": %.0f,\n\t\"units\": [\n", ticks_per_second);
+	for(uint i = 0; i < classes.size(); ++i)
+	{
+		const UnitProfile& profile = classes[i].profile;
+		fprintf(stream, "\t\t{\"name\": \"%s\", \"count\": %d", classes[i].name.c_str(), classes[i].num_units);
+		for(uint j = 0; j < (uint)Phase::NUM_PHASES; ++j)
+			fprintf(stream, ", \"%s_seconds\": %.6f, \"%s_clocks\": %llu", phase_names[j], profile.phase_ticks[j] / ticks_per_second, phase_names[j], (unsigned long long)profile.phase_calls[j]);
+		for(uint j = 0; j < (uint)Section::NUM_SECTIONS; ++j)
+			fprintf(stream, ", \"%s_seconds\": %.6f", section_names[j], profile.section_ticks[j] / ticks_per_second);
+		fprintf(stream, "}%s\n", i + 1 < classes.size() ? "," : "");
+	}
+	fprintf(stream, "\t]\n}\n");
+
+	fclose(stream);
+}
+
+}
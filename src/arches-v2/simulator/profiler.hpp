@@ -0,0 +1,96 @@
+#pragma once
+#include "stdafx.hpp"
+
+//Section scopes sit inside unit clocks and cost a thread_local read even when profiling is off at runtime, so they are
+//compiled out unless the build turns them on (ARCHES_SECTION_PROFILER in CMake). Per unit timing is switched at runtime.
+#ifndef ENABLE_SECTION_PROFILER
+#define ENABLE_SECTION_PROFILER 0
+#endif
+
+namespace Arches {
+
+namespace Units
+{
+	class UnitBase;
+}
+
+//Wall time spent in every unit by clock phase plus named sections for costs hidden inside a unit's clock (interconnect
+//clocks, Ramulator ticks). Times are raw timestamp counter ticks and are only converted to seconds for reporting.
+class Profiler
+{
+public:
+	enum class Phase : uint8_t
+	{
+		RISE,
+		FALL,
+		NUM_PHASES,
+	};
+
+	enum class Section : uint8_t
+	{
+		INTERCONNECT,
+		RAMULATOR,
+		NUM_SECTIONS,
+	};
+
+	struct UnitProfile
+	{
+		uint64_t phase_ticks[(uint)Phase::NUM_PHASES]{};
+		uint64_t phase_calls[(uint)Phase::NUM_PHASES]{};
+		uint64_t section_ticks[(uint)Section::NUM_SECTIONS]{};
+	};
+
+	//Profile of the unit being clocked on this thread, null when the simulator isn't timing units
+	inline static thread_local UnitProfile* current{nullptr};
+
+	class Scope
+	{
+	private:
+		uint64_t _start;
+		Section _section;
+
+	public:
+		Scope(Section section) : _section(section)
+		{
+			if(current) _start = __rdtsc();
+		}
+
+		~Scope()
+		{
+			if(current) current->section_ticks[(uint)_section] += __rdtsc() - _start;
+		}
+	};
+
+	//Aggregates the per unit profiles by class. ticks_per_second converts timestamp counter ticks to wall time.
+	static void print(const std::vector<Units::UnitBase*>& units, const std::vector<UnitProfile>& profiles, double ticks_per_second, FILE* stream = stdout);
+	static void write_json(const std::vector<Units::UnitBase*>& units, const std::vector<UnitProfile>& profiles, double ticks_per_second, const std::string& path);
+
+	//Demangled class name without namespaces
+	static std::string class_name(const std::type_info& type);
+
+private:
+	struct ClassProfile
+	{
+		std::string name;
+		uint num_units{0};
+		UnitProfile profile;
+
+		uint64_t total_ticks() const
+		{
+			uint64_t ticks = 0;
+			for(uint i = 0; i < (uint)Phase::NUM_PHASES; ++i)
+				ticks += profile.phase_ticks[i];
+			return ticks;
+		}
+	};
+
+	static std::vector<ClassProfile> _aggregate(const std::vector<Units::UnitBase*>& units, const std::vector<UnitProfile>& profiles);
+};
+
+#if ENABLE_SECTION_PROFILER
+#define PROFILE_SECTION(section) Profiler::Scope _profile_scope(Profiler::Section::section)
+#else
+#define PROFILE_SECTION(section)
+#endif
+
+}
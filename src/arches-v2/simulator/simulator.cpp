@@ -1,14 +1,25 @@
 #include "simulator.hpp"
 
 #include "units/unit-base.hpp"
+#include "spin-barrier.hpp"
+#include "util/bit-manipulation.hpp"
+
+#ifdef BUILD_PLATFORM_WINDOWS
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
 
 namespace Arches {
 
-void Simulator::register_unit(Units::UnitBase * unit)
+void Simulator::register_unit(Units::UnitBase * unit, uint clock_domain)
 {
+	_assert(clock_domain < _clock_domains.size());
 	unit->unit_id = _units.size();
+	unit->clock_domain = clock_domain;
 	_units.push_back(unit);
 	_unit_groups.back().end++;
+	_clock_domains[clock_domain].num_units++;
 	unit->simulator = this;
 }
 
@@ -17,6 +28,16 @@ void Simulator::new_unit_group()
 	_unit_groups.emplace_back(static_cast<uint>(_units.size()), static_cast<uint>(_units.size()));
 }
 
+uint Simulator::add_clock_domain(double frequency)
+{
+	_assert(frequency > 0.0);
+	for(uint i = 0; i < _clock_domains.size(); ++i)
+		if(_clock_domains[i].frequency == frequency) return i;
+
+	_clock_domains.emplace_back(frequency);
+	return _clock_domains.size() - 1;
+}
+
 #ifndef _DEBUG
 #define USE_TBB
 #endif
@@ -27,23 +48,567 @@ void Simulator::new_unit_group()
 //#define UNIT_LOOP_END }});
 
 //custom block ranges
-#define UNIT_LOOP tbb::parallel_for(tbb::blocked_range<uint>(0, _unit_groups.size()), [&](tbb::blocked_range<uint> r) { for(uint j = r.begin(); j < r.end(); ++j) { for(uint i = _unit_groups[j].start; i < _unit_groups[j].end; ++i) {
-#define UNIT_LOOP_END }}});
+#define GROUP_LOOP tbb::parallel_for(tbb::blocked_range<uint>(0, _unit_groups.size()), [&](tbb::blocked_range<uint> r) { for(uint j = r.begin(); j < r.end(); ++j) {
+#define GROUP_LOOP_END }});
 
 
 #else
-#define UNIT_LOOP for(uint i = 0; i < _units.size(); ++i) {
-#define UNIT_LOOP_END }
+#define GROUP_LOOP for(uint j = 0; j < _unit_groups.size(); ++j) {
+#define GROUP_LOOP_END }
 #endif
 
-void Simulator::_clock_rise()
+void Simulator::_wake_unit(uint unit_index)
+{
+	_wake_masks[unit_index / 64].fetch_or(0x1ull << (unit_index % 64), std::memory_order_relaxed);
+}
+
+void Simulator::_reset(UnitGroup& group)
+{
+	group.active.clear();
+	group.sleep_requests.clear();
+	group.unit_clocks = 0;
+	group.next_event = NO_EVENT;
+	for(uint i = group.start; i < group.end; ++i)
+	{
+		_units[i]->_asleep = false;
+		_units[i]->_woken = false;
+		_units[i]->_sleep_requested = false;
+		_units[i]->reset();
+		group.active.push_back(i);
+	}
+}
+
+//Runs at the start of clock rise. Port writes only happen on clock fall so every wake from the last cycle is visible here
+void Simulator::_update_activity(UnitGroup& group)
+{
+	bool changed = false;
+
+	//wake sleeping units that were written to
+	for(uint w = group.start / 64; w < (group.end + 63) / 64; ++w)
+	{
+		uint64_t group_bits = ~0x0ull;
+		if(w == group.start / 64) group_bits &= ~generate_nbit_mask(group.start % 64);
+		if(w == group.end / 64) group_bits &= generate_nbit_mask(group.end % 64);
+
+		if(!(_wake_masks[w].load(std::memory_order_relaxed) & group_bits)) continue;
+
+		uint64_t woken = _wake_masks[w].fetch_and(~group_bits, std::memory_order_relaxed) & group_bits;
+		while(woken)
+		{
+			uint i = w * 64 + ctz(woken);
+			woken &= woken - 1;
+
+			_units[i]->_asleep = false;
+			_units[i]->_woken = false;
+			group.active.push_back(i);
+			changed = true;
+		}
+	}
+
+	//put units to sleep unless they were written to in the same cycle they went idle
+	for(uint i : group.sleep_requests)
+	{
+		Units::UnitBase* unit = _units[i];
+		if(unit->_woken)
+		{
+			unit->_woken = false;
+			continue;
+		}
+
+		unit->_asleep = true;
+		changed = true;
+	}
+	group.sleep_requests.clear();
+
+	if(changed)
+	{
+		group.active.erase(std::remove_if(group.active.begin(), group.active.end(), [&](uint i) { return _units[i]->asleep(); }), group.active.end());
+		std::sort(group.active.begin(), group.active.end());
+	}
+}
+
+//Timed clock used while profiling. Profiler::current lets sections inside the unit attribute time to themselves.
+void Simulator::_clock_unit(uint unit_index, Profiler::Phase phase)
+{
+	Profiler::UnitProfile& profile = _unit_profiles[unit_index];
+	Profiler::current = &profile;
+
+	uint64_t start = __rdtsc();
+	if(phase == Profiler::Phase::RISE) _units[unit_index]->clock_rise();
+	else                               _units[unit_index]->clock_fall();
+	uint64_t ticks = __rdtsc() - start;
+
+	Profiler::current = nullptr;
+
+	_unit_ticks[unit_index] += ticks;
+	if(profile_units)
+	{
+		profile.phase_ticks[(uint)phase] += ticks;
+		profile.phase_calls[(uint)phase]++;
+	}
+}
+
+void Simulator::_clock_rise(UnitGroup& group)
+{
+	if(skip_idle_units) _update_activity(group);
+
+	if(_pending_skip)
+	{
+		for(uint i : group.active)
+		{
+			cycles_t cycles = _clock_domains[_units[i]->clock_domain].pending_skip;
+			if(cycles) _units[i]->skip_cycles(cycles);
+		}
+	}
+
+	if(!_all_ticking)
+	{
+		//only some domains have an edge this step
+		for(uint i : group.active)
+		{
+			if(!_clock_domains[_units[i]->clock_domain].ticking) continue;
+			if(_profiling || profile_units) _clock_unit(i, Profiler::Phase::RISE);
+			else                            _units[i]->clock_rise();
+			group.unit_clocks++;
+		}
+		return;
+	}
+
+	group.unit_clocks += group.active.size();
+	if(_profiling || profile_units)
+	{
+		for(uint i : group.active)
+			_clock_unit(i, Profiler::Phase::RISE);
+	}
+	else
+	{
+		for(uint i : group.active)
+			_units[i]->clock_rise();
+	}
+}
+
+void Simulator::_clock_fall(UnitGroup& group)
+{
+	uint64_t start_port_writes = port_writes;
+	group.next_event = skip_to_next_event ? NO_EVENT : _next_edge_time;
+	group.write_horizon = 0;
+
+	for(uint i : group.active)
+	{
+		Units::UnitBase* unit = _units[i];
+		const ClockDomain& domain = _clock_domains[unit->clock_domain];
+
+		//units without an edge this step still report their next event so the step after can't jump past it
+		if(domain.ticking)
+		{
+			if(_profiling || profile_units) _clock_unit(i, Profiler::Phase::FALL);
+			else                            unit->clock_fall();
+		}
+
+		if(unit->_sleep_requested)
+		{
+			unit->_sleep_requested = false;
+			if(skip_idle_units)
+			{
+				group.sleep_requests.push_back(i);
+				continue;
+			}
+		}
+
+		//once any unit has work on the next edge there is nothing left to learn from the rest of the group
+		if(group.next_event > _next_edge_time)
+		{
+			cycles_t next_event_cycle = unit->next_event_cycle();
+			if(next_event_cycle != NO_EVENT)
+				group.next_event = std::min(group.next_event, domain.edge_time(next_event_cycle));
+		}
+	}
+
+	//a transaction written this step may have landed after its receiver reported so it has to be handled next edge.
+	//The receiver may be in a domain without an edge next step and report from a stale view of its ports until it is
+	//clocked, so no skipping until every domain has had an edge.
+	if(port_writes != start_port_writes)
+	{
+		group.next_event = _next_edge_time;
+		group.write_horizon = _edge_horizon;
+	}
+}
+
+//Runs serially between steps. The interval logger runs on core clock cycles.
+void Simulator::_advance_cycle(uint delta, std::function<void()>& interval_logger)
+{
+	bool core_ticked = _clock_domains[0].ticking;
+
+	//functional execution shares units with the detailed work still draining so it can't run inside a phase
+	if(fast_forward && core_ticked)
+		for(Units::UnitBase* unit : _units)
+			unit->functional_step();
+
+	for(ClockDomain& domain : _clock_domains)
+	{
+		if(domain.ticking) domain.cycle++;
+		domain.pending_skip = 0;
+	}
+	_pending_skip = false;
+	current_cycle = _clock_domains[0].cycle;
+
+	if(core_ticked && delta != 0 && current_cycle % delta == 0)
+		interval_logger();
+
+	if(_checkpoint_pending && core_ticked && current_cycle >= checkpoint_cycle)
+	{
+		_checkpoint_pending = false;
+		save_checkpoint(checkpoint_path);
+	}
+
+	if(skip_to_next_event && !fast_forward && units_executing > 0)
+		_skip_to_next_event(delta, interval_logger);
+
+	_schedule_edges();
+}
+
+//Jumps every domain to its first edge at or after the earliest reported event when every active unit is only waiting
+//on latency, stopping at interval boundaries so the logger still runs once per interval.
+void Simulator::_skip_to_next_event(uint delta, std::function<void()>& interval_logger)
+{
+	cycles_t next_event = NO_EVENT;
+	for(const UnitGroup& group : _unit_groups)
+	{
+		next_event = std::min(next_event, group.next_event);
+		_write_horizon = std::max(_write_horizon, group.write_horizon);
+	}
+
+	cycles_t next_edge_time = NO_EVENT;
+	for(const ClockDomain& domain : _clock_domains)
+		next_edge_time = std::min(next_edge_time, domain.edge_time(domain.cycle));
+
+	if(next_event == NO_EVENT || next_event <= next_edge_time || next_edge_time <= _write_horizon) return;
+
+	ClockDomain& core_domain = _clock_domains[0];
+	if(delta != 0)
+		next_event = std::min(next_event, core_domain.edge_time((current_cycle / delta + 1) * delta));
+
+	for(ClockDomain& domain : _clock_domains)
+	{
+		cycles_t cycle = (next_event + domain.period - 1) / domain.period;
+		domain.pending_skip = cycle - domain.cycle;
+		domain.cycle = cycle;
+		if(domain.pending_skip) _pending_skip = true;
+	}
+
+	skipped_cycles += core_domain.pending_skip;
+	current_cycle = core_domain.cycle;
+
+	if(core_domain.pending_skip && delta != 0 && current_cycle % delta == 0)
+		interval_logger();
+}
+
+//Picks the domains that have an edge in the next step
+void Simulator::_schedule_edges()
+{
+	cycles_t step_time = NO_EVENT;
+	for(const ClockDomain& domain : _clock_domains)
+		step_time = std::min(step_time, domain.edge_time(domain.cycle));
+
+	_all_ticking = true;
+	_next_edge_time = NO_EVENT;
+	_edge_horizon = 0;
+	for(ClockDomain& domain : _clock_domains)
+	{
+		domain.ticking = domain.edge_time(domain.cycle) == step_time;
+		_all_ticking &= domain.ticking;
+		_next_edge_time = std::min(_next_edge_time, domain.edge_time(domain.cycle + domain.ticking));
+		_edge_horizon = std::max(_edge_horizon, domain.edge_time(domain.cycle + domain.ticking));
+	}
+
+	current_cycle = domain_cycle(0);
+}
+
+//Starts a profile window when one is due and rebalances at the end of it. Runs serially between cycles.
+bool Simulator::_update_rebalance(uint num_threads)
+{
+	//a single thread has nothing to balance so don't pay for the profiling windows
+	if(!rebalance_groups || units_executing == 0 || num_threads < 2) return false;
+
+	if(!_profiling)
+	{
+		if(current_cycle < _next_rebalance) return false;
+		_profiling = true;
+		_profile_end = current_cycle + rebalance_window;
+		std::fill(_unit_ticks.begin(), _unit_ticks.end(), 0);
+		return false;
+	}
+
+	if(current_cycle < _profile_end) return false;
+
+	_profiling = false;
+	_next_rebalance = rebalance_period ? current_cycle + rebalance_period : NO_EVENT;
+	return _rebalance(num_threads);
+}
+
+//Splits the units, in registration order, into one group per thread with roughly equal measured cost. Keeping the
+//groups contiguous keeps units that talk to each other (a TM's TPs and L1, a partition's L2 and DRAM) on one thread.
+//Returns false if the current groups were kept.
+bool Simulator::_rebalance(uint num_threads)
+{
+	uint64_t total_ticks = 0;
+	for(UnitGroup& group : _unit_groups)
+	{
+		group.cost = 0;
+		for(uint i = group.start; i < group.end; ++i)
+			group.cost += _unit_ticks[i];
+		total_ticks += group.cost;
+	}
+	if(total_ticks == 0) return false;
+
+	std::vector<std::vector<uint>> thread_groups(num_threads);
+	_assign_unit_groups(thread_groups);
+	float imbalance_before = _load_imbalance(thread_groups);
+
+	//carry over state that lives in the groups
+	std::vector<uint> sleep_requests;
+	for(UnitGroup& group : _unit_groups)
+		sleep_requests.insert(sleep_requests.end(), group.sleep_requests.begin(), group.sleep_requests.end());
+	std::sort(sleep_requests.begin(), sleep_requests.end());
+
+	//cut at whichever unit boundary lands closest to each multiple of the target cost
+	uint num_groups = std::max(1u, std::min(num_threads, (uint)_units.size()));
+	std::vector<UnitGroup> unit_groups;
+	uint64_t prefix_ticks = 0;
+	uint start = 0;
+	for(uint i = 0; i < _units.size() && unit_groups.size() + 1 < num_groups; ++i)
+	{
+		uint64_t target_ticks = total_ticks * (unit_groups.size() + 1) / num_groups;
+		if(prefix_ticks + _unit_ticks[i] >= target_ticks)
+		{
+			uint64_t undershoot = target_ticks > prefix_ticks ? target_ticks - prefix_ticks : 0;
+			uint64_t overshoot = prefix_ticks + _unit_ticks[i] - target_ticks;
+			uint end = (undershoot < overshoot && i > start) ? i : i + 1;
+			unit_groups.emplace_back(start, end);
+			start = end;
+		}
+		prefix_ticks += _unit_ticks[i];
+	}
+	unit_groups.emplace_back(start, (uint)_units.size());
+
+	std::vector<std::vector<uint>> new_thread_groups(num_threads);
+	std::swap(_unit_groups, unit_groups);
+	for(UnitGroup& group : _unit_groups)
+		for(uint i = group.start; i < group.end; ++i)
+			group.cost += _unit_ticks[i];
+	_assign_unit_groups(new_thread_groups);
+	float imbalance_after = _load_imbalance(new_thread_groups);
+
+	//measurements are noisy so keep the current groups unless the new split is actually better
+	if(imbalance_after >= imbalance_before)
+	{
+		std::swap(_unit_groups, unit_groups);
+		return false;
+	}
+
+	auto sleep_request = sleep_requests.begin();
+	for(UnitGroup& group : _unit_groups)
+	{
+		for(uint i = group.start; i < group.end; ++i)
+			if(!_units[i]->asleep()) group.active.push_back(i);
+
+		for(; sleep_request != sleep_requests.end() && *sleep_request < group.end; ++sleep_request)
+			group.sleep_requests.push_back(*sleep_request);
+	}
+
+	for(UnitGroup& group : unit_groups)
+		_retired_unit_clocks += group.unit_clocks;
+
+	if(num_rebalances++ == 0) initial_imbalance = imbalance_before;
+	last_imbalance = imbalance_after;
+
+	printf("Rebalanced %d units into %d groups at cycle %lld: imbalance %.2fx -> %.2fx\n", (uint)_units.size(), (uint)_unit_groups.size(), current_cycle, imbalance_before, imbalance_after);
+	return true;
+}
+
+//Max thread cost over the mean thread cost for a group assignment
+float Simulator::_load_imbalance(std::vector<std::vector<uint>>& thread_groups)
+{
+	uint64_t total_cost = 0, max_cost = 0;
+	for(std::vector<uint>& groups : thread_groups)
+	{
+		uint64_t thread_cost = 0;
+		for(uint j : groups)
+			thread_cost += _unit_groups[j].cost;
+
+		total_cost += thread_cost;
+		max_cost = std::max(max_cost, thread_cost);
+	}
+
+	if(total_cost == 0) return 1.0f;
+	return (float)max_cost * thread_groups.size() / total_cost;
+}
+
+double Simulator::active_unit_ratio() const
+{
+	uint64_t unit_clocks = _retired_unit_clocks;
+	for(const UnitGroup& group : _unit_groups)
+		unit_clocks += group.unit_clocks;
+
+	uint64_t unit_cycles = 0;
+	for(const ClockDomain& domain : _clock_domains)
+		unit_cycles += domain.num_units * domain.cycle;
+
+	if(unit_cycles == 0) return 0.0;
+	return (double)unit_clocks / unit_cycles;
+}
+
+void Simulator::print_unit_profile(FILE* stream) const
+{
+	if(!profile_units || _execute_seconds <= 0.0) return;
+	Profiler::print(_units, _unit_profiles, _execute_ticks / _execute_seconds, stream);
+}
+
+void Simulator::write_unit_profile_json(const std::string& path) const
+{
+	if(!profile_units || _execute_seconds <= 0.0) return;
+	Profiler::write_json(_units, _unit_profiles, _execute_ticks / _execute_seconds, path);
+}
+
+//Header, then every unit's state tagged with its class so a checkpoint only restores into the configuration it was
+//saved from. Sleep state isn't saved, every unit starts awake and goes back to sleep on its own once it is idle.
+static const uint32_t CHECKPOINT_MAGIC = 0x504b4341; //"ACKP"
+static const uint32_t CHECKPOINT_VERSION = 16;
+
+struct CheckpointHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t num_units;
+	uint64_t num_domains;
+	cycles_t skipped_cycles;
+	uint64_t unit_clocks;
+	uint32_t units_executing;
+};
+
+bool Simulator::save_checkpoint(const std::string& path)
+{
+	Checkpoint checkpoint(Checkpoint::Mode::SAVE);
+
+	CheckpointHeader header;
+	header.magic = CHECKPOINT_MAGIC;
+	header.version = CHECKPOINT_VERSION;
+	header.num_units = _units.size();
+	header.num_domains = _clock_domains.size();
+	header.skipped_cycles = skipped_cycles;
+	header.unit_clocks = _retired_unit_clocks;
+	for(const UnitGroup& group : _unit_groups)
+		header.unit_clocks += group.unit_clocks;
+	header.units_executing = units_executing;
+	checkpoint.io(header);
+
+	for(ClockDomain& domain : _clock_domains)
+	{
+		checkpoint.io(domain.frequency);
+		checkpoint.io(domain.cycle);
+	}
+
+	for(Units::UnitBase* unit : _units)
+	{
+		std::string name = typeid(*unit).name();
+		Checkpoint unit_checkpoint(Checkpoint::Mode::SAVE);
+		if(!unit->checkpoint(unit_checkpoint))
+		{
+			printf("Checkpoint not saved: %s does not support checkpoints\n", Profiler::class_name(typeid(*unit)).c_str());
+			return false;
+		}
+
+		checkpoint.io(name);
+		checkpoint.io(unit_checkpoint.data());
+	}
+
+	if(!checkpoint.write_file(path))
+	{
+		printf("Checkpoint not saved: failed to write %s\n", path.c_str());
+		return false;
+	}
+
+	printf("Saved checkpoint at cycle %lld: %s (%.1f MB)\n", current_cycle, path.c_str(), checkpoint.data().size() / (1024.0 * 1024.0));
+	return true;
+}
+
+bool Simulator::restore_checkpoint(const std::string& path)
 {
+	Checkpoint checkpoint(Checkpoint::Mode::RESTORE);
+	if(!checkpoint.read_file(path))
+	{
+		printf("Checkpoint not restored: failed to read %s\n", path.c_str());
+		return false;
+	}
+
+	CheckpointHeader header;
+	if(checkpoint.data().size() < sizeof(header)) header.magic = 0;
+	else checkpoint.io(header);
+
+	if(header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION || header.num_units != _units.size() || header.num_domains != _clock_domains.size())
+	{
+		printf("Checkpoint not restored: %s is from a different version or configuration\n", path.c_str());
+		return false;
+	}
+
+	std::vector<cycles_t> domain_cycles(_clock_domains.size());
+	for(uint i = 0; i < _clock_domains.size(); ++i)
+	{
+		double frequency;
+		checkpoint.io(frequency);
+		checkpoint.io(domain_cycles[i]);
+		if(frequency != _clock_domains[i].frequency)
+		{
+			printf("Checkpoint not restored: clock domain %d ran at %.0f Hz\n", i, frequency);
+			return false;
+		}
+	}
+
+	//check every unit matches before any state is touched
+	std::vector<Checkpoint> unit_checkpoints(_units.size(), Checkpoint(Checkpoint::Mode::RESTORE));
+	for(uint i = 0; i < _units.size(); ++i)
+	{
+		std::string name;
+		checkpoint.io(name);
+		checkpoint.io(unit_checkpoints[i].data());
+		if(name != typeid(*_units[i]).name())
+		{
+			printf("Checkpoint not restored: unit %d is not a %s\n", i, Profiler::class_name(typeid(*_units[i])).c_str());
+			return false;
+		}
+	}
+	_assert(checkpoint.at_end());
+
+	for(uint i = 0; i < _units.size(); ++i)
+	{
+		bool restored = _units[i]->checkpoint(unit_checkpoints[i]);
+		_assert(restored && unit_checkpoints[i].at_end());
+	}
+
+	for(uint i = 0; i < _clock_domains.size(); ++i)
+	{
+		_clock_domains[i].cycle = domain_cycles[i];
+		_clock_domains[i].pending_skip = 0;
+	}
+	_pending_skip = false;
+	_write_horizon = 0;
+	_schedule_edges();
 
+	skipped_cycles = header.skipped_cycles;
+	_retired_unit_clocks = header.unit_clocks;
+	units_executing = header.units_executing;
+
+	printf("Restored checkpoint at cycle %lld: %s\n", _clock_domains[0].cycle, path.c_str());
+	return true;
 }
 
-void Simulator::_clock_fall()
+//Runs once after every unit is reset. A failed restore leaves the units untouched and the run starts from scratch.
+void Simulator::_restore_on_start()
 {
+	if(restore_path.empty() || !restore_checkpoint(restore_path)) return;
 
+	_checkpoint_pending = _checkpoint_pending && current_cycle < checkpoint_cycle;
+	if(_profiling) _profile_end = current_cycle + rebalance_window;
 }
 
 #ifdef USE_TBB
@@ -68,7 +633,74 @@ public:
 };
 #endif
 
-void Simulator::execute(uint delta, std::function<void()> interval_logger)
+static void pin_thread_to_core(uint core_index)
+{
+#ifdef BUILD_PLATFORM_WINDOWS
+	SetThreadAffinityMask(GetCurrentThread(), 0x1ull << (core_index % 64));
+#else
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(core_index % CPU_SETSIZE, &cpu_set);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+#endif
+}
+
+const char* Simulator::engine_name() const
+{
+	if(engine == Engine::WORKER_POOL) return "Worker Pool";
+#ifdef USE_TBB
+	return "TBB";
+#else
+	return "Serial";
+#endif
+}
+
+uint Simulator::engine_threads() const
+{
+	if(engine == Engine::WORKER_POOL)
+	{
+		uint non_empty_groups = 0;
+		for(const UnitGroup& group : _unit_groups)
+			if(group.end > group.start) non_empty_groups++;
+
+		uint threads = num_threads ? num_threads : std::thread::hardware_concurrency();
+		return std::max(1u, std::min(threads, non_empty_groups));
+	}
+
+#ifdef USE_TBB
+	return tbb::info::default_concurrency();
+#else
+	return 1;
+#endif
+}
+
+//Greedily assigns the most expensive remaining group to the thread with the lowest cost so far
+void Simulator::_assign_unit_groups(std::vector<std::vector<uint>>& thread_groups)
+{
+	std::vector<uint> group_indices;
+	for(uint j = 0; j < _unit_groups.size(); ++j)
+		if(_unit_groups[j].end > _unit_groups[j].start)
+			group_indices.push_back(j);
+
+	std::sort(group_indices.begin(), group_indices.end(), [&](uint a, uint b)
+	{
+		return _unit_groups[a].cost > _unit_groups[b].cost;
+	});
+
+	std::vector<uint64_t> thread_costs(thread_groups.size(), 0);
+	for(uint j : group_indices)
+	{
+		uint thread_index = std::min_element(thread_costs.begin(), thread_costs.end()) - thread_costs.begin();
+		thread_groups[thread_index].push_back(j);
+		thread_costs[thread_index] += _unit_groups[j].cost;
+	}
+
+	//keep groups in registration order within a thread so neighbouring units stay together
+	for(std::vector<uint>& groups : thread_groups)
+		std::sort(groups.begin(), groups.end());
+}
+
+void Simulator::_execute_tbb(uint delta, std::function<void()>& interval_logger)
 {
 #ifdef USE_TBB
 	tbb::task_arena::constraints arena_constraints;
@@ -81,23 +713,25 @@ void Simulator::execute(uint delta, std::function<void()> interval_logger)
 		task_observer observer;
 #endif
 
-		UNIT_LOOP
-			_units[i]->reset();
-		UNIT_LOOP_END
+		GROUP_LOOP
+			_reset(_unit_groups[j]);
+		GROUP_LOOP_END
+
+		_restore_on_start();
 
+		uint threads = engine_threads();
 		do
 		{
-			UNIT_LOOP
-				_units[i]->clock_rise();
-			UNIT_LOOP_END
+			GROUP_LOOP
+				_clock_rise(_unit_groups[j]);
+			GROUP_LOOP_END
 
-			UNIT_LOOP
-				_units[i]->clock_fall();
-			UNIT_LOOP_END
+			GROUP_LOOP
+				_clock_fall(_unit_groups[j]);
+			GROUP_LOOP_END
 
-			current_cycle++;
-			if(delta != 0 && current_cycle % delta == 0)
-				interval_logger();
+			_advance_cycle(delta, interval_logger);
+			_update_rebalance(threads);
 		}
 		while(units_executing > 0);
 
@@ -106,4 +740,101 @@ void Simulator::execute(uint delta, std::function<void()> interval_logger)
 #endif
 }
 
+void Simulator::_execute_worker_pool(uint delta, std::function<void()>& interval_logger)
+{
+	std::vector<std::vector<uint>> thread_groups(engine_threads());
+	_assign_unit_groups(thread_groups);
+
+	SpinBarrier barrier(thread_groups.size());
+	bool done = false;
+
+	auto worker = [&](uint thread_index)
+	{
+		pin_thread_to_core(thread_index);
+
+		const std::vector<uint>& groups = thread_groups[thread_index];
+		bool sense = false;
+
+		for(uint j : groups)
+			_reset(_unit_groups[j]);
+
+		barrier.arrive_and_wait(sense, [&]() { _restore_on_start(); });
+
+		do
+		{
+			for(uint j : groups)
+				_clock_rise(_unit_groups[j]);
+
+			barrier.arrive_and_wait(sense);
+
+			for(uint j : groups)
+				_clock_fall(_unit_groups[j]);
+
+			//the last thread to finish the fall phase advances the cycle while the others spin
+			barrier.arrive_and_wait(sense, [&]()
+			{
+				_advance_cycle(delta, interval_logger);
+				if(_update_rebalance(thread_groups.size()))
+				{
+					for(std::vector<uint>& groups : thread_groups)
+						groups.clear();
+					_assign_unit_groups(thread_groups);
+				}
+
+				done = units_executing == 0;
+			});
+		}
+		while(!done);
+	};
+
+	std::vector<std::thread> threads;
+	for(uint thread_index = 0; thread_index < thread_groups.size(); ++thread_index)
+		threads.emplace_back(worker, thread_index);
+
+	for(std::thread& thread : threads)
+		thread.join();
+}
+
+void Simulator::execute(uint delta, std::function<void()> interval_logger)
+{
+	_wake_masks = std::vector<std::atomic_uint64_t>((_units.size() + 63) / 64);
+
+	//all domains start with an edge at the current core cycle
+	ClockDomain& core_domain = _clock_domains[0];
+	for(ClockDomain& domain : _clock_domains)
+	{
+		domain.period = std::max<cycles_t>(std::llround(TIMELINE_TICKS_PER_SECOND / domain.frequency), 1);
+		domain.cycle = (core_domain.edge_time(current_cycle) + domain.period - 1) / domain.period;
+		domain.pending_skip = 0;
+	}
+	_pending_skip = false;
+	_write_horizon = 0;
+	_schedule_edges();
+
+	_unit_ticks.assign(_units.size(), 0);
+	for(UnitGroup& group : _unit_groups)
+		group.cost = group.end - group.start;
+
+	//the first profile window starts right away
+	_profiling = rebalance_groups;
+	_profile_end = rebalance_window;
+	_next_rebalance = 0;
+
+	_unit_profiles.assign(_units.size(), Profiler::UnitProfile());
+
+	_checkpoint_pending = checkpoint_cycle != 0;
+
+	//calibrate the timestamp counter against wall time over the whole run
+	auto start_time = std::chrono::high_resolution_clock::now();
+	uint64_t start_ticks = __rdtsc();
+
+	if(engine == Engine::WORKER_POOL) _execute_worker_pool(delta, interval_logger);
+	else                              _execute_tbb(delta, interval_logger);
+
+	current_cycle = core_domain.cycle;
+
+	_execute_ticks = __rdtsc() - start_ticks;
+	_execute_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+}
+
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 #include "stdafx.hpp"
 
+#include "profiler.hpp"
+#include "checkpoint.hpp"
+
 namespace Arches {
 
 namespace Units
@@ -10,32 +13,164 @@ namespace Units
 
 class Simulator
 {
+public:
+	enum class Engine
+	{
+		TBB,         //tbb::parallel_for over the unit groups for every phase
+		WORKER_POOL, //persistent pinned threads that each own a fixed set of unit groups
+	};
+
 private:
 	struct UnitGroup
 	{
 		uint start;
 		uint end;
 
+		std::vector<uint> active;         //indices of the units clocked this cycle in registration order
+		std::vector<uint> sleep_requests; //units that called sleep() during the last cycle
+		uint64_t unit_clocks{0};
+		uint64_t cost{0};                 //measured ticks from the last profile window, or the unit count before one ran
+		cycles_t next_event{NO_EVENT};    //timeline time of the earliest next_event_cycle() reported by the group's active units
+		cycles_t write_horizon{0};        //set when the group wrote to a port this step, see _clock_fall
+
 		UnitGroup() = default;
 		UnitGroup(uint start, uint end) : start(start), end(end) {}
 	};
 
+	//Every domain has a rising edge at each multiple of its period on a common timeline. A step clocks every domain
+	//with an edge at the earliest pending time, rise then fall, so interconnects between domains keep the usual
+	//protocol: a write on one domain's fall is visible to the next rise of the other.
+	struct ClockDomain
+	{
+		double frequency;
+		cycles_t period{1};       //timeline ticks between edges
+		cycles_t cycle{0};        //edges completed before the current step
+		cycles_t pending_skip{0}; //edges jumped over at the end of the last step
+		uint num_units{0};
+		bool ticking{true};       //has an edge in the current step
+
+		ClockDomain(double frequency) : frequency(frequency) {}
+
+		cycles_t edge_time(cycles_t edge) const { return edge * period; }
+	};
+
 	std::vector<UnitGroup> _unit_groups;
 	std::vector<Units::UnitBase*> _units;
+	std::vector<std::atomic_uint64_t> _wake_masks; //one bit per unit, set when a sleeping unit is written to
+
+	std::vector<ClockDomain> _clock_domains;
+	bool _all_ticking{true};                        //every domain has an edge in the current step
+	bool _pending_skip{false};                      //some domain jumped over edges at the end of the last step
+	cycles_t _next_edge_time{0};                    //earliest edge after the current step
+	cycles_t _edge_horizon{0};                      //time by which every domain has an edge after the current step
+	cycles_t _write_horizon{0};                     //no skipping until every domain has ticked since the last port write
+
+	//rebalancing state
+	std::vector<uint64_t> _unit_ticks;              //wall time per unit over the current profile window
+	bool _profiling{false};
+	cycles_t _profile_end{0};
+	cycles_t _next_rebalance{0};
+	uint64_t _retired_unit_clocks{0};               //unit_clocks of groups replaced by a rebalance
+
+	//unit profiling state
+	std::vector<Profiler::UnitProfile> _unit_profiles;
+	uint64_t _execute_ticks{0};
+	double _execute_seconds{0.0};
+
+	bool _checkpoint_pending{false};
 
 public:
+	static constexpr cycles_t NO_EVENT = std::numeric_limits<cycles_t>::max();
+	static constexpr double TIMELINE_TICKS_PER_SECOND = 1.0e15; //femtosecond resolution
+
+	//Interconnect writes made by the calling thread. Sampled around clock fall to detect transactions that the
+	//receiving unit could not have seen when it reported its next event.
+	inline static thread_local uint64_t port_writes{0};
+
 	std::atomic_uint units_executing{0};
-	cycles_t current_cycle{0};
+	cycles_t current_cycle{0}; //cycle of clock domain 0, the core clock
+	cycles_t skipped_cycles{0};
 
-	Simulator() { _unit_groups.emplace_back(0u, 0u); }
+	Engine engine{Engine::TBB};
+	uint num_threads{0}; //0 uses all hardware threads
+	bool skip_idle_units{true};
+	bool skip_to_next_event{true};
 
-	void register_unit(Units::UnitBase* unit);
+	//Profile guided rebalancing. Unit wall time is measured for rebalance_window cycles, then the units are split into
+	//one contiguous group of equal cost per thread. Repeats every rebalance_period cycles, 0 only rebalances once.
+	bool rebalance_groups{true};
+	cycles_t rebalance_window{1024};
+	cycles_t rebalance_period{0};
+	uint num_rebalances{0};
+	float initial_imbalance{1.0f}; //max thread load over mean thread load before the first rebalance
+	float last_imbalance{1.0f};    //predicted imbalance after the most recent rebalance
+
+	//Times every unit's clock rise and fall for the whole run. Off by default since reading the timestamp counter around
+	//every clock costs more than most units do.
+	bool profile_units{false};
+
+	//Sampled simulation. While set, units that support it run functionally with no timing and only keep the state that
+	//later detailed cycles depend on (cache tags, thread contexts) warm. Only changed between steps.
+	bool fast_forward{false};
+
+	//Checkpointing. The state of every unit is written to checkpoint_path once the core clock reaches checkpoint_cycle,
+	//0 never saves. With restore_path set execute() loads that checkpoint after reset and continues from its cycle, so
+	//repeated runs with the same configuration can skip warmup.
+	cycles_t checkpoint_cycle{0};
+	std::string checkpoint_path{"checkpoint.bin"};
+	std::string restore_path{""};
+
+	Simulator(double core_frequency = 1.0e9)
+	{
+		_unit_groups.emplace_back(0u, 0u);
+		_clock_domains.emplace_back(core_frequency);
+	}
+
+	void register_unit(Units::UnitBase* unit, uint clock_domain = 0);
 	void new_unit_group();
 
-	void _clock_rise();
-	void _clock_fall();
+	//Returns the domain clocked at frequency (Hz), creating it if needed. Domain 0 is the core clock.
+	uint add_clock_domain(double frequency);
+
+	//Current cycle of a domain, or the last cycle it was clocked in if it has no edge in the current step
+	cycles_t domain_cycle(uint clock_domain) const
+	{
+		const ClockDomain& domain = _clock_domains[clock_domain];
+		return domain.ticking ? domain.cycle : domain.cycle - 1;
+	}
 
 	void execute(uint epsilon = 0, std::function<void()> interval_logger = nullptr);
+
+	const char* engine_name() const;
+	uint engine_threads() const;
+	double active_unit_ratio() const;
+
+	void print_unit_profile(FILE* stream = stdout) const;
+	void write_unit_profile_json(const std::string& path) const;
+
+	//Only valid between steps or before execute(). Restore expects every unit to be registered and reset.
+	bool save_checkpoint(const std::string& path);
+	bool restore_checkpoint(const std::string& path);
+
+	void _wake_unit(uint unit_index);
+
+private:
+	void _reset(UnitGroup& group);
+	void _update_activity(UnitGroup& group);
+	void _clock_unit(uint unit_index, Profiler::Phase phase);
+	void _clock_rise(UnitGroup& group);
+	void _clock_fall(UnitGroup& group);
+	void _advance_cycle(uint delta, std::function<void()>& interval_logger);
+	void _skip_to_next_event(uint delta, std::function<void()>& interval_logger);
+	void _schedule_edges();
+	void _restore_on_start();
+	bool _update_rebalance(uint num_threads);
+	bool _rebalance(uint num_threads);
+	float _load_imbalance(std::vector<std::vector<uint>>& thread_groups);
+
+	void _execute_tbb(uint delta, std::function<void()>& interval_logger);
+	void _execute_worker_pool(uint delta, std::function<void()>& interval_logger);
+	void _assign_unit_groups(std::vector<std::vector<uint>>& thread_groups);
 };
 
-}
\ No newline at end of file
+}
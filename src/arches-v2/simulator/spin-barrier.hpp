@@ -0,0 +1,42 @@
+#pragma once
+#include "stdafx.hpp"
+
+namespace Arches {
+
+//Lock free sense reversing barrier. Each participant keeps its own local sense which is flipped on every arrival.
+//The last thread to arrive optionally runs a completion function before releasing the others so serial work
+//(cycle counting, logging) can be folded into the barrier instead of requiring a second one.
+class alignas(64) SpinBarrier
+{
+private:
+	alignas(64) std::atomic_uint _count;
+	alignas(64) std::atomic_bool _sense{false};
+	const uint _num_threads;
+
+public:
+	SpinBarrier(uint num_threads) : _count(num_threads), _num_threads(num_threads) {}
+
+	template<typename FUNC>
+	void arrive_and_wait(bool& local_sense, FUNC completion)
+	{
+		local_sense = !local_sense;
+		if(_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			completion();
+			_count.store(_num_threads, std::memory_order_relaxed);
+			_sense.store(local_sense, std::memory_order_release);
+		}
+		else
+		{
+			while(_sense.load(std::memory_order_acquire) != local_sense)
+				_mm_pause();
+		}
+	}
+
+	void arrive_and_wait(bool& local_sense)
+	{
+		arrive_and_wait(local_sense, []() {});
+	}
+};
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "stdafx.hpp"
+
+namespace Arches {
+
+//Arena shared by every network carrying T. Networks keep 8 byte handles in their fifos so moving a transaction between
+//fifos never copies its payload, it is copied in when a source writes and out when a sink reads.
+//Slots live in fixed size chunks that are never moved or freed so handles stay valid while the arena grows. Sources
+//and sinks run on different threads so each thread allocates from and frees to its own free list, lists that grow too
+//long are handed back in batches so a thread that only frees doesn't hoard slots a thread that only allocates needs.
+template<typename T>
+class TransactionPool
+{
+public:
+	struct Handle
+	{
+		uint32_t index{~0u};
+		uint32_t generation{0};
+	};
+
+private:
+	constexpr static uint CHUNK_SIZE = 1024;
+	constexpr static uint MAX_CHUNKS = 4096;
+	constexpr static uint BATCH_SIZE = 256;
+
+	struct Slot
+	{
+		T value;
+		uint32_t generation{0};
+		uint32_t next{~0u};
+	};
+
+	struct FreeList
+	{
+		uint32_t head{~0u};
+		uint32_t size{0};
+	};
+
+	inline static Slot* _chunks[MAX_CHUNKS]{};
+	inline static uint _num_chunks{0};
+	inline static std::vector<FreeList> _batches;
+	inline static std::mutex _mutex;
+	inline static thread_local FreeList _free;
+
+	static Slot& _slot(uint32_t index)
+	{
+		return _chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+	}
+
+	//refills the thread's free list with a returned batch or a new chunk
+	static void _refill()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if(!_batches.empty())
+		{
+			_free = _batches.back();
+			_batches.pop_back();
+			return;
+		}
+
+		_assert(_num_chunks < MAX_CHUNKS);
+		Slot* chunk = new Slot[CHUNK_SIZE];
+		uint32_t base = _num_chunks * CHUNK_SIZE;
+		for(uint i = 0; i < CHUNK_SIZE; ++i)
+			chunk[i].next = i + 1 < CHUNK_SIZE ? base + i + 1 : ~0u;
+		_chunks[_num_chunks++] = chunk;
+		_free.head = base;
+		_free.size = CHUNK_SIZE;
+	}
+
+	//hands the first BATCH_SIZE slots of the thread's free list back to the arena
+	static void _release_batch()
+	{
+		FreeList batch{_free.head, BATCH_SIZE};
+		uint32_t tail = _free.head;
+		for(uint i = 1; i < BATCH_SIZE; ++i)
+			tail = _slot(tail).next;
+
+		_free.head = _slot(tail).next;
+		_free.size -= BATCH_SIZE;
+		_slot(tail).next = ~0u;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_batches.push_back(batch);
+	}
+
+public:
+	static Handle allocate(const T& value)
+	{
+		if(_free.size == 0) _refill();
+
+		uint32_t index = _free.head;
+		Slot& slot = _slot(index);
+		_free.head = slot.next;
+		_free.size--;
+
+		slot.value = value;
+		return {index, slot.generation};
+	}
+
+	static void free(Handle handle)
+	{
+		Slot& slot = _slot(handle.index);
+		_assert(slot.generation == handle.generation);
+		slot.generation++;
+		slot.next = _free.head;
+		_free.head = handle.index;
+		if(++_free.size >= 2 * BATCH_SIZE) _release_batch();
+	}
+
+	static T& get(Handle handle)
+	{
+		Slot& slot = _slot(handle.index);
+		_assert(slot.generation == handle.generation);
+		return slot.value;
+	}
+};
+
+}
@@ -31,10 +31,20 @@ struct MemoryRequest
 		CSHIT,
 	};
 
+	//expected reuse of the requested data, used by the BVH_HINT replacement policy
+	enum class Hint : uint8_t
+	{
+		NONE,
+		HIGH_REUSE,
+		LOW_REUSE,
+		STREAMING,
+	};
+
 	struct Flags
 	{
 		uint8_t omit_cache : 3;
-		uint8_t : 5;
+		uint8_t hint : 2;
+		uint8_t : 3;
 	};
 
 	const static uint MAX_SIZE = CACHE_SECTOR_SIZE;
@@ -81,6 +91,9 @@ struct MemoryRequest
 		std::memcpy(data, other.data, other.size);
 		return *this;
 	}
+	//plain data under the user defined copy, saved whole
+	template<typename CP>
+	void checkpoint(CP& checkpoint) { checkpoint.io_bytes(this, sizeof(*this)); }
 };
 
 struct MemoryReturn
@@ -138,6 +151,8 @@ struct MemoryReturn
 		std::memcpy(data, other.data, size);
 		return *this;
 	}
+	template<typename CP>
+	void checkpoint(CP& checkpoint) { checkpoint.io_bytes(this, sizeof(*this)); }
 };
 
 struct StreamSchedulerRequest
@@ -125,8 +125,11 @@
 #include <cstring>
 
 #include <atomic>
+#include <chrono>
+#include <limits>
 #include <mutex>
 #include <thread>
+#include <typeinfo>
 
 #include <deque>
 #include <map>
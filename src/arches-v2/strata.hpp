@@ -149,10 +149,11 @@ static STRaTAKernel::Args initilize_buffers(Units::UnitMainMemoryBase* main_memo
 	args.framebuffer_size = args.framebuffer_width * args.framebuffer_height;
 	heap_address = align_to(page_size, heap_address);
 	args.framebuffer = reinterpret_cast<uint32_t*>(heap_address);
+	RegionMap::get_instance().add_region("framebuffer", heap_address, args.framebuffer_size * sizeof(uint32_t));
 	heap_address += args.framebuffer_size * sizeof(uint32_t);
 
 	std::vector<rtm::Hit> hits(args.framebuffer_size, {T_MAX, rtm::vec2(0.0), ~0u});
-	args.hit_records = write_vector(main_memory, page_size, hits, heap_address);
+	args.hit_records = write_vector(main_memory, page_size, hits, heap_address, "hit_records");
 
 	args.raybuffer_size = raybuffer_size;
 	args.max_init_ray = std::min(args.raybuffer_size / (uint32_t)sizeof(STRaTAKernel::RayData), args.framebuffer_size);
@@ -180,18 +181,18 @@ static STRaTAKernel::Args initilize_buffers(Units::UnitMainMemoryBase* main_memo
 
 	rtm::CompressedWideBVHSTRaTA cwbvh(wbvh);
 	rtm::CompressedWideTreeletBVHSTRaTA cwtbvh(cwbvh, mesh, 1024);
-	args.treelets = write_vector(main_memory, page_size, cwtbvh.treelets, heap_address);
+	args.treelets = write_vector(main_memory, page_size, cwtbvh.treelets, heap_address, "treelets");
 #else
 	rtm::WideBVHSTRaTA wbvh(bvh2, build_objects);
 	mesh.reorder(build_objects);
 	rtm::WideTreeletBVHSTRaTA wtbvh(wbvh, mesh, 1024);
-	args.treelets = write_vector(main_memory, page_size, wtbvh.treelets, heap_address);
+	args.treelets = write_vector(main_memory, page_size, wtbvh.treelets, heap_address, "treelets");
 #endif
 
 	std::vector<rtm::Triangle> tris;
 	mesh.get_triangles(tris);
-	args.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address);
-	args.rays = write_vector(main_memory, CACHE_BLOCK_SIZE, rays, heap_address);
+	args.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address, "tris");
+	args.rays = write_vector(main_memory, CACHE_BLOCK_SIZE, rays, heap_address, "rays");
 	main_memory->direct_write(&args, sizeof(STRaTAKernel::Args), KERNEL_ARGS_ADDRESS);
 	return args;
 }
@@ -286,6 +287,7 @@ void run_sim_strata(const SimulationConfig& sim_config)
 	uint num_sfus = static_cast<uint>(ISA::RISCV::InstrType::NUM_TYPES) * num_tms;
 
 	Simulator simulator;
+	configure_simulator(simulator, sim_config);
 	std::vector<Units::STRaTA::UnitTP*> tps;
 	std::vector<Units::UnitSFU*> sfus;
 	std::vector<Units::UnitThreadScheduler*> thread_schedulers;
@@ -452,6 +454,8 @@ void run_sim_strata(const SimulationConfig& sim_config)
 		printf(" L2$ Hit Rate: %8.1f%%\n", 100.0 * (l2_delta_log.hits + l2_delta_log.half_misses) / l2_delta_log.get_total());
 		printf("L1d$ Hit Rate: %8.1f%%\n", 100.0 * (l1d_delta_log.hits + l1d_delta_log.half_misses) / l1d_delta_log.get_total());
 		printf("                             \n");
+		dram_delta_log.print_short();
+		printf("                             \n");
 	});
 	auto stop = std::chrono::high_resolution_clock::now();
 
@@ -465,16 +469,19 @@ void run_sim_strata(const SimulationConfig& sim_config)
 	print_header("DRAM");
 	delta_log(dram_log, dram);
 	dram_log.print(frame_cycles);
+	dram_log.regions.print(false);
 	float total_power = dram.total_power();
 
 	print_header("L2$");
 	delta_log(l2_log, l2);
 	l2_log.print(frame_cycles);
+	l2_log.regions.print();
 	total_power += l2_log.print_power(l2_power_config, frame_time);
 
 	print_header("L1d$");
 	delta_log(l1d_log, l1ds);
 	l1d_log.print(frame_cycles);
+	l1d_log.regions.print();
 	total_power += l1d_log.print_power(l1d_power_config, frame_time);
 
 	print_header("TP");
@@ -507,9 +514,10 @@ void run_sim_strata(const SimulationConfig& sim_config)
 	else              printf("MRays/J: %.2f\n", kernel_args.framebuffer_size / total_energy / 1'000'000.0);
 
 	print_header("Simulation Summary");
-	printf("Simulation rate: %.2f KHz\n", simulator.current_cycle / simulation_time / 1000.0);
+	print_simulation_rate(simulator, sim_config, simulator.current_cycle, simulation_time);
 	printf("Simulation time: %.0f s\n", simulation_time);
 	printf("MSIPS: %.2f\n", simulator.current_cycle * tps.size() / simulation_time / 1'000'000.0);
+	print_simulation_profile(simulator, sim_config);
 
 	stbi_flip_vertically_on_write(true);
 	dram.dump_as_png_uint8((paddr_t)kernel_args.framebuffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, "out.png");
@@ -118,7 +118,13 @@ namespace TRaX {
 #include "trax-kernel/include.hpp"
 #include "trax-kernel/intersect.hpp"
 
+#define TRAX_USE_FAST_DRAM 0
+
+#if TRAX_USE_FAST_DRAM
+typedef Units::UnitDRAMFast UnitDRAM;
+#else
 typedef Units::UnitDRAMRamulator UnitDRAM;
+#endif
 typedef Units::UnitCache UnitL2Cache;
 typedef Units::UnitCache UnitL1Cache;
 //typedef Units::TRaX::UnitTreeletRTCore UnitRTCore;
@@ -139,6 +145,7 @@ static TRaXKernelArgs initilize_buffers(uint8_t* main_memory, paddr_t& heap_addr
 	args.framebuffer_size = args.framebuffer_width * args.framebuffer_height;
 	heap_address = align_to(page_size, heap_address);
 	args.framebuffer = reinterpret_cast<uint32_t*>(heap_address);
+	RegionMap::get_instance().add_region("framebuffer", heap_address, args.framebuffer_size * sizeof(uint32_t));
 	heap_address += args.framebuffer_size * sizeof(uint32_t);
 
 	args.pregen_rays = sim_config.get_int("pregen_rays");
@@ -163,22 +170,22 @@ static TRaXKernelArgs initilize_buffers(uint8_t* main_memory, paddr_t& heap_addr
 	//args.nodes = write_vector(main_memory, 256, wbvh.nodes, heap_address);
 	mesh.reorder(build_objects);
 
-	args.strips = write_vector(main_memory, 256, wbvh.triangle_strips, heap_address);;
+	args.strips = write_vector(main_memory, 256, wbvh.triangle_strips, heap_address, "strips");
 
 	rtm::NVCWBVH cwbvh(wbvh);
-	args.nodes = write_vector(main_memory, 256, cwbvh.nodes, heap_address);
+	args.nodes = write_vector(main_memory, 256, cwbvh.nodes, heap_address, "nodes");
 
 	//rtm::HECWBVH hecwbvh(wbvh, wbvh.triangle_strips);
 	//args.nodes = write_vector(main_memory, 256, hecwbvh.nodes, heap_address);
 
 	std::vector<rtm::Triangle> tris;
 	mesh.get_triangles(tris);
-	args.tris = write_vector(main_memory, 256, tris, heap_address);
+	args.tris = write_vector(main_memory, 256, tris, heap_address, "tris");
 
 	std::vector<rtm::Ray> rays(args.framebuffer_size);
 	if(args.pregen_rays)
 		pregen_rays(args.framebuffer_width, args.framebuffer_height, args.camera, cwbvh.nodes.data(), wbvh.triangle_strips.data(), tris.data(), sim_config.get_int("pregen_bounce"), rays);
-	args.rays = write_vector(main_memory, 256, rays, heap_address);
+	args.rays = write_vector(main_memory, 256, rays, heap_address, "rays");
 
 	std::memcpy(main_memory + TRAX_KERNEL_ARGS_ADDRESS, &args, sizeof(TRaXKernelArgs));
 	return args;
@@ -206,8 +213,7 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	UnitDRAM::Configuration dram_config;
 	dram_config.config_path = project_folder_path + "build\\src\\arches-v2\\config-files\\gddr6x_21000_config.yaml";
 	dram_config.size = 1ull << 30; //1GB per partition
-	dram_config.clock_ratio = dram_clock / core_clock;
-	dram_config.latency - 92;
+	dram_config.latency = (uint)(92 * dram_clock / core_clock); //92 core cycles
 
 	//L2$
 	UnitL2Cache::Configuration l2_config;
@@ -235,7 +241,7 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	l1d_config.miss_alloc = true;
 	l1d_config.size = 128 << 10;
 	l1d_config.associativity = 32;
-	l1d_config.policy = Units::UnitCacheBase::Policy::RANDOM;
+	l1d_config.policy = Units::UnitCacheBase::Policy::LRU_RANDOM;
 	l1d_config.num_banks = 4;
 	l1d_config.crossbar_width = l1d_config.num_banks;
 	l1d_config.num_mshr = 512;
@@ -275,8 +281,7 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	UnitDRAM::Configuration dram_config;
 	dram_config.config_path = project_folder_path + "build\\src\\arches-v2\\config-files\\gddr6_14000_config.yaml";
 	dram_config.size = 1ull << 30; //1GB
-	dram_config.clock_ratio = dram_clock / core_clock;
-	dram_config.latency = 92;
+	dram_config.latency = (uint)(92 * dram_clock / core_clock); //92 core cycles
 
 	//L2$
 	UnitL2Cache::Configuration l2_config;
@@ -332,9 +337,8 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	UnitDRAM::Configuration dram_config;
 	dram_config.config_path = project_folder_path + "build\\src\\arches-v2\\config-files\\gddr6_pch_config.yaml";
 	dram_config.size = 1ull << 30; //1GB
-	dram_config.clock_ratio = dram_clock / core_clock;
-	dram_config.latency = 1;
-	//dram_config.latency = 56;
+	dram_config.latency = (uint)(dram_clock / core_clock); //1 core cycle
+	//dram_config.latency = (uint)(56 * dram_clock / core_clock);
 
 	//L2$
 	UnitL2Cache::Configuration l2_config;
@@ -381,7 +385,19 @@ static void run_sim_trax(SimulationConfig& sim_config)
 
 	uint num_sfus = static_cast<uint>(ISA::RISCV::InstrType::NUM_TYPES) * num_tms;
 
-	Simulator simulator;
+	l1d_config.policy = get_cache_policy(sim_config, "l1_policy", l1d_config.policy);
+	l2_config.policy = get_cache_policy(sim_config, "l2_policy", l2_config.policy);
+	l1d_config.reuse_sample_rate = sim_config.get_float("l1_reuse_profile");
+	l2_config.reuse_sample_rate = sim_config.get_float("l2_reuse_profile");
+	l1d_config.compressed = sim_config.get_int("l1_compression");
+	l2_config.compressed = sim_config.get_int("l2_compression");
+	xbar_config.partition_hash = get_address_hash(sim_config, "partition_hash");
+	xbar_config.slice_hash = get_address_hash(sim_config, "slice_hash");
+	l2_config.bank_hash = xbar_config.slice_hash; //the L2 routes to its slices the same way the crossbar does
+	l1d_config.bank_hash = get_address_hash(sim_config, "l1_bank_hash");
+
+	Simulator simulator(core_clock);
+	configure_simulator(simulator, sim_config);
 	std::vector<Units::UnitTP*> tps;
 	std::vector<Units::UnitSFU*> sfus;
 	std::vector<Units::UnitThreadScheduler*> thread_schedulers;
@@ -395,11 +411,17 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	std::vector<UnitDRAM*> drams;
 	std::vector<UnitL2Cache*> l2s;
 	dram_config.num_ports = l2_config.num_slices;
+#if !TRAX_USE_FAST_DRAM
+	dram_config.calibrate = sim_config.get_int("dram_calibrate");
+#endif
 	l2_config.num_ports = l2_config.num_slices;
+	RegionMap::get_instance().set_partitions(AddressHash(num_partitions, partition_stride, xbar_config.partition_hash));
 	for(uint i = 0; i < num_partitions; ++i)
 	{
+		dram_config.partition = i;
+		l2_config.partition = i;
 		drams.push_back(_new UnitDRAM(dram_config));
-		simulator.register_unit(drams.back());
+		simulator.register_unit(drams.back(), simulator.add_clock_domain(dram_clock));
 
 		l2_config.mem_higher_port = 0;
 		l2_config.mem_highers = {drams.back()};
@@ -411,8 +433,8 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	}
 
 	xbar_config.num_clients = num_tms;
-	Units::UnitCrossbar xbar(xbar_config);
-	simulator.register_unit(&xbar);
+	Units::UnitPartitionInterconnect* xbar = new_partition_interconnect(xbar_config, sim_config);
+	simulator.register_unit(xbar);
 	simulator.new_unit_group();
 
 	uint8_t* device_mem = (uint8_t*)malloc(3 << 29);
@@ -421,7 +443,7 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	heap_address = align_to(partition_stride, heap_address);
 
 	for(uint addr = 0; addr < heap_address; addr += partition_stride)
-		drams[xbar.get_partition(addr)]->direct_write(device_mem + addr, partition_stride, xbar.strip_partition_bits(addr));
+		drams[xbar->get_partition(addr)]->direct_write(device_mem + addr, partition_stride, xbar->strip_partition_bits(addr));
 
 	bool warm_l2 = false;
 	if(warm_l2)
@@ -429,7 +451,7 @@ static void run_sim_trax(SimulationConfig& sim_config)
 		paddr_t start = (paddr_t)kernel_args.nodes & ~(1 - partition_stride);
 		paddr_t end = start + l2_config.size * num_partitions;
 		for(paddr_t block_addr = end - l2_config.block_size; block_addr >= start; block_addr -= l2_config.block_size)
-			l2s[xbar.get_partition(block_addr)]->direct_write(xbar.strip_partition_bits(block_addr), device_mem + block_addr);
+			l2s[xbar->get_partition(block_addr)]->direct_write(xbar->strip_partition_bits(block_addr), device_mem + block_addr);
 	}
 
 	bool deserialize_l2 = false, serialize_l2 = !deserialize_l2;
@@ -442,10 +464,17 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	simulator.new_unit_group();
 
 	l1d_config.num_ports = num_tps;
-	l1d_config.mem_highers = {&xbar};
+	l1d_config.mem_highers = {xbar};
 #if TRAX_USE_RT_CORE
 	l1d_config.num_ports += num_tps;
 	l1d_config.crossbar_width *= 2;
+
+	//the RT cores hint node and strip fetches which is what the prefetchers key on
+	l1d_config.bvh_prefetch_degree = sim_config.get_int("l1_bvh_prefetch");
+	l1d_config.node_base_addr = (paddr_t)kernel_args.nodes;
+	l1d_config.tri_base_addr = (paddr_t)kernel_args.strips;
+	l1d_config.tri_size = sizeof(rtm::TriangleStrip);
+	l1d_config.stream_prefetch_degree = sim_config.get_int("l1_stream_prefetch");
 #endif
 
 	for(uint tm_index = 0; tm_index < num_tms; ++tm_index)
@@ -528,6 +557,7 @@ static void run_sim_trax(SimulationConfig& sim_config)
 		tp_config.unique_mems = &mem_lists.back();
 		tp_config.unique_sfus = &sfu_lists.back();
 		tp_config.num_threads = num_threads;
+		tp_config.store_omit_cache = sim_config.get_int("cache_stores") ? 0b011 : 0b111; //L1s are private and not coherent so only L2 caches stores
 		for(uint tp_index = 0; tp_index < num_tps; ++tp_index)
 		{
 			tp_config.tp_index = tp_index;
@@ -559,6 +589,8 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	float peak_l2_bandwidth = num_partitions * l2_config.num_slices * MemoryRequest::MAX_SIZE;
 	float peak_l1d_bandwidth = num_tms * l1d_config.num_banks * MemoryRequest::MAX_SIZE;
 
+	SimulationSampler sampler(simulator, sim_config);
+
 	auto start = std::chrono::high_resolution_clock::now();
 	simulator.execute(delta, [&]() -> void
 	{
@@ -569,6 +601,20 @@ static void run_sim_trax(SimulationConfig& sim_config)
 
 		double simulation_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1000.0;
 
+		SimulationSampler::Phase phase = sampler.phase();
+		if(sampler.enabled())
+		{
+			Units::UnitTP::Log tp_delta_log = delta_log(tp_log, tps);
+			sampler.end_interval({(double)delta, (double)tp_delta_log.get_instructions(), (double)dram_delta_log.bytes_read});
+		}
+
+		if(phase == SimulationSampler::Phase::FAST_FORWARD)
+		{
+			printf("Cycle: %lld (fast forward)  \n", simulator.current_cycle);
+			printf("Threads Launched: %d        \n", atomic_regs.iregs[0]);
+			return;
+		}
+
 		printf("                            \n");
 		printf("Cycle: %lld                 \n", simulator.current_cycle);
 		printf("Threads Launched: %d        \n", atomic_regs.iregs[0]);
@@ -577,6 +623,9 @@ static void run_sim_trax(SimulationConfig& sim_config)
 		printf("DRAM Read: %8.1f GB/s  (%.2f%%)\n", (float)dram_delta_log.bytes_read / delta_ns, 100.0f * dram_delta_log.bytes_read / delta / peak_dram_bandwidth);
 		printf(" L2$ Read: %8.1f B/clk (%.2f%%)\n", (float)l2_delta_log.bytes_read / delta, 100.0f * l2_delta_log.bytes_read / delta / peak_l2_bandwidth);
 		printf("L1d$ Read: %8.1f B/clk (%.2f%%)\n", (float)l1d_delta_log.bytes_read / delta, 100.0 * l1d_delta_log.bytes_read / delta / peak_l1d_bandwidth);
+		printf("DRAM Write: %8.1f GB/s\n", (float)dram_delta_log.bytes_written / delta_ns);
+		printf(" L2$ Write: %8.1f B/clk\n", (float)l2_delta_log.bytes_written / delta);
+		printf("L1d$ Write: %8.1f B/clk\n", (float)l1d_delta_log.bytes_written / delta);
 		printf("                            \n");
 		printf(" L2$ Hit/Half/Miss: %3.1f%%/%3.1f%%/%3.1f%%\n", 100.0 * l2_delta_log.hits / l2_delta_log.get_total(), 100.0 * l2_delta_log.half_misses / l2_delta_log.get_total(), 100.0 * l2_delta_log.misses / l2_delta_log.get_total());
 		printf("L1d$ Hit/Half/Miss: %3.1f%%/%3.1f%%/%3.1f%%\n", 100.0 * l1d_delta_log.hits / l1d_delta_log.get_total(), 100.0 * l1d_delta_log.half_misses / l1d_delta_log.get_total(), 100.0 * l1d_delta_log.misses / l1d_delta_log.get_total());
@@ -587,6 +636,12 @@ static void run_sim_trax(SimulationConfig& sim_config)
 		printf("L2$  Occ: %0.2f%%\n", 100.0 * l2_delta_log.get_total() / num_partitions / l2_config.num_slices / l2_config.num_banks / delta);
 		printf("L1d$ Occ: %0.2f%%\n", 100.0 * l1d_delta_log.get_total() / num_tms  / l1d_config.num_banks / delta);
 		printf("                            \n");
+		dram_delta_log.print_short();
+		printf("                            \n");
+		dram_delta_log.regions.print_short("DRAM");
+		l2_delta_log.regions.print_short(" L2$");
+		l1d_delta_log.regions.print_short("L1d$");
+		printf("                            \n");
 		if(!rtcs.empty())
 		{
 			printf("MRays/s: %.0f\n\n", rtc_delta_log.rays / delta_ns * 1000.0);
@@ -596,8 +651,12 @@ static void run_sim_trax(SimulationConfig& sim_config)
 
 	auto stop = std::chrono::high_resolution_clock::now();
 
+	//dirty lines still in the caches hold the newest data, write them back before reading memory
+	for(auto& l1d : l1ds) l1d->functional_flush();
+	for(auto& l2 : l2s) l2->functional_flush();
+
 	for(uint addr = 0; addr < heap_address; addr += partition_stride)
-		drams[xbar.get_partition(addr)]->direct_read(device_mem + addr, partition_stride, xbar.strip_partition_bits(addr));
+		drams[xbar->get_partition(addr)]->direct_read(device_mem + addr, partition_stride, xbar->strip_partition_bits(addr));
 
 	if(serialize_l2)
 		for(uint i = 0; i < num_partitions; ++i)
@@ -619,17 +678,27 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	delta_log(dram_log, drams);
 	printf("DRAM Read: %.1f GB/s (%.2f%%)\n", (float)dram_log.bytes_read / frame_cycles, 100.0f * dram_log.bytes_read / frame_cycles / peak_dram_bandwidth);
 	dram_log.print(frame_cycles);
+	dram_log.regions.print(false);
 
 	print_header("L2$");
 	delta_log(l2_log, l2s);
 	printf(" L2$ Read: %.1f B/clk (%.2f%%)\n", (float)l2_log.bytes_read / frame_cycles, 100.0f * l2_log.bytes_read / frame_cycles / peak_l2_bandwidth);
+	printf(" L2$ Write: %.1f B/clk (%.1f B/clk written back)\n", (float)l2_log.bytes_written / frame_cycles, (float)l2_log.bytes_written_back / frame_cycles);
 	l2_log.print(frame_cycles);
+	l2_log.regions.print();
+	l2_log.print_miss_ratio_curve(l2_config.block_size);
 	total_power += l2_log.print_power(l2_power_config, frame_time);
 
+	print_header("L2$ Interconnect");
+	xbar->print_stats(frame_cycles);
+
 	print_header("L1d$");
 	delta_log(l1d_log, l1ds);
 	printf("L1d$ Read: %.1f B/clk (%.2f%%)\n", (float)l1d_log.bytes_read / frame_cycles, 100.0 * l1d_log.bytes_read / frame_cycles / peak_l1d_bandwidth);
+	printf("L1d$ Write: %.1f B/clk (%.1f B/clk written back)\n", (float)l1d_log.bytes_written / frame_cycles, (float)l1d_log.bytes_written_back / frame_cycles);
 	l1d_log.print(frame_cycles);
+	l1d_log.regions.print();
+	l1d_log.print_miss_ratio_curve(l1d_config.block_size);
 	total_power += l1d_log.print_power(l1d_power_config, frame_time);
 
 	print_header("TP");
@@ -652,6 +721,12 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	if(!rtcs.empty()) printf("MRays/s: %.0f\n", rtc_log.rays / frame_time / 1'000'000.0);
 	else              printf("MRays/s: %.0f\n", kernel_args.framebuffer_size / frame_time / 1'000'000.0);
 
+	if(sampler.enabled())
+	{
+		print_header("Sampled Performance Summary");
+		sampler.print(tp_log.get_instructions(), !rtcs.empty() ? rtc_log.rays : kernel_args.framebuffer_size, core_clock);
+	}
+
 	print_header("Power Summary");
 	printf("Energy: %.2f mJ\n", total_power * frame_time * 1000.0);
 	printf("Power: %.2f W\n", total_power);
@@ -659,9 +734,10 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	else              printf("MRays/J: %.2f\n", kernel_args.framebuffer_size / total_energy / 1'000'000.0);
 
 	print_header("Simulation Summary");
-	printf("Simulation rate: %.2f KHz\n", simulator.current_cycle / simulation_time / 1000.0);
+	print_simulation_rate(simulator, sim_config, simulator.current_cycle, simulation_time);
 	printf("Simulation time: %.0f s\n", simulation_time);
 	printf("MSIPS: %.2f\n", simulator.current_cycle * tps.size() / simulation_time / 1'000'000.0);
+	print_simulation_profile(simulator, sim_config);
 
 	stbi_flip_vertically_on_write(true);
 	stbi_write_png("out.png", (int)kernel_args.framebuffer_width,  (int)kernel_args.framebuffer_height, 4, device_mem + (size_t)kernel_args.framebuffer, 0);
@@ -673,6 +749,7 @@ static void run_sim_trax(SimulationConfig& sim_config)
 	for(auto& thread_scheduler : thread_schedulers) delete thread_scheduler;
 	for(auto& rtc : rtcs) delete rtc;
 	for(auto& l2 : l2s) delete l2;
+	delete xbar;
 	for(auto& dram : drams) delete dram;
 }
 }
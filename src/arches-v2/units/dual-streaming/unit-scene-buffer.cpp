@@ -41,6 +41,7 @@ void UnitSceneBuffer::process_requests(uint bank_index)
 		paddr_t buffer_addr = _address_translator.translate(req.paddr);
 		bank.data_array_pipline.write(MemoryReturn(req, &_data_u8[buffer_addr]));
 		log.loads++;
+		log.regions.log(RegionMap::get_instance().find(req.paddr), req.size, true);
 	}
 	bank.data_array_pipline.clock();
 }
@@ -3,6 +3,7 @@
 
 #include "units/unit-memory-base.hpp"
 #include "units/unit-dram.hpp"
+#include "util/memory-map.hpp"
 
 #include "dual-streaming-kernel/include.hpp"
 #include "simulator/interconnects.hpp"
@@ -242,6 +243,7 @@ public:
 			};
 			uint64_t counters[NUM_COUNTERS];
 		};
+		RegionLog regions; //loads served by region
 
 		Log() { reset(); }
 
@@ -249,12 +251,14 @@ public:
 		{
 			for(uint i = 0; i < NUM_COUNTERS; ++i)
 				counters[i] = 0;
+			regions.reset();
 		}
 
 		void accumulate(const Log& other)
 		{
 			for(uint i = 0; i < NUM_COUNTERS; ++i)
 				counters[i] += other.counters[i];
+			regions.accumulate(other.regions);
 		}
 
 		void print(cycles_t cycles, uint units = 1)
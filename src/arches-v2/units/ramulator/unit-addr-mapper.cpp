@@ -51,4 +51,33 @@ public:
     }
 };
 
+class RoBgBaRaChCoX final : public LinearMapperBase, public Implementation {
+    RAMULATOR_REGISTER_IMPLEMENTATION(IAddrMapper, RoBgBaRaChCoX, "RoBgBaRaChCoX", "Applies a RoBgBaRaChCo mapping with the channel and banks XORed with the low row bits.");
+
+public:
+    void init() override { };
+
+    void setup(IFrontEnd* frontend, IMemorySystem* memory_system) override {
+        LinearMapperBase::setup(frontend, memory_system);
+    }
+
+    // Permutation based interleaving (Zhang et al. 2000). Rows strided by a power of two that would all land on one
+    // channel and bank are spread by their own row bits. Each field takes the next row bits so they don't move together.
+    void apply(Request& req) override {
+        req.addr_vec.resize(m_num_levels, -1);
+        Addr_t addr = req.addr >> m_tx_offset;
+        req.addr_vec[m_addr_bits.size() - 1] = slice_lower_bits(addr, m_addr_bits[m_addr_bits.size() - 1]);
+        req.addr_vec[0] = slice_lower_bits(addr, m_addr_bits[0]);
+        req.addr_vec[1] = slice_lower_bits(addr, m_addr_bits[1]);
+        req.addr_vec[3] = slice_lower_bits(addr, m_addr_bits[3]);
+        req.addr_vec[2] = slice_lower_bits(addr, m_addr_bits[2]);
+        req.addr_vec[4] = slice_lower_bits(addr, m_addr_bits[4]);
+
+        Addr_t row = req.addr_vec[4];
+        req.addr_vec[0] ^= slice_lower_bits(row, m_addr_bits[0]);
+        req.addr_vec[3] ^= slice_lower_bits(row, m_addr_bits[3]);
+        req.addr_vec[2] ^= slice_lower_bits(row, m_addr_bits[2]);
+    }
+};
+
 }   // namespace Ramulator
\ No newline at end of file
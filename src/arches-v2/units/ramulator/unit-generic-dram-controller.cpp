@@ -1,10 +1,16 @@
 #include "ramulator2/src/dram_controller/controller.h"
 #include "ramulator2/src/memory_system/memory_system.h"
+#include "unit-all-bank-refresh.cpp"
 
 namespace Ramulator {
 
 class GenericDRAMControllerA final : public IDRAMController, public Implementation {
   RAMULATOR_REGISTER_IMPLEMENTATION(IDRAMController, GenericDRAMControllerA, "GenericA", "A generic DRAM controller for Arches.");
+  public:
+    enum class RowOutcome : int {
+      Hit, Miss, Conflict
+    };
+
   private:
     std::deque<Request> pending;          // A queue for read requests that are about to finish (callback after RL)
 
@@ -56,6 +62,16 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
     size_t s_read_latency = 0;
     float s_avg_read_latency = 0;
 
+    AllBankRefreshA* m_skippable_refresh = nullptr;
+
+    int m_num_banks = 1;                  // Banks per channel, counting every level from rank down to bank
+    std::vector<int> m_bank_waiting;      // Reads and writes in the active, read and write buffers per bank
+    int m_busy_banks = 0;                 // Banks with a nonzero m_bank_waiting
+    std::function<void(int bank, RowOutcome outcome)> m_row_outcome_callback;
+
+    // Controllers of each memory system so Arches can reach them past the IMemorySystem interface
+    inline static std::map<IMemorySystem*, std::vector<GenericDRAMControllerA*>> s_controllers;
+
 
   public:
     void init() override {
@@ -84,6 +100,14 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
 
       m_num_cores = frontend->get_num_cores();
 
+      for (int level = 1; level <= m_bank_addr_idx; level++) {
+        m_num_banks *= m_dram->m_organization.count[level];
+      }
+      m_bank_waiting.resize(m_num_banks, 0);
+
+      m_skippable_refresh = dynamic_cast<AllBankRefreshA*>(m_refresh);
+      s_controllers[memory_system].push_back(this);
+
       s_read_row_hits_per_core.resize(m_num_cores, 0);
       s_read_row_misses_per_core.resize(m_num_cores, 0);
       s_read_row_conflicts_per_core.resize(m_num_cores, 0);
@@ -164,6 +188,7 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
       req.arrive = m_clk;
       if        (req.type_id == Request::Type::Read) {
         is_success = m_read_buffer.enqueue(req);
+        if (is_success) update_bank_waiting(req, 1);
       } else if (req.type_id == Request::Type::Write) {
           // write merge
           for (auto itr = m_write_buffer.begin(); itr != m_write_buffer.end(); ++itr)
@@ -174,8 +199,10 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
                   break;
               }
           }
-          if (!is_success)
+          if (!is_success) {
             is_success = m_write_buffer.enqueue(req);
+            if (is_success) update_bank_waiting(req, 1);
+          }
       } else {
         throw std::runtime_error("Invalid request type!");
       }
@@ -256,9 +283,11 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
           } else if (req_it->type_id == Request::Type::Write) {
             // TODO: Add code to update statistics
           }
+          if (buffer != &m_priority_buffer) update_bank_waiting(*req_it, -1);
           buffer->remove(req_it);
         } else {
           if (m_dram->m_command_meta(req_it->command).is_opening) {
+            if (buffer == &m_priority_buffer) update_bank_waiting(*req_it, 1);
             m_active_buffer.enqueue(*req_it);
             buffer->remove(req_it);
           }
@@ -269,7 +298,114 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
     };
 
 
+    static const std::vector<GenericDRAMControllerA*>& get_controllers(IMemorySystem* memory_system) {
+      return s_controllers[memory_system];
+    }
+
+    /**
+     * @brief    True if nothing is queued or waiting on its read latency
+     */
+    bool is_idle() {
+      return pending.empty() && m_active_buffer.size() == 0 && m_priority_buffer.size() == 0 && m_read_buffer.size() == 0 && m_write_buffer.size() == 0;
+    }
+
+    /**
+     * @brief    Cycles an idle controller has to keep ticking before the DRAM is back in a steady state
+     * @details
+     * Covers the longest constraint a previous command can leave behind, a refresh in progress or a row cycle.
+     */
+    Clk_t settle_cycles() {
+      return m_dram->m_timing_vals("nRFC") + m_dram->m_timing_vals("nRC");
+    }
+
+    /**
+     * @brief    Cycle the next refresh is sent on, -1 if never or if the refresh manager can't skip
+     */
+    Clk_t next_refresh_cycle() {
+      return m_skippable_refresh ? m_skippable_refresh->next_refresh_cycle() : -1;
+    }
+
+    /**
+     * @brief    Earliest cycle a read can call back, -1 if no read is queued or waiting on its read latency
+     * @details
+     * Reads call back in order from the pending queue. A read still waiting on its command is issued next tick at the
+     * earliest and departs read latency cycles after that.
+     */
+    Clk_t next_read_depart() {
+      if (!pending.empty()) return pending.front().depart;
+      for (ReqBuffer* buffer : {&m_active_buffer, &m_read_buffer}) {
+        for (const Request& req : *buffer) {
+          if (req.type_id == Request::Type::Read) return m_clk + 1 + m_dram->m_read_latency;
+        }
+      }
+      return -1;
+    }
+
+    bool can_skip() {
+      return m_skippable_refresh != nullptr && is_idle();
+    }
+
+    /**
+     * @brief    Advances an idle controller's clock in one step
+     * @details
+     * The DRAM isn't ticked, it only compares against its own clock and a settled device has nothing left to time.
+     */
+    void skip(Clk_t cycles) {
+      m_clk += cycles;
+      m_skippable_refresh->skip(cycles);
+    }
+
+    int get_num_banks() {
+      return m_num_banks;
+    }
+
+    int get_read_queue_size() {
+      return m_read_buffer.size();
+    }
+
+    int get_write_queue_size() {
+      return m_write_buffer.size();
+    }
+
+    int get_queue_capacity() {
+      return m_read_buffer.max_size;
+    }
+
+    /**
+     * @brief    Number of banks with a read or write still waiting on a command, the achieved bank level parallelism
+     */
+    int get_busy_banks() {
+      return m_busy_banks;
+    }
+
+    /**
+     * @brief    Called with the bank and row buffer outcome the first time a read or write is scheduled
+     */
+    void set_row_outcome_callback(std::function<void(int bank, RowOutcome outcome)> callback) {
+      m_row_outcome_callback = callback;
+    }
+
   private:
+    int flat_bank(const AddrVec_t& addr_vec) {
+      int bank = 0;
+      for (int level = 1; level <= m_bank_addr_idx; level++) {
+        bank = bank * m_dram->m_organization.count[level] + addr_vec[level];
+      }
+      return bank;
+    }
+
+    /**
+     * @brief    Tracks a request entering (delta 1) or leaving (delta -1) the buffers counted by get_busy_banks()
+     */
+    void update_bank_waiting(const Request& req, int delta) {
+      int bank = flat_bank(req.addr_vec);
+      if (bank < 0 || bank >= m_num_banks) return;
+
+      bool was_busy = m_bank_waiting[bank] != 0;
+      m_bank_waiting[bank] += delta;
+      m_busy_banks += (m_bank_waiting[bank] != 0) - was_busy;
+    }
+
     /**
      * @brief    Helper function to check if a request is hitting an open row
      * @details
@@ -298,14 +434,21 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
     {
       req->is_stat_updated = true;
 
+      if (req->type_id != Request::Type::Read && req->type_id != Request::Type::Write)
+        return;
+
+      RowOutcome outcome = is_row_hit(req) ? RowOutcome::Hit : is_row_open(req) ? RowOutcome::Conflict : RowOutcome::Miss;
+      if (m_row_outcome_callback)
+        m_row_outcome_callback(flat_bank(req->addr_vec), outcome);
+
       if (req->type_id == Request::Type::Read) 
       {
-        if (is_row_hit(req)) {
+        if (outcome == RowOutcome::Hit) {
           s_read_row_hits++;
           s_row_hits++;
           if (req->source_id != -1)
             s_read_row_hits_per_core[0]++; // req->source_id
-        } else if (is_row_open(req)) {
+        } else if (outcome == RowOutcome::Conflict) {
           s_read_row_conflicts++;
           s_row_conflicts++;
           if (req->source_id != -1)
@@ -317,12 +460,12 @@ class GenericDRAMControllerA final : public IDRAMController, public Implementati
             s_read_row_misses_per_core[0]++;
         } 
       } 
-      else if (req->type_id == Request::Type::Write) 
+      else
       {
-        if (is_row_hit(req)) {
+        if (outcome == RowOutcome::Hit) {
           s_write_row_hits++;
           s_row_hits++;
-        } else if (is_row_open(req)) {
+        } else if (outcome == RowOutcome::Conflict) {
           s_write_row_conflicts++;
           s_row_conflicts++;
         } else {
@@ -11,9 +11,9 @@ namespace Arches { namespace Units { namespace TRaX {
 
 template<typename NT, typename PT>
 UnitRTCore<NT, PT>::UnitRTCore(const Configuration& config) :
-	_max_rays(config.max_rays), _node_base_addr(config.node_base_addr), _tri_base_addr(config.tri_base_addr),
-	_cache(config.cache), _request_network(config.num_clients, 1), _return_network(1, config.num_clients),
-	_box_pipline(3), _tri_pipline(22), _cache_port(config.cache_port), _cache_port_stride(config.cache_port_stride)
+	_request_network(config.num_clients, 1), _return_network(1, config.num_clients), _cache(config.cache),
+	_cache_port(config.cache_port), _cache_port_stride(config.cache_port_stride), _box_pipline(3), _tri_pipline(22),
+	_max_rays(config.max_rays), _node_base_addr(config.node_base_addr), _tri_base_addr(config.tri_base_addr), _high_reuse_levels(config.high_reuse_levels)
 {
 	_ray_states.resize(config.max_rays);
 	for(uint i = 0; i < _ray_states.size(); ++i)
@@ -46,6 +46,176 @@ void UnitRTCore<NT, PT>::clock_fall()
 	_return_network.clock();
 }
 
+//Rays waiting on node or triangle data are woken by the cache which reports the return as its own event
+template<typename NT, typename PT>
+cycles_t UnitRTCore<NT, PT>::next_event_cycle()
+{
+	cycles_t current_cycle = simulator->current_cycle;
+	if(!_request_network.empty() || !_return_network.empty()) return current_cycle + 1;
+	if(!_ray_scheduling_queue.empty() || !_ray_return_queue.empty()) return current_cycle + 1;
+	if(!_node_isect_queue.empty() || !_tri_isect_queue.empty()) return current_cycle + 1;
+	for(uint i = 0; i < _cache_fetch_queues.size(); ++i)
+		if(!_cache_fetch_queues[i].empty()) return current_cycle + 1;
+
+	cycles_t next_event = Simulator::NO_EVENT;
+	if(!_box_pipline.empty()) next_event = std::min(next_event, current_cycle + std::max<cycles_t>(_box_pipline.cycles_until_read_valid(), 1));
+	if(!_tri_pipline.empty()) next_event = std::min(next_event, current_cycle + std::max<cycles_t>(_tri_pipline.cycles_until_read_valid(), 1));
+	return next_event;
+}
+
+template<typename NT, typename PT>
+void UnitRTCore<NT, PT>::skip_cycles(cycles_t cycles)
+{
+	_box_pipline.skip(cycles);
+	_tri_pipline.skip(cycles);
+
+	//replay the per cycle stall accounting from _read_requests() and _schedule_ray()
+	_stall_cycles += (uint)cycles;
+	for(cycles_t i = 0; i < cycles; ++i)
+	{
+		uint phase = (uint)_ray_states[_last_ray_id].phase;
+		if(++_last_ray_id == _ray_states.size()) _last_ray_id = 0;
+		log.stall_counters[phase]++;
+	}
+}
+
+template<typename NT, typename PT>
+bool UnitRTCore<NT, PT>::checkpoint(Checkpoint& checkpoint)
+{
+	checkpoint.io(_request_network);
+	checkpoint.io(_return_network);
+	checkpoint.io(_cache_fetch_queues);
+	checkpoint.io(_ray_scheduling_queue);
+	checkpoint.io(_ray_return_queue);
+	checkpoint.io(_free_ray_ids);
+	checkpoint.io(_ray_states);
+	checkpoint.io(_node_isect_queue);
+	checkpoint.io(_box_pipline);
+	checkpoint.io(_box_issue_count);
+	checkpoint.io(_tri_isect_queue);
+	checkpoint.io(_tri_pipline);
+	checkpoint.io(_tri_issue_count);
+	checkpoint.io(_last_ray_id);
+	checkpoint.io(_rows_accessed);
+	checkpoint.io(_drain_phase);
+	checkpoint.io(_stall_cycles);
+	checkpoint.io(log.counters);
+	return true;
+}
+
+//Traces the whole ray at once with an unbounded stack instead of the restart trail, so the hit matches the pipeline.
+//Node and triangle fetches still go through the cache to keep it warm. Only rays are logged.
+template<typename NT, typename PT>
+bool UnitRTCore<NT, PT>::functional_access(const MemoryRequest& request, MemoryReturn& ret)
+{
+	//rtm::Ray isn't trivially copyable so its fields are copied out as floats
+	float ray_data[8];
+	std::memcpy(ray_data, request.data, sizeof(ray_data));
+	rtm::Ray ray;
+	ray.o = rtm::vec3(ray_data[0], ray_data[1], ray_data[2]);
+	ray.t_min = ray_data[3];
+	ray.d = rtm::vec3(ray_data[4], ray_data[5], ray_data[6]);
+	ray.t_max = ray_data[7];
+	rtm::vec3 inv_d = rtm::vec3(1.0f) / ray.d;
+
+	rtm::Hit hit;
+	hit.t = ray.t_max;
+	hit.bc = rtm::vec2(0.0f);
+	hit.id = ~0u;
+
+	StackEntry root;
+	root.t = ray.t_min;
+	root.data.is_int = 1;
+	root.data.child_index = 0;
+	root.is_last = false;
+
+	StagingBuffer buffer;
+	_functional_stack.clear();
+	_functional_stack.push_back(root);
+	while(!_functional_stack.empty())
+	{
+		StackEntry entry = _functional_stack.back();
+		_functional_stack.pop_back();
+		if(entry.t >= hit.t) continue;
+
+		if(entry.data.is_int)
+		{
+			if(!_functional_fetch(_node_base_addr + entry.data.child_index * sizeof(NT), sizeof(NT), buffer.data)) return false;
+			const rtm::WBVH::Node node = rtm::decompress(buffer.node);
+
+			//same order as the node pipeline, closest child on top
+			uint stack_size = _functional_stack.size();
+			for(uint i = 0; i < rtm::WBVH::WIDTH; i++)
+			{
+				if(!node.is_valid(i)) continue;
+
+				float t = rtm::intersect(node.aabb[i], ray, inv_d);
+				if(t < hit.t)
+				{
+					_functional_stack.emplace_back();
+					uint j = _functional_stack.size() - 1;
+					for(; j > stack_size; --j)
+					{
+						if(_functional_stack[j - 1].t > t) break;
+						_functional_stack[j] = _functional_stack[j - 1];
+					}
+
+					_functional_stack[j].t = t;
+					_functional_stack[j].is_last = false;
+					_functional_stack[j].data = node.data[i];
+				}
+			}
+		}
+		else
+		{
+			for(uint i = 0; i < entry.data.num_prims; ++i)
+			{
+				uint prim_id = entry.data.prim_index + i;
+				if(!_functional_fetch(_tri_base_addr + prim_id * sizeof(PT), sizeof(PT), buffer.data)) return false;
+
+				rtm::IntersectionTriangle tris[rtm::TriangleStrip::MAX_TRIS * 3];
+				uint tri_count = rtm::decompress(buffer.prims[0], prim_id, tris);
+				for(uint k = 0; k < tri_count; ++k)
+					if(rtm::intersect(tris[k].tri, ray, hit))
+						hit.id = tris[k].id;
+			}
+		}
+	}
+
+	ret = MemoryReturn(request);
+	ret.size = sizeof(rtm::Hit);
+	ret.paddr = 0xdeadbeefull;
+	std::memcpy(ret.data, &hit, sizeof(rtm::Hit));
+
+	log.rays++;
+	return true;
+}
+
+template<typename NT, typename PT>
+bool UnitRTCore<NT, PT>::_functional_fetch(paddr_t addr, uint size, void* data)
+{
+	//split at the same boundries as the detailed requests
+	paddr_t start = addr;
+	paddr_t end = start + size;
+	while(addr < end)
+	{
+		paddr_t next_boundry = std::min(end, _align_address(addr + MemoryRequest::MAX_SIZE));
+
+		MemoryRequest req;
+		req.type = MemoryRequest::Type::LOAD;
+		req.paddr = addr;
+		req.size = next_boundry - addr;
+
+		MemoryReturn ret;
+		if(!_cache->functional_access(req, ret)) return false;
+		std::memcpy((uint8_t*)data + (addr - start), ret.data, ret.size);
+
+		addr += req.size;
+	}
+
+	return true;
+}
+
 template<typename NT, typename PT>
 bool UnitRTCore<NT, PT>::_try_queue_node(uint ray_id, uint node_id)
 {
@@ -57,6 +227,9 @@ bool UnitRTCore<NT, PT>::_try_queue_node(uint ray_id, uint node_id)
 	ray_state.buffer.bytes_filled = 0;
 	ray_state.buffer.type = 0;
 
+	//nodes near the root are shared by every ray so they should outlive the rest of the tree in the caches
+	MemoryRequest::Hint hint = ray_state.level < _high_reuse_levels ? MemoryRequest::Hint::HIGH_REUSE : MemoryRequest::Hint::LOW_REUSE;
+
 	//split request at cache boundries
 	//queue the requests to fill the buffer
 	paddr_t addr = start;
@@ -68,6 +241,7 @@ bool UnitRTCore<NT, PT>::_try_queue_node(uint ray_id, uint node_id)
 		req.type = MemoryRequest::Type::LOAD;
 		req.paddr = addr;
 		req.size = next_boundry - addr;
+		req.flags.hint = (uint8_t)hint;
 		req.dst.push(ray_id, 10);
 		_cache_fetch_queues[ray_id % _cache_fetch_queues.size()].push(req);
 
@@ -90,6 +264,8 @@ bool UnitRTCore<NT, PT>::_try_queue_tris(uint ray_id, uint tri_id, uint num_tris
 	ray_state.buffer.prim_id = tri_id;
 	ray_state.buffer.num_prims = num_tris;
 
+	MemoryRequest::Hint hint = MemoryRequest::Hint::STREAMING;
+
 	//split request at cache boundries
 	//queue the requests to fill the buffer
 	paddr_t addr = start;
@@ -101,6 +277,7 @@ bool UnitRTCore<NT, PT>::_try_queue_tris(uint ray_id, uint tri_id, uint num_tris
 		req.type = MemoryRequest::Type::LOAD;
 		req.paddr = addr;
 		req.size = next_boundry - addr;
+		req.flags.hint = (uint8_t)hint;
 		req.dst.push(ray_id, 10);
 		_cache_fetch_queues[ray_id % _cache_fetch_queues.size()].push(req);
 
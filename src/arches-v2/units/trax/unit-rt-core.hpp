@@ -17,6 +17,7 @@ public:
 		uint max_rays{1};
 		paddr_t node_base_addr{0x0ull};
 		paddr_t tri_base_addr{0x0ull};
+		uint high_reuse_levels{4}; //node fetches above this level are hinted as high reuse
 
 		UnitMemoryBase* cache{nullptr};
 		uint cache_port{0};
@@ -98,6 +99,10 @@ private:
 		bool done;
 
 		RayState() {};
+
+		//plain data behind the unions, saved whole
+		template<typename CP>
+		void checkpoint(CP& checkpoint) { checkpoint.io_bytes(this, sizeof(*this)); }
 	};
 
 	struct FetchItem
@@ -137,6 +142,7 @@ private:
 	uint _max_rays;
 	paddr_t _node_base_addr;
 	paddr_t _tri_base_addr;
+	uint _high_reuse_levels;
 	uint _last_ray_id{0};
 
 	std::set<uint> _rows_accessed;
@@ -144,6 +150,8 @@ private:
 	bool _drain_phase{false};
 
 	uint _stall_cycles{0};
+
+	std::vector<StackEntry> _functional_stack;
 public:
 	UnitRTCore(const Configuration& config);
 
@@ -151,6 +159,12 @@ public:
 
 	void clock_fall() override;
 
+	cycles_t next_event_cycle() override;
+
+	void skip_cycles(cycles_t cycles) override;
+
+	bool checkpoint(Checkpoint& checkpoint) override;
+
 	bool request_port_write_valid(uint port_index) override
 	{
 		return _request_network.is_write_valid(port_index);
@@ -176,6 +190,8 @@ public:
 		return _return_network.read(port_index);
 	}
 
+	bool functional_access(const MemoryRequest& request, MemoryReturn& ret) override;
+
 private:
 	paddr_t _align_address(paddr_t addr)
 	{
@@ -185,6 +201,7 @@ private:
 	bool _try_queue_node(uint ray_id, uint node_id);
 	bool _try_queue_tris(uint ray_id, uint tri_id, uint num_tris);
 	bool _try_queue_prefetch(paddr_t addr, uint size, uint cache_mask);
+	bool _functional_fetch(paddr_t addr, uint size, void* data);
 
 	void _read_requests();
 	void _read_returns();
@@ -25,6 +25,8 @@ public:
 	UnitAtomicRegfile(uint num_clients) : UnitMemoryBase(),
 		_request_network(num_clients, 1), _return_network(1, num_clients)
 	{
+		_request_network.set_owner(this);
+
 		for (uint i = 0; i < 32; ++i)
 			iregs[i] = 0;
 	}
@@ -46,51 +48,7 @@ public:
 		{
 			if (_current_request.type != MemoryRequest::Type::STORE && !_return_network.is_write_valid(0)) return;
 
-			uint32_t reg_index = (_current_request.paddr >> 2) & 0b1'1111;
-			uint32_t request_data = _current_request.data_u32;
-			uint32_t ret_val = iregs[reg_index];
-
-			switch (_current_request.type)
-			{
-			case MemoryRequest::Type::STORE:
-				iregs[reg_index] = request_data;
-				break;
-
-			case MemoryRequest::Type::LOAD:
-				break;
-
-			case MemoryRequest::Type::AMO_ADD:
-				iregs[reg_index] += request_data;
-				break;
-
-			case MemoryRequest::Type::AMO_AND:
-				iregs[reg_index] &= request_data;
-				break;
-
-			case MemoryRequest::Type::AMO_OR:
-				iregs[reg_index] |= request_data;
-				break;
-
-			case MemoryRequest::Type::AMO_XOR:
-				iregs[reg_index] ^= request_data;
-				break;
-
-			case MemoryRequest::Type::AMO_MIN:
-				iregs[reg_index] = std::min((int32_t)request_data, (int32_t)iregs[reg_index]);
-				break;
-
-			case MemoryRequest::Type::AMO_MAX:
-				iregs[reg_index] = std::max((int32_t)request_data, (int32_t)iregs[reg_index]);
-				break;
-
-			case MemoryRequest::Type::AMO_MINU:
-				iregs[reg_index] = std::min(request_data, iregs[reg_index]);
-				break;
-
-			case MemoryRequest::Type::AMO_MAXU:
-				iregs[reg_index] = std::max(request_data, iregs[reg_index]);
-				break;
-			}
+			uint32_t ret_val = _apply(_current_request);
 
 			if (_current_request.type != MemoryRequest::Type::STORE)
 			{
@@ -102,6 +60,19 @@ public:
 		}
 
 		_return_network.clock();
+
+		if(!_current_request_valid && _request_network.empty() && _return_network.empty())
+			sleep();
+	}
+
+	bool checkpoint(Checkpoint& checkpoint) override
+	{
+		checkpoint.io(iregs);
+		checkpoint.io(_current_request_valid);
+		checkpoint.io(_current_request);
+		checkpoint.io(_request_network);
+		checkpoint.io(_return_network);
+		return true;
 	}
 
 	bool request_port_write_valid(uint port_index) override
@@ -128,6 +99,66 @@ public:
 	{
 		return _return_network.read(port_index);
 	}
+
+	bool functional_access(const MemoryRequest& request, MemoryReturn& ret) override
+	{
+		uint32_t ret_val = _apply(request);
+		ret = MemoryReturn(request, &ret_val);
+		return true;
+	}
+
+private:
+	//Returns the register's value from before the operation
+	uint32_t _apply(const MemoryRequest& request)
+	{
+		uint32_t reg_index = (request.paddr >> 2) & 0b1'1111;
+		uint32_t request_data = request.data_u32;
+		uint32_t ret_val = iregs[reg_index];
+
+		switch (request.type)
+		{
+		case MemoryRequest::Type::STORE:
+			iregs[reg_index] = request_data;
+			break;
+
+		case MemoryRequest::Type::LOAD:
+			break;
+
+		case MemoryRequest::Type::AMO_ADD:
+			iregs[reg_index] += request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_AND:
+			iregs[reg_index] &= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_OR:
+			iregs[reg_index] |= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_XOR:
+			iregs[reg_index] ^= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_MIN:
+			iregs[reg_index] = std::min((int32_t)request_data, (int32_t)iregs[reg_index]);
+			break;
+
+		case MemoryRequest::Type::AMO_MAX:
+			iregs[reg_index] = std::max((int32_t)request_data, (int32_t)iregs[reg_index]);
+			break;
+
+		case MemoryRequest::Type::AMO_MINU:
+			iregs[reg_index] = std::min(request_data, iregs[reg_index]);
+			break;
+
+		case MemoryRequest::Type::AMO_MAXU:
+			iregs[reg_index] = std::max(request_data, iregs[reg_index]);
+			break;
+		}
+
+		return ret_val;
+	}
 };
 
 }
@@ -2,6 +2,7 @@
 #include "stdafx.hpp"
 
 #include "simulator/simulator.hpp"
+#include "simulator/checkpoint.hpp"
 
 namespace Arches { namespace Units {
 
@@ -11,12 +12,54 @@ class alignas(64) UnitBase
 public:
 	Simulator* simulator{nullptr};
 	uint64_t   unit_id{~0ull};
+	uint       clock_domain{0};
+
+private:
+	friend class Arches::Simulator;
+
+	//Sleep/wake state. Only the simulator transitions a unit between awake and asleep and it only does so on clock
+	//rise, when no port writes can be in flight, so the flags below never race with the owner thread
+	std::atomic_bool _asleep{false};
+	std::atomic_bool _woken{false};
+	bool _sleep_requested{false};
 
 public:
 	UnitBase() = default;
 	virtual void clock_rise() = 0;
 	virtual void clock_fall() = 0;
 	virtual void reset() {};
+
+	//Opt in sleep/wake protocol. A unit calls sleep() once it is fully drained and the simulator stops clocking it from
+	//the next cycle on. Any write into one of its ports calls wake() and it is clocked again starting the next cycle.
+	void sleep()
+	{
+		_sleep_requested = true;
+	}
+
+	void wake()
+	{
+		if(_woken.load(std::memory_order_relaxed)) return;
+		_woken.store(true, std::memory_order_relaxed);
+		if(_asleep.load(std::memory_order_relaxed)) simulator->_wake_unit(unit_id);
+	}
+
+	bool asleep() const { return _asleep.load(std::memory_order_relaxed); }
+
+	//Time skip hooks. Called after clock fall, returns the earliest cycle of the unit's clock domain at which clocking the
+	//unit could change its state if no new input arrives, or Simulator::NO_EVENT. Units outside the core domain count
+	//cycles with simulator->domain_cycle(clock_domain). The default never lets the simulator skip ahead.
+	virtual cycles_t next_event_cycle() { return simulator->current_cycle + 1; }
+
+	//Called on clock rise when the simulator jumped over cycles. Anything that ages or counts per cycle catches up here.
+	virtual void skip_cycles(cycles_t cycles) {}
+
+	//Saves or restores the unit's state depending on the checkpoint's mode. Restore runs on a freshly constructed and
+	//reset unit with the same configuration. Units that don't support checkpoints return false and block the save.
+	virtual bool checkpoint(Checkpoint& checkpoint) { return false; }
+
+	//Sampled simulation. Called serially between steps while simulator->fast_forward is set, in place of the detailed
+	//work the unit would do on clock fall. Functional accesses into other units are safe here since nothing is clocked.
+	virtual void functional_step() {}
 };
 
-}}
\ No newline at end of file
+}}
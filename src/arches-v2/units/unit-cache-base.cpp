@@ -1,41 +1,82 @@
 #include "unit-cache-base.hpp"
-#include "rtm/rng.hpp"
+#include "util/simd-scan.hpp"
 
 namespace Arches {
 namespace Units {
 
-UnitCacheBase::UnitCacheBase(size_t size, uint block_size, uint associativity, uint sector_size, Policy policy) : UnitMemoryBase(), _tag_array(size / block_size), _data_array(size), _sector_size(sector_size), _policy(policy)
+static ReplacementPolicy* _new_replacement_policy(UnitCacheBase::Policy policy, uint sets, uint associativity)
 {
-	//initialize tag array
-	for(uint i = 0; i < _tag_array.size(); ++i)
+	switch(policy)
 	{
-		_tag_array[i].valid = 0;
-		_tag_array[i].dirty = 0;
-		_tag_array[i].lru = i % associativity;
-		_tag_array[i].tag = ~0x0ull;
+	case UnitCacheBase::Policy::LRU:        return _new LRUReplacement(sets, associativity);
+	case UnitCacheBase::Policy::LRU_RANDOM: return _new RandomLRUReplacement(sets, associativity);
+	case UnitCacheBase::Policy::SRRIP:      return _new RRIPReplacement(sets, associativity);
+	case UnitCacheBase::Policy::BRRIP:      return _new BRRIPReplacement(sets, associativity);
+	case UnitCacheBase::Policy::DRRIP:      return _new DRRIPReplacement(sets, associativity);
+	case UnitCacheBase::Policy::SHIP:       return _new SHiPReplacement(sets, associativity);
+	case UnitCacheBase::Policy::BVH_HINT:   return _new BVHHintReplacement(sets, associativity);
 	}
 
+	_assert(false);
+	return nullptr;
+}
+
+UnitCacheBase::UnitCacheBase(size_t size, uint block_size, uint associativity, uint sector_size, Policy policy, bool compressed) : UnitMemoryBase(), _policy(policy), _sector_size(sector_size), _compressed(compressed), _base_associativity(associativity)
+{
 	if(sector_size == 0) _sector_size = block_size;
 	else                _sector_size = sector_size;
 	_block_size = block_size;
-	_associativity = associativity;
+	_associativity = compressed ? associativity * COMPRESSION_TAG_FACTOR : associativity;
 	_sets = size / (block_size * associativity);
 
+	//sector masks and replacement state are 8 bit
+	_assert(_associativity <= 256);
+	_assert(block_size / _sector_size <= 8);
+	_assert(!compressed || _sector_size % SectorCompressor::SEGMENT_SIZE == 0);
+
 	_block_offset_bits = _block_size - 1;
 	_sector_offset_bits = _sector_size - 1;
 
-	_hash = 1;
+	uint num_blocks = _sets * _associativity;
+	_tags.resize(num_blocks, INVALID_TAG);
+	_lru.resize(num_blocks);
+	_valid.resize(num_blocks, 0);
+	_dirty.resize(num_blocks, 0);
+	_prefetched.resize(num_blocks, 0);
+	_data_array.resize((size_t)num_blocks * _block_size);
+
+	if(_compressed)
+	{
+		uint num_sectors = num_blocks * (_block_size / _sector_size);
+		_set_capacity = _base_associativity * _block_size / SectorCompressor::SEGMENT_SIZE;
+		_segments.resize(num_sectors, 0);
+		_encodings.resize(num_sectors, SectorCompressor::Encoding::UNCOMPRESSED);
+		_set_segments.resize(_sets, 0);
+	}
+
+	_replacement = _new_replacement_policy(policy, _sets, _associativity);
+	for(uint i = 0; i < _sets; ++i)
+		_replacement->reset(_lru.data() + i * _associativity, i);
 }
 
 UnitCacheBase::~UnitCacheBase()
 {
-
+	delete _replacement;
 }
 
 void UnitCacheBase::serialize(std::string file_path)
 {
 	std::ofstream file_stream(file_path, std::ios::binary);
-	file_stream.write((char*)_tag_array.data(), sizeof(BlockMetaData) * _tag_array.size());
+	std::vector<BlockMetaData> tag_array(_tags.size());
+	for(uint i = 0; i < tag_array.size(); ++i)
+	{
+		tag_array[i].tag = _tags[i];
+		tag_array[i].lru = _lru[i];
+		tag_array[i].dirty = _dirty[i];
+		tag_array[i].valid = _valid[i];
+	}
+
+	file_stream.write((char*)tag_array.data(), sizeof(BlockMetaData) * tag_array.size());
 	//file_stream.write((char*)_data_array.data(), _data_array.size());
 
 	printf("Write cache success: %s\n", file_path.c_str());
@@ -50,18 +91,41 @@ bool UnitCacheBase::deserialize(std::string file_path, const UnitMainMemoryBase&
 	std::ifstream file_stream(file_path, std::ios::binary);
 	if(file_stream.good())
 	{
-		file_stream.read((char*)_tag_array.data(), sizeof(BlockMetaData) * _tag_array.size());
+		std::vector<BlockMetaData> tag_array(_tags.size());
+		file_stream.read((char*)tag_array.data(), sizeof(BlockMetaData) * tag_array.size());
 		//file_stream.read((char*)_data_array.data(), _data_array.size());
 
-		for(uint i = 0; i < _tag_array.size(); ++i)
+		for(uint i = 0; i < tag_array.size(); ++i)
+		{
+			_tags[i] = tag_array[i].tag;
+			_lru[i] = tag_array[i].lru;
+			_dirty[i] = tag_array[i].dirty;
+			_valid[i] = tag_array[i].valid;
+		}
+
+		for(uint i = 0; i < _tags.size(); ++i)
 		{
-			if(!_tag_array[i].valid) continue;
-			uint64_t tag = _tag_array[i].tag;
+			if(!_valid[i]) continue;
+			uint64_t tag = _tags[i];
 			uint64_t set_index = i / _associativity;
 			paddr_t block_addr = _get_block_addr(tag, set_index);
 			main_mem.direct_read(_data_array.data() + i * _block_size, _block_size, block_addr);
 		}
 
+		//the blocks were just read from memory so any that no longer fit can be dropped
+		if(_compressed)
+		{
+			std::fill(_segments.begin(), _segments.end(), 0);
+			std::fill(_set_segments.begin(), _set_segments.end(), 0);
+			for(uint i = 0; i < _tags.size(); ++i)
+				for(uint j = 0; j < _block_size / _sector_size; ++j)
+					if((_valid[i] >> j) & 0x1) _compress_sector(i, j);
+
+			for(uint i = 0; i < _sets; ++i)
+				_compact_set(i, ~0u);
+			_compaction_victims.clear();
+		}
+
 		succeeded = true;
 
 		printf("Loaded cache: %s\n", file_path.c_str());
@@ -79,38 +143,46 @@ void UnitCacheBase::direct_write(paddr_t block_addr, uint8_t* data)
 	_allocate_block(block_addr);
 	for(uint i = 0; i < _block_size / _sector_size; ++i)
 		_write_sector(block_addr + i * _sector_size, data + i * _sector_size, false);
+
+	//direct writes bypass write backs
+	_compaction_victims.clear();
+}
+
+void UnitCacheBase::_checkpoint_arrays(Checkpoint& checkpoint)
+{
+	checkpoint.io(_tags);
+	checkpoint.io(_lru);
+	checkpoint.io(_valid);
+	checkpoint.io(_dirty);
+	checkpoint.io(_prefetched);
+	checkpoint.io(_data_array);
+	checkpoint.io(_segments);
+	checkpoint.io(_encodings);
+	checkpoint.io(_set_segments);
+	_replacement->checkpoint(checkpoint);
+}
+
+//returns the way holding tag or ~0u
+uint UnitCacheBase::_find_way(uint start, uint64_t tag)
+{
+	uint way = scan_find(_tags.data() + start, _associativity, tag);
+	return way == ~0u ? ~0u : start + way;
 }
 
 //update lru and returns data pointer to cache line
-uint8_t* UnitCacheBase::_read_sector(paddr_t sector_addr)
+uint8_t* UnitCacheBase::_read_sector(paddr_t sector_addr, MemoryRequest::Flags flags)
 {
 	uint64_t tag = _get_tag(sector_addr);
 	uint set_index = _get_set_index(sector_addr);
 	uint sector_index = _get_sector_index(sector_addr);
 	uint start = set_index  * _associativity;
-	uint end = start + _associativity;
-
-	uint found_index = ~0;
-	uint found_lru = 0;
-	for(uint i = start; i < end; ++i)
-	{
-		if(_tag_array[i].tag == tag)
-		{
-			found_index = i;
-			found_lru = _tag_array[i].lru;
-			break;
-		}
-	}
 
-	if(found_index == ~0) 
+	uint found_index = _find_way(start, tag);
+	if(found_index == ~0u) 
 		return nullptr; //Didn't find line so we will leave lru alone and return nullptr
 
-	for(uint i = start; i < end; ++i)
-		if(_tag_array[i].lru < found_lru) 
-			_tag_array[i].lru++;
-
-	_tag_array[found_index].lru = 0;
-	if(!((_tag_array[found_index].valid >> sector_index) & 0x1)) //Found sector but it was invalid
+	_replacement->hit(_lru.data() + start, set_index, found_index - start, flags);
+	if(!((_valid[found_index] >> sector_index) & 0x1)) //Found sector but it was invalid
 		return nullptr;
 
 	return &_data_array[found_index * _block_size + sector_index * _sector_size];
@@ -124,88 +196,204 @@ uint8_t* UnitCacheBase::_write_sector(paddr_t sector_addr, const uint8_t* data,
 	uint set_index = _get_set_index(sector_addr);
 	uint sector_index = _get_sector_index(sector_addr);
 	uint start = set_index * _associativity;
-	uint end = start + _associativity;
 
-	for(uint i = start; i < end; ++i)
+	uint i = _find_way(start, tag);
+	if(i == ~0u)
+		return nullptr;
+
+	_valid[i] |= 0x1 << sector_index;
+	if(set_dirty) _dirty[i] |= 0x1 << sector_index;
+	std::memcpy(_data_array.data() + i * _block_size + sector_index * _sector_size, data, _sector_size);
+	if(_compressed)
 	{
-		if(_tag_array[i].tag == tag)
-		{
-			_tag_array[i].valid |= 0x1ull << sector_index;
-			if(set_dirty) _tag_array[i].dirty |= 0x1ull << sector_index;
-			std::memcpy(_data_array.data() + i * _block_size + sector_index * _sector_size, data, _sector_size);
-			return &_data_array[i * _block_size + sector_index * _sector_size];
-		}
+		_compress_sector(i, sector_index);
+		_compact_set(set_index, i);
 	}
+	return &_data_array[i * _block_size + sector_index * _sector_size];
+}
 
-	return nullptr;
+//returns data pointer to a valid sector without touching the replacement state
+uint8_t* UnitCacheBase::_get_sector(paddr_t sector_addr)
+{
+	uint sector_index = _get_sector_index(sector_addr);
+	uint i = _find_way(_get_set_index(sector_addr) * _associativity, _get_tag(sector_addr));
+	if(i == ~0u || !((_valid[i] >> sector_index) & 0x1))
+		return nullptr;
+
+	return &_data_array[i * _block_size + sector_index * _sector_size];
 }
 
-//inserts cacheline associated with paddr replacing least recently used. Assumes cachline isn't already in cache if it is this has undefined behaviour
-UnitCacheBase::Victim UnitCacheBase::_allocate_block(paddr_t block_addr)
+//marks a sector modified so it is written back on eviction. The data changed so a compressed sector is resized
+void UnitCacheBase::_set_dirty(paddr_t sector_addr)
+{
+	uint set_index = _get_set_index(sector_addr);
+	uint i = _find_way(set_index * _associativity, _get_tag(sector_addr));
+	_assert(i != ~0u);
+	_dirty[i] |= 0x1 << _get_sector_index(sector_addr);
+
+	if(_compressed)
+	{
+		_compress_sector(i, _get_sector_index(sector_addr));
+		_compact_set(set_index, i);
+	}
+}
+
+//marks a sector as brought in by a prefetch
+void UnitCacheBase::_set_prefetched(paddr_t sector_addr)
+{
+	uint i = _find_way(_get_set_index(sector_addr) * _associativity, _get_tag(sector_addr));
+	_assert(i != ~0u);
+	_prefetched[i] |= 0x1 << _get_sector_index(sector_addr);
+}
+
+//true the first time a prefetched sector is used
+bool UnitCacheBase::_take_prefetched(paddr_t sector_addr)
+{
+	uint i = _find_way(_get_set_index(sector_addr) * _associativity, _get_tag(sector_addr));
+	if(i == ~0u) return false;
+
+	uint8_t mask = 0x1 << _get_sector_index(sector_addr);
+	if(!(_prefetched[i] & mask)) return false;
+
+	_prefetched[i] &= ~mask;
+	return true;
+}
+
+//inserts cacheline associated with paddr replacing the block picked by the replacement policy. If the block is already cached it only counts as a hit
+UnitCacheBase::Victim UnitCacheBase::_allocate_block(paddr_t block_addr, MemoryRequest::Flags flags)
 {
 	uint64_t tag = _get_tag(block_addr);
 	uint set_index = _get_set_index(block_addr);
 	uint start = set_index * _associativity;
-	uint end = start + _associativity;
+	uint8_t* state = _lru.data() + start;
 
 	//check for block
-	uint replacement_lru = 0u;
-	uint replacement_index = ~0u;
-	for(uint i = start; i < end; ++i)
-		if(_tag_array[i].tag == tag)
-		{
-			replacement_lru = _tag_array[i].lru;
-			replacement_index = i;
-			break;
-		}
-
-	if(replacement_index == ~0u)
+	uint found_index = _find_way(start, tag);
+	if(found_index != ~0u)
 	{
-		//find replacement block
-		if(_policy == Policy::LRU)
-		{
-			replacement_lru = _associativity - 1;
-		}
-		else if(_policy == Policy::LRU_RANDOM)
-		{
-			replacement_lru = _associativity * 3 / 4 + _hash % (_associativity / 4);
-			_hash = rtm::RNG::hash(_hash);
-		}
+		_replacement->hit(state, set_index, found_index - start, flags);
+		return Victim();
+	}
 
-		for(uint i = start; i < end; ++i)
-			if(_tag_array[i].lru == replacement_lru)
-			{
-				replacement_index = i;
-				break;
-			}
+	//find replacement block. Compaction leaves compressed sets with free ways
+	uint way = ~0u;
+	if(_compressed)
+	{
+		uint free_index = _find_way(start, INVALID_TAG);
+		if(free_index != ~0u) way = free_index - start;
 	}
+	if(way == ~0u) way = _replacement->victim(state, set_index);
+	uint replacement_index = start + way;
 
 	//check for victim block
 	Victim victim;
-	if(_tag_array[replacement_index].tag != tag && _tag_array[replacement_index].valid)
+	if(_valid[replacement_index])
 	{
-		victim.addr = _get_block_addr(_tag_array[replacement_index].tag, set_index);
+		victim.addr = _get_block_addr(_tags[replacement_index], set_index);
 		victim.data = _data_array.data() + replacement_index * _block_size;
-		victim.dirty = _tag_array[replacement_index].dirty;
-		victim.valid = _tag_array[replacement_index].valid;
+		victim.dirty = _dirty[replacement_index];
+		victim.valid = _valid[replacement_index];
+		victim.prefetched = _prefetched[replacement_index];
+		_replacement->evict(state, set_index, way);
 	}
+	if(_compressed) _release_block(replacement_index);
 
-	//update lru
-	for(uint i = start; i < end; ++i)
-		if(_tag_array[i].lru < replacement_lru) 
-			_tag_array[i].lru++;
+	//set block metadata
+	_tags[replacement_index] = tag;
+	_valid[replacement_index] = 0;
+	_dirty[replacement_index] = 0;
+	_prefetched[replacement_index] = 0;
+	_replacement->insert(state, set_index, way, block_addr, flags);
 
-	_tag_array[replacement_index].lru = 0;
+	return victim;
+}
 
-	//set block metadata
-	if(_tag_array[replacement_index].tag != tag)
+//sizes a valid sector under the compressor and charges it to its set
+void UnitCacheBase::_compress_sector(uint index, uint sector_index)
+{
+	uint i = index * (_block_size / _sector_size) + sector_index;
+	SectorCompressor::Result result = SectorCompressor::compress(_data_array.data() + index * _block_size + sector_index * _sector_size, _sector_size);
+	_set_segments[index / _associativity] += result.segments - _segments[i];
+	_segments[i] = result.segments;
+	_encodings[i] = result.encoding;
+}
+
+//evicts blocks until the set fits its data capacity. Every policy gives the block it would replace first the highest
+//state so the highest state block other than the one being written goes first
+void UnitCacheBase::_compact_set(uint set_index, uint keep_index)
+{
+	uint start = set_index * _associativity;
+	uint8_t* state = _lru.data() + start;
+	while(_set_segments[set_index] > _set_capacity)
 	{
-		_tag_array[replacement_index].tag = tag;
-		_tag_array[replacement_index].valid = 0;
-		_tag_array[replacement_index].dirty = 0;
+		uint victim_index = ~0u;
+		for(uint i = start; i < start + _associativity; ++i)
+			if(i != keep_index && _valid[i] && (victim_index == ~0u || state[i - start] > state[victim_index - start]))
+				victim_index = i;
+
+		_assert(victim_index != ~0u);
+
+		Victim victim;
+		victim.addr = _get_block_addr(_tags[victim_index], set_index);
+		victim.data = _data_array.data() + victim_index * _block_size;
+		victim.dirty = _dirty[victim_index];
+		victim.valid = _valid[victim_index];
+		victim.prefetched = _prefetched[victim_index];
+		_compaction_victims.push_back(victim);
+
+		_replacement->evict(state, set_index, victim_index - start);
+		_release_block(victim_index);
+		_tags[victim_index] = INVALID_TAG;
+		_valid[victim_index] = 0;
+		_dirty[victim_index] = 0;
+		_prefetched[victim_index] = 0;
 	}
+}
 
-	return victim;
+//returns the space held by a block's sectors to its set
+void UnitCacheBase::_release_block(uint index)
+{
+	uint sectors = _block_size / _sector_size;
+	for(uint i = index * sectors; i < (index + 1) * sectors; ++i)
+	{
+		_set_segments[index / _associativity] -= _segments[i];
+		_segments[i] = 0;
+	}
+}
+
+//cycles to decompress a sector, 0 if it isn't resident
+uint UnitCacheBase::_decompression_latency(paddr_t sector_addr)
+{
+	uint sector_index = _get_sector_index(sector_addr);
+	uint i = _find_way(_get_set_index(sector_addr) * _associativity, _get_tag(sector_addr));
+	if(i == ~0u || !((_valid[i] >> sector_index) & 0x1)) return 0;
+
+	return SectorCompressor::latency(_encodings[i * (_block_size / _sector_size) + sector_index]);
+}
+
+//compressed size of a resident sector in bytes
+uint UnitCacheBase::_compressed_size(paddr_t sector_addr)
+{
+	uint sector_index = _get_sector_index(sector_addr);
+	uint i = _find_way(_get_set_index(sector_addr) * _associativity, _get_tag(sector_addr));
+	if(i == ~0u || !((_valid[i] >> sector_index) & 0x1)) return 0;
+
+	return _segments[i * (_block_size / _sector_size) + sector_index] * SectorCompressor::SEGMENT_SIZE;
+}
+
+//true if a resident sector's block is ranked behind as many blocks as the set has uncompressed ways, so an uncompressed
+//cache would have replaced it. Call before the access updates the replacement state
+bool UnitCacheBase::_compression_hit(paddr_t sector_addr)
+{
+	uint start = _get_set_index(sector_addr) * _associativity;
+	uint i = _find_way(start, _get_tag(sector_addr));
+	if(i == ~0u || !((_valid[i] >> _get_sector_index(sector_addr)) & 0x1)) return false;
+
+	uint ahead = 0;
+	for(uint j = start; j < start + _associativity; ++j)
+		if(j != i && _valid[j] && _lru[j] < _lru[i]) ahead++;
+
+	return ahead >= _base_associativity;
 }
 
-}}
\ No newline at end of file
+}}
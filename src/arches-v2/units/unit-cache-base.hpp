@@ -2,6 +2,8 @@
 #include "stdafx.hpp"
 
 #include "unit-main-memory-base.hpp"
+#include "unit-cache-replacement.hpp"
+#include "unit-cache-compression.hpp"
 #include "util/bit-manipulation.hpp"
 #include "util/alignment-allocator.hpp"
 
@@ -13,10 +15,15 @@ public:
 	enum class Policy
 	{
 		LRU,
-		LRU_RANDOM
+		LRU_RANDOM,
+		SRRIP,
+		BRRIP,
+		DRRIP,
+		SHIP,
+		BVH_HINT,
 	};
 
-	UnitCacheBase(size_t size, uint block_size, uint associativity, uint sector_size = 0, Policy policy = Policy::LRU);
+	UnitCacheBase(size_t size, uint block_size, uint associativity, uint sector_size = 0, Policy policy = Policy::LRU, bool compressed = false);
 	virtual ~UnitCacheBase();
 
 	void serialize(std::string file_path);
@@ -24,6 +31,7 @@ public:
 	void direct_write(paddr_t block_addr, uint8_t* data);
 
 protected:
+	//packed layout of one way, only used for the serialized cache format
 	struct BlockMetaData
 	{
 		uint64_t tag     : 48;
@@ -38,19 +46,53 @@ protected:
 		uint8_t* data{nullptr};
 		uint8_t dirty{0x0};
 		uint8_t valid{0x0};
+		uint8_t prefetched{0x0};
 	};
 
-	uint _hash;
 	Policy _policy;
+	ReplacementPolicy* _replacement;
 	uint _sets, _associativity, _block_size, _sector_size;
 	paddr_t _block_offset_bits, _sector_offset_bits;
 
-	std::vector<BlockMetaData, AlignmentAllocator<BlockMetaData, 64>> _tag_array;
+	//tag array is stored as a structure of arrays so a whole set can be searched with a few vector compares. _lru holds
+	//the replacement state of whichever policy is in use
+	constexpr static uint64_t INVALID_TAG = (0x1ull << 48) - 1;
+	std::vector<uint64_t, AlignmentAllocator<uint64_t, 64>> _tags;
+	std::vector<uint8_t, AlignmentAllocator<uint8_t, 64>> _lru;
+	std::vector<uint8_t, AlignmentAllocator<uint8_t, 64>> _valid;
+	std::vector<uint8_t, AlignmentAllocator<uint8_t, 64>> _dirty;
+	std::vector<uint8_t, AlignmentAllocator<uint8_t, 64>> _prefetched; //sectors filled by a prefetch and not yet used
 	std::vector<uint8_t, AlignmentAllocator<uint8_t, 64>> _data_array;
 
-	uint8_t* _read_sector(paddr_t sector_addr);
+	//Compressed mode gives every set COMPRESSION_TAG_FACTOR times the tags and charges each valid sector its compressed
+	//size, so a set holds as many blocks as fit in the data capacity of the uncompressed ways. Blocks squeezed out when a
+	//sector is written go to _compaction_victims and have to be written back by the caller before the next allocation
+	constexpr static uint COMPRESSION_TAG_FACTOR = 2;
+	bool _compressed;
+	uint _base_associativity; //ways of data per set
+	uint _set_capacity; //segments per set
+	std::vector<uint8_t> _segments; //per sector, 0 when invalid
+	std::vector<SectorCompressor::Encoding> _encodings; //per sector
+	std::vector<uint16_t> _set_segments;
+	std::vector<Victim> _compaction_victims;
+
+	uint _find_way(uint start, uint64_t tag);
+
+	uint8_t* _read_sector(paddr_t sector_addr, MemoryRequest::Flags flags = {});
 	uint8_t* _write_sector(paddr_t sector_addr, const uint8_t* data, bool set_dirty = false);
-	Victim _allocate_block(paddr_t block_addr);
+	uint8_t* _get_sector(paddr_t sector_addr);
+	void _set_dirty(paddr_t sector_addr);
+	void _set_prefetched(paddr_t sector_addr);
+	bool _take_prefetched(paddr_t sector_addr);
+	Victim _allocate_block(paddr_t block_addr, MemoryRequest::Flags flags = {});
+	void _checkpoint_arrays(Checkpoint& checkpoint);
+
+	void _compress_sector(uint index, uint sector_index);
+	void _compact_set(uint set_index, uint keep_index);
+	void _release_block(uint index);
+	uint _decompression_latency(paddr_t sector_addr);
+	uint _compressed_size(paddr_t sector_addr);
+	bool _compression_hit(paddr_t sector_addr);
 
 	paddr_t _get_sector_index(paddr_t paddr) { return _get_block_offset(paddr) / _sector_size; }
 	paddr_t _get_sector_offset(paddr_t paddr) { return paddr & _sector_offset_bits; }
@@ -0,0 +1,112 @@
+#include "unit-cache-compression.hpp"
+
+namespace Arches { namespace Units {
+
+static uint64_t load_value(const uint8_t* data, uint bytes)
+{
+	uint64_t value = 0;
+	std::memcpy(&value, data, bytes);
+	return value;
+}
+
+static int64_t sign_extend(uint64_t value, uint bytes)
+{
+	uint shift = 64 - bytes * 8;
+	return (int64_t)(value << shift) >> shift;
+}
+
+//true if the difference of two values_bytes wide values fits in delta_bytes
+static bool delta_fits(uint64_t value, uint64_t base, uint value_bytes, uint delta_bytes)
+{
+	int64_t delta = sign_extend(value - base, value_bytes);
+	return sign_extend((uint64_t)delta, delta_bytes) == delta;
+}
+
+SectorCompressor::Result SectorCompressor::compress(const uint8_t* data, uint size)
+{
+	_assert(size % SEGMENT_SIZE == 0);
+	uint8_t max_segments = size / SEGMENT_SIZE;
+
+	uint64_t first = load_value(data, 8);
+	bool repeated = true;
+	for(uint i = 8; i < size && repeated; i += 8)
+		repeated = load_value(data + i, 8) == first;
+
+	if(repeated) return {1, first == 0 ? Encoding::ZEROS : Encoding::REPEATED};
+
+	uint bdi_segments = (bdi_size(data, size) + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+	uint fpc_segments = (fpc_size(data, size) + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+
+	//BDI wins ties since it decompresses faster
+	if(bdi_segments < max_segments && bdi_segments <= fpc_segments) return {(uint8_t)bdi_segments, Encoding::BDI};
+	if(fpc_segments < max_segments)                                 return {(uint8_t)fpc_segments, Encoding::FPC};
+	return {max_segments, Encoding::UNCOMPRESSED};
+}
+
+//smallest base + delta encoding. Each value is a delta from the first value that isn't near zero or from zero, a bit
+//per value selects which
+uint SectorCompressor::bdi_size(const uint8_t* data, uint size)
+{
+	const static uint configs[][2] = {{8, 1}, {8, 2}, {8, 4}, {4, 1}, {4, 2}, {2, 1}};
+
+	uint best = size;
+	for(auto& config : configs)
+	{
+		uint value_bytes = config[0], delta_bytes = config[1];
+		uint num_values = size / value_bytes;
+
+		bool has_base = false, fits = true;
+		uint64_t base = 0;
+		for(uint i = 0; i < num_values && fits; ++i)
+		{
+			uint64_t value = load_value(data + i * value_bytes, value_bytes);
+			if(delta_fits(value, 0, value_bytes, delta_bytes)) continue;
+
+			if(!has_base)
+			{
+				base = value;
+				has_base = true;
+			}
+			else fits = delta_fits(value, base, value_bytes, delta_bytes);
+		}
+
+		if(fits) best = std::min(best, value_bytes + num_values * delta_bytes + (num_values + 7) / 8);
+	}
+
+	return best;
+}
+
+uint SectorCompressor::fpc_size(const uint8_t* data, uint size)
+{
+	uint bits = 0;
+	for(uint i = 0; i < size; i += 4)
+	{
+		uint32_t word = (uint32_t)load_value(data + i, 4);
+		if(word == 0)
+		{
+			//runs of up to 8 zero words share one prefix and a 3 bit count
+			uint run = 1;
+			while(run < 8 && i + 4 < size && (uint32_t)load_value(data + i + 4, 4) == 0)
+			{
+				i += 4;
+				run++;
+			}
+			bits += 3 + 3;
+			continue;
+		}
+
+		int32_t value = (int32_t)word;
+		uint16_t low = word & 0xffff, high = word >> 16;
+		if(value >= -8 && value < 8)                                   bits += 3 + 4;
+		else if(value >= -128 && value < 128)                          bits += 3 + 8;
+		else if(value >= -32768 && value < 32768)                      bits += 3 + 16;
+		else if(low == 0)                                              bits += 3 + 16;
+		else if(sign_extend(low, 2) == (int8_t)low && sign_extend(high, 2) == (int8_t)high) bits += 3 + 16;
+		else if(word == (word & 0xff) * 0x01010101u)                   bits += 3 + 8;
+		else                                                           bits += 3 + 32;
+	}
+
+	return (bits + 7) / 8;
+}
+
+}}
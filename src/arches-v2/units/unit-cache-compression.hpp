@@ -0,0 +1,49 @@
+#pragma once
+#include "stdafx.hpp"
+
+namespace Arches { namespace Units {
+
+//Sizes a sector under the encoders of a compressed cache. Only the compressed size and the decompression latency are
+//modeled, the data array keeps sectors uncompressed.
+//Base-Delta-Immediate (Pekhimenko et al. PACT 2012) stores one base and a narrow delta per value, values can also be
+//deltas from an implicit zero base. Frequent Pattern Compression (Alameldeen and Wood ISCA 2004) codes each 32 bit
+//word with a 3 bit prefix selecting one of seven patterns.
+class SectorCompressor
+{
+public:
+	constexpr static uint SEGMENT_SIZE = 8; //compressed sectors are allocated in segments
+
+	enum class Encoding : uint8_t
+	{
+		UNCOMPRESSED,
+		ZEROS,
+		REPEATED,
+		BDI,
+		FPC,
+	};
+
+	struct Result
+	{
+		uint8_t segments;
+		Encoding encoding;
+	};
+
+	static Result compress(const uint8_t* data, uint size);
+
+	static uint bdi_size(const uint8_t* data, uint size);
+	static uint fpc_size(const uint8_t* data, uint size);
+
+	//cycles to decompress a sector before it can be read or merged with a store
+	static uint latency(Encoding encoding)
+	{
+		switch(encoding)
+		{
+		case Encoding::REPEATED: return 1;
+		case Encoding::BDI:      return 1;
+		case Encoding::FPC:      return 5;
+		default:                 return 0;
+		}
+	}
+};
+
+}}
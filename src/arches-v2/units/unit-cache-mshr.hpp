@@ -0,0 +1,189 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "simulator/checkpoint.hpp"
+#include "simulator/transactions.hpp"
+
+namespace Arches { namespace Units {
+
+//Miss status handling registers of a cache slice. Entries and their subentries live in flat arrays sized at construction
+//so misses never touch the heap. Entries are found through a linear probed index at least twice the size of the file,
+//freeing an entry shifts the rest of its probe run back so the index never needs tombstones.
+class MSHRFile
+{
+private:
+	constexpr static uint16_t EMPTY = 0xffff;
+
+	struct Entry
+	{
+		paddr_t addr{0x0};
+		uint16_t head{0};
+		uint16_t count{0};
+		uint16_t slot{EMPTY};
+	};
+
+	uint _num_subentries;
+	std::vector<Entry> _entries;
+	std::vector<MemoryRequest> _subentries;
+	std::vector<uint16_t> _free;
+	std::vector<uint16_t> _index;
+	uint _index_mask;
+
+	uint _hash(paddr_t addr) const
+	{
+		return (uint)((addr * 0x9e3779b97f4a7c15ull) >> 32) & _index_mask;
+	}
+
+	void _insert_index(uint entry)
+	{
+		uint slot = _hash(_entries[entry].addr);
+		while(_index[slot] != EMPTY) slot = (slot + 1) & _index_mask;
+		_index[slot] = entry;
+		_entries[entry].slot = slot;
+	}
+
+	void _remove_index(uint slot)
+	{
+		_index[slot] = EMPTY;
+
+		//move later entries of the run into the hole unless that would put them before their home slot
+		uint hole = slot;
+		for(uint next = (slot + 1) & _index_mask; _index[next] != EMPTY; next = (next + 1) & _index_mask)
+		{
+			uint home = _hash(_entries[_index[next]].addr);
+			if(((next - home) & _index_mask) < ((next - hole) & _index_mask)) continue;
+
+			_index[hole] = _index[next];
+			_entries[_index[hole]].slot = hole;
+			_index[next] = EMPTY;
+			hole = next;
+		}
+	}
+
+	MemoryRequest& _subentry(uint entry, uint i)
+	{
+		uint j = _entries[entry].head + i;
+		if(j >= _num_subentries) j -= _num_subentries;
+		return _subentries[entry * _num_subentries + j];
+	}
+
+public:
+	MSHRFile(uint num_mshr, uint num_subentries) : _num_subentries(num_subentries), _entries(num_mshr), _subentries(num_mshr * num_subentries)
+	{
+		_assert(num_mshr < EMPTY && num_subentries < EMPTY);
+
+		uint index_size = 1;
+		while(index_size < 2 * num_mshr) index_size <<= 1;
+		_index.resize(index_size, EMPTY);
+		_index_mask = index_size - 1;
+
+		_free.reserve(num_mshr);
+		for(uint i = num_mshr; i > 0; --i)
+			_free.push_back(i - 1);
+	}
+
+	uint capacity() const { return _entries.size(); }
+	uint size() const { return _entries.size() - _free.size(); }
+	bool empty() const { return _free.size() == _entries.size(); }
+	bool full() const { return _free.empty(); }
+
+	//returns the entry tracking addr or ~0u
+	uint find(paddr_t addr) const
+	{
+		for(uint slot = _hash(addr); _index[slot] != EMPTY; slot = (slot + 1) & _index_mask)
+			if(_entries[_index[slot]].addr == addr) return _index[slot];
+
+		return ~0u;
+	}
+
+	//returns a new entry for addr or ~0u if the file is full, addr must not already have an entry
+	uint allocate(paddr_t addr)
+	{
+		_assert(find(addr) == ~0u);
+		if(full()) return ~0u;
+
+		uint entry = _free.back();
+		_free.pop_back();
+		_entries[entry].addr = addr;
+		_entries[entry].head = 0;
+		_entries[entry].count = 0;
+		_insert_index(entry);
+		return entry;
+	}
+
+	void free(uint entry)
+	{
+		_remove_index(_entries[entry].slot);
+		_entries[entry].slot = EMPTY;
+		_free.push_back(entry);
+	}
+
+	uint num_subentries(uint entry) const { return _entries[entry].count; }
+	bool subentries_full(uint entry) const { return _entries[entry].count >= _num_subentries; }
+
+	MemoryRequest& front(uint entry)
+	{
+		_assert(_entries[entry].count > 0);
+		return _subentry(entry, 0);
+	}
+
+	void push(uint entry, const MemoryRequest& request)
+	{
+		_assert(!subentries_full(entry));
+		_subentry(entry, _entries[entry].count++) = request;
+	}
+
+	void pop(uint entry)
+	{
+		_assert(_entries[entry].count > 0);
+		if(++_entries[entry].head >= _num_subentries) _entries[entry].head = 0;
+		_entries[entry].count--;
+	}
+
+	//only live entries are saved, a restore allocates them again to rebuild the index
+	template<typename CP>
+	void checkpoint(CP& checkpoint)
+	{
+		uint live = size();
+		checkpoint.io(live);
+
+		if(checkpoint.restoring())
+		{
+			std::fill(_index.begin(), _index.end(), EMPTY);
+			_free.clear();
+			for(uint i = _entries.size(); i > 0; --i)
+				_free.push_back(i - 1);
+
+			for(uint i = 0; i < live; ++i)
+			{
+				paddr_t addr;
+				uint16_t count;
+				checkpoint.io(addr);
+				checkpoint.io(count);
+
+				uint entry = allocate(addr);
+				for(uint j = 0; j < count; ++j)
+				{
+					MemoryRequest request;
+					checkpoint.io(request);
+					push(entry, request);
+				}
+			}
+		}
+		else
+		{
+			for(uint slot = 0; slot < _index.size(); ++slot)
+			{
+				if(_index[slot] == EMPTY) continue;
+
+				uint entry = _index[slot];
+				checkpoint.io(_entries[entry].addr);
+				checkpoint.io(_entries[entry].count);
+				for(uint j = 0; j < _entries[entry].count; ++j)
+					checkpoint.io(_subentry(entry, j));
+			}
+		}
+	}
+};
+
+}}
@@ -0,0 +1,106 @@
+#include "unit-cache-prefetcher.hpp"
+
+namespace Arches { namespace Units {
+
+uint BVHPrefetcher::decode(const Node& node, Region* regions)
+{
+	//the exponents are the same for every child so quantized extents scaled by them rank the children exactly
+	rtm::vec3 e = node.e();
+	float area[WIDTH];
+	uint order[WIDTH];
+	uint num_children = 0;
+	for(uint i = 0; i < WIDTH; ++i)
+	{
+		if(!node.is_int(i) && node.num_prims(i) == 0) continue;
+
+		const rtm::QAABB8& qaabb = node.qaabb[i];
+		float x = (qaabb.max[0] - qaabb.min[0]) * e.x;
+		float y = (qaabb.max[1] - qaabb.min[1]) * e.y;
+		float z = (qaabb.max[2] - qaabb.min[2]) * e.z;
+		area[i] = x * y + y * z + z * x;
+
+		uint j = num_children++;
+		for(; j > 0 && area[order[j - 1]] < area[i]; --j)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	uint num_regions = std::min(num_children, _degree);
+	for(uint j = 0; j < num_regions; ++j)
+	{
+		uint i = order[j];
+		if(node.is_int(i))
+		{
+			regions[j].addr = _node_base_addr + (node.base_child_index + node.offset(i)) * sizeof(Node);
+			regions[j].size = sizeof(Node);
+		}
+		else
+		{
+			regions[j].addr = _tri_base_addr + (node.base_prim_index + node.offset(i)) * _tri_size;
+			regions[j].size = _tri_size;
+		}
+	}
+
+	return num_regions;
+}
+
+uint StreamPrefetcher::train(paddr_t block_addr, paddr_t* blocks)
+{
+	_clock++;
+
+	//find the stream this block continues, otherwise replace the least recently used stream
+	Stream* stream = nullptr;
+	Stream* lru = &_streams[0];
+	for(Stream& s : _streams)
+	{
+		int64_t stride = ((int64_t)block_addr - (int64_t)s.last_block) / (int64_t)_block_size;
+		if(s.last_block != ~0ull && stride >= -MAX_STRIDE && stride <= MAX_STRIDE)
+		{
+			stream = &s;
+			break;
+		}
+
+		if(s.last_use < lru->last_use) lru = &s;
+	}
+
+	if(!stream)
+	{
+		lru->last_block = block_addr;
+		lru->stride = 0;
+		lru->confidence = 0;
+		lru->last_use = _clock;
+		return 0;
+	}
+
+	int64_t stride = ((int64_t)block_addr - (int64_t)stream->last_block) / (int64_t)_block_size;
+	stream->last_use = _clock;
+	if(stride == 0) return 0;
+
+	//ahead is how many strides past the last block were already prefetched, only the new ones are issued
+	if(stride == stream->stride)
+	{
+		if(stream->confidence < CONFIDENCE_MAX) stream->confidence++;
+		if(stream->ahead > 0) stream->ahead--;
+	}
+	else
+	{
+		stream->stride = stride;
+		stream->confidence = 0;
+		stream->ahead = 0;
+	}
+	stream->last_block = block_addr;
+
+	if(stream->confidence == 0) return 0;
+
+	uint num_blocks = 0;
+	for(uint i = std::max(stream->ahead + 1, _distance); i < _distance + _degree; ++i)
+	{
+		int64_t addr = (int64_t)block_addr + stride * (int64_t)i * (int64_t)_block_size;
+		if(addr >= 0) blocks[num_blocks++] = (paddr_t)addr;
+	}
+	stream->ahead = _distance + _degree - 1;
+
+	return num_blocks;
+}
+
+}}
@@ -0,0 +1,102 @@
+#pragma once
+#include "stdafx.hpp"
+#include "rtm/rtm.hpp"
+
+#include "simulator/checkpoint.hpp"
+#include "simulator/transactions.hpp"
+
+namespace Arches { namespace Units {
+
+//Prefetchers only pick addresses. The cache owns the prefetch queues, filters candidates it already holds or is already
+//fetching and issues the rest into free MSHRs.
+
+//Decodes NVCWBVH nodes as they become resident and prefetches the children a ray is most likely to visit next. The cache
+//doesn't see rays so children are ranked by surface area, the probability a random ray that hit the parent hits the child.
+//Leaf children prefetch their first strip. Nodes must be at raw addresses so this only works at the first cache level.
+class BVHPrefetcher
+{
+public:
+	typedef rtm::NVCWBVH::Node Node;
+	constexpr static uint WIDTH = rtm::NVCWBVH::WIDTH;
+
+	struct Region
+	{
+		paddr_t addr;
+		uint size;
+	};
+
+	constexpr static uint FILTER_SIZE = 64;
+
+	BVHPrefetcher(uint degree, paddr_t node_base_addr, paddr_t tri_base_addr, uint tri_size) :
+		_degree(degree), _node_base_addr(node_base_addr), _tri_base_addr(tri_base_addr), _tri_size(tri_size), _filter(FILTER_SIZE, ~0ull) {}
+
+	paddr_t get_node_addr(paddr_t addr) const
+	{
+		return _node_base_addr + (addr - _node_base_addr) / sizeof(Node) * sizeof(Node);
+	}
+
+	bool is_node(paddr_t addr, MemoryRequest::Flags flags) const
+	{
+		MemoryRequest::Hint hint = (MemoryRequest::Hint)flags.hint;
+		return addr >= _node_base_addr && (hint == MemoryRequest::Hint::HIGH_REUSE || hint == MemoryRequest::Hint::LOW_REUSE);
+	}
+
+	//true if the node was decoded recently. Every ray through the top of the tree decodes the same nodes
+	bool filter(paddr_t node_addr)
+	{
+		paddr_t& entry = _filter[(node_addr / sizeof(Node)) % FILTER_SIZE];
+		if(entry == node_addr) return true;
+		entry = node_addr;
+		return false;
+	}
+
+	//fills regions with the children to prefetch and returns how many there are
+	uint decode(const Node& node, Region* regions);
+
+	void checkpoint(Checkpoint& checkpoint) { checkpoint.io(_filter); }
+
+private:
+	uint _degree;
+	paddr_t _node_base_addr;
+	paddr_t _tri_base_addr;
+	uint _tri_size;
+	std::vector<paddr_t> _filter;
+};
+
+//Stride prefetcher for streamed data like triangle strips. Each stream tracks the last block it touched and the stride
+//between its last two blocks, once the same stride is seen twice it keeps degree blocks in flight starting distance blocks
+//ahead.
+class StreamPrefetcher
+{
+public:
+	constexpr static int64_t MAX_STRIDE = 16; //in blocks
+	constexpr static uint8_t CONFIDENCE_MAX = 3;
+	constexpr static uint MAX_DEGREE = 16;
+
+	StreamPrefetcher(uint num_streams, uint degree, uint distance, uint block_size) :
+		_streams(num_streams), _degree(degree), _distance(distance), _block_size(block_size)
+	{
+		_assert(num_streams > 0 && degree <= MAX_DEGREE);
+	}
+
+	//trains on a demand access to block_addr and fills blocks with the blocks to prefetch. Returns how many there are
+	uint train(paddr_t block_addr, paddr_t* blocks);
+
+	void checkpoint(Checkpoint& checkpoint) { checkpoint.io(_streams); checkpoint.io(_clock); }
+
+private:
+	struct Stream
+	{
+		paddr_t last_block{~0ull};
+		int64_t stride{0};
+		uint8_t confidence{0};
+		uint ahead{0};
+		uint64_t last_use{0};
+	};
+
+	std::vector<Stream> _streams;
+	uint _degree, _distance, _block_size;
+	uint64_t _clock{0};
+};
+
+}}
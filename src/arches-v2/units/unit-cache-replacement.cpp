@@ -0,0 +1,135 @@
+#include "unit-cache-replacement.hpp"
+#include "util/bit-manipulation.hpp"
+#include "util/simd-scan.hpp"
+#include "rtm/rng.hpp"
+
+namespace Arches { namespace Units {
+
+void LRUReplacement::reset(uint8_t* state, uint)
+{
+	for(uint i = 0; i < _associativity; ++i)
+		state[i] = i;
+}
+
+void LRUReplacement::hit(uint8_t* state, uint, uint way, MemoryRequest::Flags)
+{
+	scan_increment_below(state, _associativity, state[way]);
+	state[way] = 0;
+}
+
+uint LRUReplacement::victim(uint8_t* state, uint)
+{
+	return scan_find(state, _associativity, _associativity - 1);
+}
+
+void LRUReplacement::insert(uint8_t* state, uint set, uint way, paddr_t, MemoryRequest::Flags flags)
+{
+	hit(state, set, way, flags);
+}
+
+uint RandomLRUReplacement::victim(uint8_t* state, uint)
+{
+	uint lru = _associativity * 3 / 4 + _hash % (_associativity / 4);
+	_hash = rtm::RNG::hash(_hash);
+	return scan_find(state, _associativity, lru);
+}
+
+void RRIPReplacement::reset(uint8_t* state, uint)
+{
+	for(uint i = 0; i < _associativity; ++i)
+		state[i] = RRPV_MAX;
+}
+
+void RRIPReplacement::hit(uint8_t* state, uint, uint way, MemoryRequest::Flags)
+{
+	state[way] = 0;
+}
+
+//ages the whole set until some block predicts distant re-reference, in one step since every block ages equally
+uint RRIPReplacement::victim(uint8_t* state, uint)
+{
+	uint way = scan_find(state, _associativity, RRPV_MAX);
+	if(way != ~0u) return way;
+
+	scan_add(state, _associativity, RRPV_MAX - scan_max(state, _associativity));
+	return scan_find(state, _associativity, RRPV_MAX);
+}
+
+void RRIPReplacement::insert(uint8_t* state, uint set, uint way, paddr_t block_addr, MemoryRequest::Flags flags)
+{
+	state[way] = _insertion_rrpv(set, block_addr, flags);
+}
+
+void DRRIPReplacement::checkpoint(Checkpoint& checkpoint)
+{
+	BRRIPReplacement::checkpoint(checkpoint);
+	checkpoint.io(_psel);
+}
+
+//insertions only happen on misses so they double as the miss count of the leader sets
+uint8_t DRRIPReplacement::_insertion_rrpv(uint set, paddr_t, MemoryRequest::Flags)
+{
+	uint leader = set % DUEL_PERIOD;
+	if(leader == 0)
+	{
+		if(_psel < PSEL_MAX) _psel++;
+		return RRPV_MAX - 1;
+	}
+
+	if(leader == DUEL_PERIOD / 2)
+	{
+		if(_psel > 0) _psel--;
+		return _brrip_rrpv();
+	}
+
+	return _psel > PSEL_MAX / 2 ? _brrip_rrpv() : RRPV_MAX - 1;
+}
+
+SHiPReplacement::SHiPReplacement(uint sets, uint associativity) : RRIPReplacement(sets, associativity),
+	_shct(1ull << SIGNATURE_BITS, 1), _signatures(sets * associativity, 0), _reused(sets * associativity, 0)
+{
+}
+
+void SHiPReplacement::hit(uint8_t* state, uint set, uint way, MemoryRequest::Flags)
+{
+	uint index = set * _associativity + way;
+	uint8_t& counter = _shct[_signatures[index]];
+	if(counter < SHCT_MAX) counter++;
+	_reused[index] = 1;
+	state[way] = 0;
+}
+
+void SHiPReplacement::insert(uint8_t* state, uint set, uint way, paddr_t block_addr, MemoryRequest::Flags)
+{
+	uint index = set * _associativity + way;
+	uint16_t signature = _signature(block_addr);
+	_signatures[index] = signature;
+	_reused[index] = 0;
+	state[way] = _shct[signature] == 0 ? RRPV_MAX : RRPV_MAX - 1;
+}
+
+void SHiPReplacement::evict(uint8_t*, uint set, uint way)
+{
+	uint index = set * _associativity + way;
+	uint8_t& counter = _shct[_signatures[index]];
+	if(!_reused[index] && counter > 0) counter--;
+}
+
+void SHiPReplacement::checkpoint(Checkpoint& checkpoint)
+{
+	checkpoint.io(_shct);
+	checkpoint.io(_signatures);
+	checkpoint.io(_reused);
+}
+
+uint8_t BVHHintReplacement::_insertion_rrpv(uint, paddr_t, MemoryRequest::Flags flags)
+{
+	switch((MemoryRequest::Hint)flags.hint)
+	{
+	case MemoryRequest::Hint::HIGH_REUSE: return 0;
+	case MemoryRequest::Hint::STREAMING: return RRPV_MAX;
+	default: return RRPV_MAX - 1;
+	}
+}
+
+}}
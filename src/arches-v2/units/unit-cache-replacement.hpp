@@ -0,0 +1,155 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "simulator/checkpoint.hpp"
+#include "simulator/transactions.hpp"
+
+namespace Arches { namespace Units {
+
+//Replacement state is one byte per way owned by the cache so it is serialized and checkpointed with the tag array.
+//Policies get a pointer to the state of the set being accessed and keep any extra tables themselves.
+class ReplacementPolicy
+{
+public:
+	ReplacementPolicy(uint sets, uint associativity) : _sets(sets), _associativity(associativity) {}
+	virtual ~ReplacementPolicy() = default;
+
+	//initial state of a set
+	virtual void reset(uint8_t* state, uint set) = 0;
+
+	//block in way was accessed
+	virtual void hit(uint8_t* state, uint set, uint way, MemoryRequest::Flags flags) = 0;
+
+	//way to replace in a set that doesn't hold the block
+	virtual uint victim(uint8_t* state, uint set) = 0;
+
+	//block_addr was placed in way
+	virtual void insert(uint8_t* state, uint set, uint way, paddr_t block_addr, MemoryRequest::Flags flags) = 0;
+
+	//valid block in way is about to be replaced
+	virtual void evict(uint8_t*, uint, uint) {}
+
+	virtual void checkpoint(Checkpoint&) {}
+
+protected:
+	uint _sets, _associativity;
+};
+
+//state is the position in the recency stack, 0 is most recently used
+class LRUReplacement : public ReplacementPolicy
+{
+public:
+	LRUReplacement(uint sets, uint associativity) : ReplacementPolicy(sets, associativity) {}
+
+	void reset(uint8_t* state, uint set) override;
+	void hit(uint8_t* state, uint set, uint way, MemoryRequest::Flags flags) override;
+	uint victim(uint8_t* state, uint set) override;
+	void insert(uint8_t* state, uint set, uint way, paddr_t block_addr, MemoryRequest::Flags flags) override;
+};
+
+//replaces a random block from the least recently used quarter of the set
+class RandomLRUReplacement : public LRUReplacement
+{
+public:
+	RandomLRUReplacement(uint sets, uint associativity) : LRUReplacement(sets, associativity) { _assert(associativity >= 4); }
+
+	uint victim(uint8_t* state, uint set) override;
+	void checkpoint(Checkpoint& checkpoint) override { checkpoint.io(_hash); }
+
+private:
+	uint _hash{1};
+};
+
+//Static RRIP (Jaleel et al. ISCA 2010). State is a 2 bit re-reference prediction value, hits predict near re-reference
+//and new blocks are inserted with a long re-reference prediction so blocks that are never reused leave quickly.
+class RRIPReplacement : public ReplacementPolicy
+{
+public:
+	constexpr static uint8_t RRPV_MAX = 3;
+
+	RRIPReplacement(uint sets, uint associativity) : ReplacementPolicy(sets, associativity) {}
+
+	void reset(uint8_t* state, uint set) override;
+	void hit(uint8_t* state, uint set, uint way, MemoryRequest::Flags flags) override;
+	uint victim(uint8_t* state, uint set) override;
+	void insert(uint8_t* state, uint set, uint way, paddr_t block_addr, MemoryRequest::Flags flags) override;
+
+protected:
+	virtual uint8_t _insertion_rrpv(uint, paddr_t, MemoryRequest::Flags) { return RRPV_MAX - 1; }
+};
+
+//Bimodal RRIP, inserts at distant re-reference except for 1 in BIMODAL_PERIOD blocks so thrashing working sets keep a
+//fraction of their blocks
+class BRRIPReplacement : public RRIPReplacement
+{
+public:
+	constexpr static uint BIMODAL_PERIOD = 32;
+
+	BRRIPReplacement(uint sets, uint associativity) : RRIPReplacement(sets, associativity) {}
+
+	void checkpoint(Checkpoint& checkpoint) override { checkpoint.io(_throttle); }
+
+protected:
+	uint _throttle{0};
+
+	uint8_t _brrip_rrpv() { return ++_throttle % BIMODAL_PERIOD == 0 ? RRPV_MAX - 1 : RRPV_MAX; }
+	uint8_t _insertion_rrpv(uint, paddr_t, MemoryRequest::Flags) override { return _brrip_rrpv(); }
+};
+
+//Dynamic RRIP, one set in every DUEL_PERIOD always uses SRRIP and another always uses BRRIP. Misses in the leader sets
+//move a saturating counter that picks the policy for every other set.
+class DRRIPReplacement : public BRRIPReplacement
+{
+public:
+	constexpr static uint DUEL_PERIOD = 64;
+	constexpr static uint PSEL_MAX = 1023;
+
+	DRRIPReplacement(uint sets, uint associativity) : BRRIPReplacement(sets, associativity) {}
+
+	void checkpoint(Checkpoint& checkpoint) override;
+
+protected:
+	uint _psel{PSEL_MAX / 2};
+
+	uint8_t _insertion_rrpv(uint set, paddr_t block_addr, MemoryRequest::Flags flags) override;
+};
+
+//SHiP (Wu et al. MICRO 2011) on top of SRRIP. We don't carry PCs with requests so the signature is the memory region
+//of the block (SHiP-Mem). Regions whose blocks are evicted without reuse get inserted at distant re-reference.
+class SHiPReplacement : public RRIPReplacement
+{
+public:
+	constexpr static uint SIGNATURE_BITS = 14;
+	constexpr static uint REGION_BITS = 14;
+	constexpr static uint8_t SHCT_MAX = 7;
+
+	SHiPReplacement(uint sets, uint associativity);
+
+	void hit(uint8_t* state, uint set, uint way, MemoryRequest::Flags flags) override;
+	void insert(uint8_t* state, uint set, uint way, paddr_t block_addr, MemoryRequest::Flags flags) override;
+	void evict(uint8_t* state, uint set, uint way) override;
+	void checkpoint(Checkpoint& checkpoint) override;
+
+protected:
+	std::vector<uint8_t> _shct; //signature history counter table
+	std::vector<uint16_t> _signatures;
+	std::vector<uint8_t> _reused;
+
+	static uint16_t _signature(paddr_t block_addr)
+	{
+		return (uint16_t)(((block_addr >> REGION_BITS) * 0x9e3779b97f4a7c15ull) >> (64 - SIGNATURE_BITS));
+	}
+};
+
+//SRRIP with the insertion prediction taken from the requester's MemoryRequest::Hint. The RT cores mark the top levels
+//of the BVH as high reuse, deeper nodes as low reuse and triangles as streaming.
+class BVHHintReplacement : public RRIPReplacement
+{
+public:
+	BVHHintReplacement(uint sets, uint associativity) : RRIPReplacement(sets, associativity) {}
+
+protected:
+	uint8_t _insertion_rrpv(uint set, paddr_t block_addr, MemoryRequest::Flags flags) override;
+};
+
+}}
@@ -0,0 +1,66 @@
+#include "unit-cache-reuse-profiler.hpp"
+
+namespace Arches { namespace Units {
+
+bool ReuseProfiler::access(paddr_t block_addr, uint64_t& distance)
+{
+	if(!_sampled(block_addr)) return false;
+
+	if(_time == _capacity())
+	{
+		std::vector<std::pair<paddr_t, uint64_t>> live = _live_blocks();
+		_rebuild(live);
+	}
+
+	auto it = _last_access.find(block_addr);
+	if(it == _last_access.end())
+	{
+		distance = COLD;
+		_last_access[block_addr] = _time;
+	}
+	else
+	{
+		//every mark after the last access is a distinct block touched since
+		uint64_t distinct = _prefix(_time) - _prefix(it->second + 1);
+		distance = (uint64_t)(distinct / _sample_rate);
+		_update(it->second, -1);
+		it->second = _time;
+	}
+
+	_update(_time++, 1);
+	return true;
+}
+
+//live blocks ordered by last access
+std::vector<std::pair<paddr_t, uint64_t>> ReuseProfiler::_live_blocks() const
+{
+	std::vector<std::pair<paddr_t, uint64_t>> live(_last_access.begin(), _last_access.end());
+	std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+	return live;
+}
+
+//renumbers the live blocks to times 0 to n - 1 and sizes the tree to at least twice that
+void ReuseProfiler::_rebuild(std::vector<std::pair<paddr_t, uint64_t>>& live)
+{
+	uint64_t capacity = MIN_CAPACITY;
+	while(capacity < 2 * live.size()) capacity <<= 1;
+
+	_last_access.clear();
+	_tree.assign(capacity + 1, 0);
+	for(uint64_t i = 0; i < live.size(); ++i)
+	{
+		_last_access[live[i].first] = i;
+		_tree[i + 1] = 1;
+	}
+
+	//build the Fenwick tree from the marks in one pass
+	for(uint64_t i = 1; i < _tree.size(); ++i)
+	{
+		uint64_t parent = i + (i & (~i + 1));
+		if(parent < _tree.size()) _tree[parent] += _tree[i];
+	}
+
+	_time = live.size();
+}
+
+}}
@@ -0,0 +1,73 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "simulator/checkpoint.hpp"
+
+namespace Arches { namespace Units {
+
+//One pass LRU stack distance profiler (Mattson et al. 1970) with SHARDS spatial sampling (Waldspurger et al. FAST 2015).
+//Blocks whose address hash falls under the sample rate are tracked, every access to one of them reports how many distinct
+//sampled blocks were touched since its last access. Distances are scaled by 1 / sample rate so they estimate the fully
+//associative stack distance of the whole stream.
+//The distinct block count comes from a Fenwick tree over access times with one mark at the last access of every live
+//block. Times are renumbered when the tree fills so it stays proportional to the sampled footprint.
+class ReuseProfiler
+{
+public:
+	constexpr static uint64_t COLD = ~0ull;
+	constexpr static uint HASH_BITS = 24;
+
+	ReuseProfiler(float sample_rate) : _sample_rate(sample_rate),
+		_threshold((uint64_t)(sample_rate * (1ull << HASH_BITS))), _tree(MIN_CAPACITY + 1, 0)
+	{
+		_assert(sample_rate > 0.0f && sample_rate <= 1.0f);
+	}
+
+	//false if block_addr isn't sampled, otherwise distance is the scaled stack distance or COLD on the first access
+	bool access(paddr_t block_addr, uint64_t& distance);
+
+	template<typename CP>
+	void checkpoint(CP& checkpoint)
+	{
+		std::vector<std::pair<paddr_t, uint64_t>> live;
+		if(!checkpoint.restoring()) live = _live_blocks();
+		checkpoint.io(live);
+		if(checkpoint.restoring()) _rebuild(live);
+	}
+
+private:
+	constexpr static uint MIN_CAPACITY = 1 << 16;
+
+	float _sample_rate;
+	uint64_t _threshold;
+	std::unordered_map<paddr_t, uint64_t> _last_access;
+	std::vector<uint32_t> _tree; //1 indexed Fenwick tree
+	uint64_t _time{0};
+
+	bool _sampled(paddr_t block_addr) const
+	{
+		return ((block_addr * 0x9e3779b97f4a7c15ull) >> (64 - HASH_BITS)) < _threshold;
+	}
+
+	uint64_t _capacity() const { return _tree.size() - 1; }
+
+	void _update(uint64_t time, int32_t delta)
+	{
+		for(uint64_t i = time + 1; i < _tree.size(); i += i & (~i + 1))
+			_tree[i] += delta;
+	}
+
+	//marks at times [0, time)
+	uint64_t _prefix(uint64_t time) const
+	{
+		uint64_t sum = 0;
+		for(uint64_t i = time; i > 0; i -= i & (~i + 1))
+			sum += _tree[i];
+		return sum;
+	}
+
+	std::vector<std::pair<paddr_t, uint64_t>> _live_blocks() const;
+	void _rebuild(std::vector<std::pair<paddr_t, uint64_t>>& live);
+};
+
+}}
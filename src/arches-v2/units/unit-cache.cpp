@@ -3,11 +3,12 @@
 namespace Arches {namespace Units {
 
 UnitCache::UnitCache(Configuration config) :
-	UnitCacheBase(config.size, config.block_size, config.associativity, config.sector_size, config.policy),
-	_request_network(config.num_ports, config.num_slices * config.num_banks, config.block_size, config.crossbar_width),
+	UnitCacheBase(config.size, config.block_size, config.associativity, config.sector_size, config.policy, config.compressed),
+	_request_network(config.num_ports, config.num_slices * config.num_banks, config.block_size, config.crossbar_width, config.bank_hash),
 	_return_network(config.num_slices * config.num_banks, config.num_ports, config.crossbar_width),
 	_mem_highers(config.mem_highers),
-	_level(config.level), _block_prefetch(config.block_prefetch), _num_mshr(config.num_mshr), _num_subentries(config.num_subentries), _miss_alloc(config.miss_alloc)
+	_level(config.level), _partition(config.partition), _block_prefetch(config.block_prefetch), _miss_alloc(config.miss_alloc), _prefetch_queue_size(config.prefetch_queue_size),
+	_bank_hash(config.num_slices * config.num_banks, config.block_size, config.bank_hash)
 {
 	_slices.reserve(config.num_slices);
 	for(uint i = 0; i < config.num_slices; ++i)
@@ -15,10 +16,21 @@ UnitCache::UnitCache(Configuration config) :
 		_slices.push_back(config);
 		config.mem_higher_port += config.mem_higher_port_stride;
 	}
+
+	_request_network.set_owner(this);
+
+	if(config.bvh_prefetch_degree)
+		_bvh_prefetcher = _new BVHPrefetcher(config.bvh_prefetch_degree, config.node_base_addr, config.tri_base_addr, config.tri_size);
+
+	if(config.stream_prefetch_degree)
+		_stream_prefetcher = _new StreamPrefetcher(config.num_streams, config.stream_prefetch_degree, config.stream_prefetch_distance, config.block_size);
+
+	if(config.reuse_sample_rate > 0.0f)
+		_reuse_profiler = _new ReuseProfiler(config.reuse_sample_rate);
 }
 
 UnitCache::Slice::Slice(Configuration config) :
-	miss_network(config.num_banks, 1, 4, 1)
+	miss_network(config.num_banks, 1, 4, 1), mshrs(config.num_mshr, config.num_subentries)
 {
 	mem_higher_port = config.mem_higher_port;
 
@@ -32,7 +44,9 @@ UnitCache::Bank::Bank(Configuration config) :
 
 UnitCache::~UnitCache()
 {
-
+	delete _bvh_prefetcher;
+	delete _stream_prefetcher;
+	delete _reuse_profiler;
 }
 
 void UnitCache::_recive_return()
@@ -49,26 +63,62 @@ void UnitCache::_recive_return()
 				if(cached)
 				{
 					paddr_t sector_addr = _get_sector_addr(ret.paddr);
-					MSHR& mshr = slice.mshrs[sector_addr];
+					uint mshr = slice.mshrs.find(sector_addr);
 					uint b = _get_bank(ret.paddr);
 					Bank& bank = slice.banks[b];
 
-					if(!_miss_alloc) _allocate_block(sector_addr);
-					_write_sector(sector_addr, ret.data, false);
+					//a sector that is already valid was filled on an earlier cycle or fully written since the miss so it is
+					//newer than the fill data
+					uint8_t* sector_data = _get_sector(sector_addr);
+					if(!sector_data)
+					{
+						if(!_miss_alloc) _write_back(slice, _allocate_block(sector_addr, ret.flags));
+						sector_data = _write_sector(sector_addr, ret.data, false);
+						if(!sector_data) //evicted since the miss allocated it
+						{
+							_write_back(slice, _allocate_block(sector_addr, ret.flags));
+							sector_data = _write_sector(sector_addr, ret.data, false);
+						}
+
+						if(_compressed)
+						{
+							_write_back_compacted(slice);
+							_log_compression(sector_addr);
+						}
+
+						//an MSHR with no subentries was only ever requested by a prefetch
+						if(mshr != ~0u && slice.mshrs.num_subentries(mshr) == 0) _set_prefetched(sector_addr);
+						else if(mshr != ~0u && _prefetching()) _run_prefetchers(slice.mshrs.front(mshr), false);
+					}
 
-					//fill a subentry and queue for return
-					if(bank.return_pipline.is_write_valid() && !mshr.subentries.empty())
+					//replay subentries in order. Stores merge into the line, loads and AMOs fill one return per cycle
+					while(mshr != ~0u && slice.mshrs.num_subentries(mshr) > 0)
 					{
-						MemoryRequest& sube_req = mshr.subentries.front();
-						uint sector_offset = _get_sector_offset(sube_req.paddr);
-						bank.return_pipline.write(MemoryReturn(sube_req, ret.data + sector_offset));
-						mshr.subentries.pop();
+						MemoryRequest& sube_req = slice.mshrs.front(mshr);
+						bool needs_return = sube_req.type != MemoryRequest::Type::STORE;
+						if(needs_return)
+						{
+							if(!bank.return_pipline.is_write_valid()) break;
+							uint sector_offset = _get_sector_offset(sube_req.paddr);
+							bank.return_pipline.write(MemoryReturn(sube_req, sector_data + sector_offset));
+						}
+
+						if(sube_req.type != MemoryRequest::Type::LOAD)
+						{
+							_apply_store(sector_data, sube_req);
+							_write_back_compacted(slice);
+							log.data_array_writes++;
+							log.bytes_written += sube_req.size;
+						}
+
+						slice.mshrs.pop(mshr);
+						if(needs_return) break;
 					}
 
-					if(mshr.subentries.empty())
+					if(mshr == ~0u || slice.mshrs.num_subentries(mshr) == 0)
 					{
 						mem_higher->read_return(slice.mem_higher_port);
-						slice.mshrs.erase(sector_addr); //free mshr
+						if(mshr != ~0u) slice.mshrs.free(mshr);
 					}
 				}
 				else
@@ -81,6 +131,7 @@ void UnitCache::_recive_return()
 						ret.port = ret.dst.pop(8);
 						bank.return_pipline.write(ret);
 						mem_higher->read_return(slice.mem_higher_port);
+						_num_uncached_returns--;
 					}
 				}
 			}
@@ -90,6 +141,11 @@ void UnitCache::_recive_return()
 
 void UnitCache::_recive_request()
 {
+	//the MSHR files can't change while we aren't clocked so skipped and sleeping cycles count at the current occupancy
+	cycles_t cycle = simulator->domain_cycle(clock_domain);
+	cycles_t sample_cycles = cycle + 1 - _mshr_sample_cycle;
+	_mshr_sample_cycle = cycle + 1;
+
 	for(uint s = 0; s < _slices.size(); ++s)
 	{
 		Slice& slice = _slices[s];
@@ -109,6 +165,29 @@ void UnitCache::_recive_request()
 			uint8_t sector_index = _get_sector_index(request.paddr);
 
 			bool cached = !(request.flags.omit_cache & (0x1 << _level));
+			bool hit = false;
+			bool compression_hit = false;
+			if(cached && _compressed)
+			{
+				//the bank holds the request while its sector is decompressed
+				if(bank.decompress_cycles < _decompression_latency(sector_addr))
+				{
+					bank.decompress_cycles++;
+					log.decompression_stalls++;
+					continue;
+				}
+
+				if(bank.decompress_cycles) log.decompressions++;
+				compression_hit = _compression_hit(sector_addr);
+			}
+
+			if(cached && _reuse_profiler)
+			{
+				uint64_t distance;
+				if(_reuse_profiler->access(_get_block_addr(request.paddr), distance))
+					log.sample_reuse(distance);
+			}
+
 			if(!cached)
 			{
 				//Forward request
@@ -116,11 +195,12 @@ void UnitCache::_recive_request()
 				request.port = slice.mem_higher_port;
 				slice.mem_higher_request_queue.push(request);
 				log.uncached_requests++;
+				if(request.type != MemoryRequest::Type::STORE) _num_uncached_returns++;
 			}
 			else if(request.type == MemoryRequest::Type::LOAD)
 			{
 				//check data array
-				uint8_t* sector_data = _read_sector(sector_addr);
+				uint8_t* sector_data = _read_sector(sector_addr, request.flags);
 				log.tag_array_access++;
 
 				if(sector_data)
@@ -129,21 +209,79 @@ void UnitCache::_recive_request()
 					bank.return_queue.write(MemoryReturn(request, sector_data + sector_offset));
 					log.data_array_reads++;
 					log.hits++;
+					hit = true;
+					if(_prefetching()) _run_prefetchers(request, false);
 				}
 				else
 				{
 					//Miss: allocate a block and insert into miss queue
-					if(_miss_alloc) _allocate_block(sector_addr);
+					if(_miss_alloc) _write_back(slice, _allocate_block(sector_addr, request.flags));
+					slice.miss_network.write(request, b);
+				}
+			}
+			else if(request.type == MemoryRequest::Type::STORE || _is_amo(request.type))
+			{
+				//write back, write allocate. Misses merge into the sector's MSHR so partial writes to a sector combine
+				//into one fill and one eventual write back
+				uint8_t* sector_data = _read_sector(sector_addr, request.flags);
+				log.tag_array_access++;
+				if(request.type == MemoryRequest::Type::STORE) log.stores++;
+				else                                           log.amos++;
+
+				if(sector_data)
+				{
+					//Hit: AMOs return the old value
+					if(request.type != MemoryRequest::Type::STORE)
+					{
+						bank.return_queue.write(MemoryReturn(request, sector_data + sector_offset));
+						log.data_array_reads++;
+					}
+
+					_apply_store(sector_data, request);
+					_write_back_compacted(slice);
+					log.data_array_writes++;
+					log.bytes_written += request.size;
+					log.hits++;
+					hit = true;
+					if(_prefetching()) _run_prefetchers(request, false);
+				}
+				else if(request.type == MemoryRequest::Type::STORE && request.size == _sector_size && slice.mshrs.find(sector_addr) == ~0u)
+				{
+					//Full sector write: nothing to fetch
+					_write_back(slice, _allocate_block(sector_addr, request.flags));
+					_write_sector(sector_addr, request.data, true);
+					_write_back_compacted(slice);
+					log.data_array_writes++;
+					log.bytes_written += request.size;
+					log.misses++;
+				}
+				else
+				{
+					//Miss: fetch the sector and apply the write when it arrives
+					if(_miss_alloc) _write_back(slice, _allocate_block(sector_addr, request.flags));
 					slice.miss_network.write(request, b);
 				}
 			}
 			else _assert(false);
 
+			if(cached)
+			{
+				uint region = RegionMap::get_instance().find(request.paddr, _partition);
+				log.regions.log(region, request.size, hit);
+				if(hit && compression_hit)
+				{
+					log.compression_hits++;
+					log.region_compression_hits[region]++;
+				}
+			}
+
 			//pop the request
 			bank.request_pipline.read();
+			bank.decompress_cycles = 0;
 		}
 
 		//Proccess misses
+		log.sample_mshrs(slice.mshrs.size(), slice.mshrs.capacity(), sample_cycles);
 		slice.miss_network.clock();
 		if(!slice.miss_network.is_read_valid(0)) continue;
 		const MemoryRequest& miss = slice.miss_network.peek(0);
@@ -151,19 +289,29 @@ void UnitCache::_recive_request()
 		//Try to fetch an mshr for the line or allocate a new mshr for the line
 		bool request_sector = false;
 		paddr_t sector_addr = _get_sector_addr(miss.paddr);
-		if(slice.mshrs.find(sector_addr) == slice.mshrs.end())
+		uint mshr = slice.mshrs.find(sector_addr);
+		if(mshr == ~0u)
 		{
 			//Didn't find mshr. Try to allocate one
-			if(slice.mshrs.size() < _num_mshr) 
-				MSHR& mshr = slice.mshrs[sector_addr]; //Allocated a new MSHR
-			else continue; //Out of MSHRs
+			mshr = slice.mshrs.allocate(sector_addr);
+			if(mshr == ~0u)
+			{
+				log.mshr_full_stalls++;
+				continue; //Out of MSHRs
+			}
 			request_sector = true;
 		}
 
-		MSHR& mshr = slice.mshrs[sector_addr];
-		if(mshr.subentries.size() < _num_subentries)
+		if(!slice.mshrs.subentries_full(mshr))
 		{
-			mshr.subentries.push(miss);
+			uint8_t hint = miss.flags.hint;
+			if(request_sector)
+			{
+				if(_prefetching()) _run_prefetchers(miss, true);
+			}
+			else if(slice.mshrs.num_subentries(mshr) == 0) log.late_prefetches++;
+
+			slice.mshrs.push(mshr, miss);
 			slice.miss_network.read(0);
 			if(request_sector)
 			{
@@ -172,11 +320,13 @@ void UnitCache::_recive_request()
 				mshr_fill_req.paddr = sector_addr;
 				mshr_fill_req.size = _sector_size;
 				mshr_fill_req.port = slice.mem_higher_port;
+				mshr_fill_req.flags.hint = hint;
 				slice.mem_higher_request_queue.push(mshr_fill_req);
 				log.misses++;
 			}
 			else log.half_misses++;
 		}
+		else log.subentry_stalls++;
 
 		if(_block_prefetch)
 		{
@@ -184,15 +334,16 @@ void UnitCache::_recive_request()
 			for(uint i = 0; i < _block_size; i += _sector_size)
 			{
 				sector_addr = block_address + i;
-				if(slice.mshrs.find(sector_addr) == slice.mshrs.end())
+				//prefetches only use free MSHRs
+				if(slice.mshrs.find(sector_addr) == ~0u && slice.mshrs.allocate(sector_addr) != ~0u)
 				{
-					slice.mshrs.insert({sector_addr, MSHR()});
 					MemoryRequest mshr_fill_req;
 					mshr_fill_req.type = MemoryRequest::Type::LOAD;
 					mshr_fill_req.paddr = sector_addr;
 					mshr_fill_req.size = _sector_size;
 					mshr_fill_req.port = slice.mem_higher_port;
 					slice.mem_higher_request_queue.push(mshr_fill_req);
+					log.prefetches++;
 				}
 			}
 		}
@@ -217,6 +368,91 @@ void UnitCache::_send_request()
 	}
 }
 
+//issues one queued prefetch per slice per cycle. Prefetches leave a quarter of the MSHRs for demand misses and are
+//dropped if the sector is already cached or being fetched
+void UnitCache::_issue_prefetches()
+{
+	for(Slice& slice : _slices)
+	{
+		if(slice.prefetch_queue.empty()) continue;
+		if(slice.mshrs.size() + slice.mshrs.capacity() / 4 >= slice.mshrs.capacity()) continue;
+
+		paddr_t sector_addr = slice.prefetch_queue.front();
+		slice.prefetch_queue.pop();
+		log.tag_array_access++;
+		if(_get_sector(sector_addr) || slice.mshrs.find(sector_addr) != ~0u) continue;
+
+		slice.mshrs.allocate(sector_addr);
+
+		MemoryRequest mshr_fill_req;
+		mshr_fill_req.type = MemoryRequest::Type::LOAD;
+		mshr_fill_req.paddr = sector_addr;
+		mshr_fill_req.size = _sector_size;
+		mshr_fill_req.port = slice.mem_higher_port;
+		slice.mem_higher_request_queue.push(mshr_fill_req);
+		log.prefetches++;
+	}
+}
+
+//Runs the prefetchers on a demand access. Streams train on misses and on the first use of a prefetched sector so a stream
+//the prefetcher covers keeps running ahead. Nodes are decoded on any access that finds them fully resident.
+void UnitCache::_run_prefetchers(const MemoryRequest& request, bool miss)
+{
+	paddr_t sector_addr = _get_sector_addr(request.paddr);
+	bool prefetch_hit = !miss && _take_prefetched(sector_addr);
+	if(prefetch_hit) log.prefetch_hits++;
+
+	if(_stream_prefetcher && (miss || prefetch_hit) && (MemoryRequest::Hint)request.flags.hint == MemoryRequest::Hint::STREAMING)
+	{
+		paddr_t blocks[StreamPrefetcher::MAX_DEGREE];
+		uint num_blocks = _stream_prefetcher->train(_get_block_addr(sector_addr), blocks);
+		for(uint i = 0; i < num_blocks; ++i)
+			_queue_prefetch(blocks[i], _block_size);
+	}
+
+	if(_bvh_prefetcher && !miss && _bvh_prefetcher->is_node(request.paddr, request.flags))
+		_prefetch_children(_bvh_prefetcher->get_node_addr(request.paddr));
+}
+
+void UnitCache::_prefetch_children(paddr_t node_addr)
+{
+	//gather the node from the data array, it might only be partly filled
+	alignas(BVHPrefetcher::Node) uint8_t node_data[sizeof(BVHPrefetcher::Node)];
+	for(uint i = 0; i < sizeof(node_data);)
+	{
+		paddr_t addr = node_addr + i;
+		uint8_t* sector_data = _get_sector(_get_sector_addr(addr));
+		if(!sector_data) return;
+
+		uint size = std::min<uint>(_sector_size - _get_sector_offset(addr), sizeof(node_data) - i);
+		std::memcpy(node_data + i, sector_data + _get_sector_offset(addr), size);
+		i += size;
+	}
+
+	if(_bvh_prefetcher->filter(node_addr)) return;
+
+	BVHPrefetcher::Region regions[BVHPrefetcher::WIDTH];
+	uint num_regions = _bvh_prefetcher->decode(*(const BVHPrefetcher::Node*)node_data, regions);
+	for(uint i = 0; i < num_regions; ++i)
+		_queue_prefetch(regions[i].addr, regions[i].size);
+}
+
+//splits a region into sectors and queues them at the slices that own them
+void UnitCache::_queue_prefetch(paddr_t addr, uint size)
+{
+	for(paddr_t sector_addr = _get_sector_addr(addr); sector_addr < addr + size; sector_addr += _sector_size)
+	{
+		Slice& slice = _slices[_get_slice(sector_addr)];
+		if(slice.prefetch_queue.size() >= _prefetch_queue_size)
+		{
+			log.prefetch_drops++;
+			continue;
+		}
+
+		slice.prefetch_queue.push(sector_addr);
+	}
+}
+
 void UnitCache::clock_rise()
 {
 	_request_network.clock();
@@ -237,6 +473,7 @@ void UnitCache::clock_rise()
 
 	_recive_return();
 	_recive_request();
+	_issue_prefetches();
 }
 
 void UnitCache::clock_fall()
@@ -264,6 +501,71 @@ void UnitCache::clock_fall()
 	}
 
 	_return_network.clock();
+
+	if(_idle()) sleep();
+}
+
+//True when nothing is in flight anywhere in the cache so only a new request can change our state
+bool UnitCache::_idle()
+{
+	if(!_request_network.empty() || !_return_network.empty() || _num_uncached_returns) return false;
+
+	for(Slice& slice : _slices)
+	{
+		if(!slice.mshrs.empty() || !slice.mem_higher_request_queue.empty() || !slice.miss_network.empty() || !slice.prefetch_queue.empty()) return false;
+		for(Bank& bank : slice.banks)
+			if(!bank.request_pipline.empty() || !bank.return_pipline.empty() || bank.return_queue.is_read_valid()) return false;
+	}
+
+	return true;
+}
+
+//Outstanding misses and uncached requests are waiting on the next level which reports the return as its own event
+cycles_t UnitCache::next_event_cycle()
+{
+	cycles_t current_cycle = simulator->current_cycle;
+	if(!_request_network.empty() || !_return_network.empty()) return current_cycle + 1;
+
+	cycles_t next_event = Simulator::NO_EVENT;
+	for(Slice& slice : _slices)
+	{
+		if(!slice.mem_higher_request_queue.empty() || !slice.miss_network.empty() || !slice.prefetch_queue.empty()) return current_cycle + 1;
+		for(Bank& bank : slice.banks)
+		{
+			if(bank.return_queue.is_read_valid()) return current_cycle + 1;
+			if(!bank.request_pipline.empty()) next_event = std::min(next_event, current_cycle + std::max<cycles_t>(bank.request_pipline.cycles_until_read_valid(), 1));
+			if(!bank.return_pipline.empty()) next_event = std::min(next_event, current_cycle + std::max<cycles_t>(bank.return_pipline.cycles_until_read_valid(), 1));
+		}
+	}
+
+	return next_event;
+}
+
+void UnitCache::skip_cycles(cycles_t cycles)
+{
+	for(Slice& slice : _slices)
+	{
+		for(Bank& bank : slice.banks)
+		{
+			bank.request_pipline.skip(cycles);
+			bank.return_pipline.skip(cycles);
+		}
+	}
+}
+
+bool UnitCache::checkpoint(Checkpoint& checkpoint)
+{
+	_checkpoint_arrays(checkpoint);
+	checkpoint.io(_request_network);
+	checkpoint.io(_slices);
+	checkpoint.io(_return_network);
+	checkpoint.io(_num_uncached_returns);
+	checkpoint.io(_mshr_sample_cycle);
+	if(_bvh_prefetcher) _bvh_prefetcher->checkpoint(checkpoint);
+	if(_stream_prefetcher) _stream_prefetcher->checkpoint(checkpoint);
+	if(_reuse_profiler) _reuse_profiler->checkpoint(checkpoint);
+	checkpoint.io(log);
+	return true;
 }
 
 bool UnitCache::request_port_write_valid(uint port_index)
@@ -291,4 +593,172 @@ const MemoryReturn UnitCache::read_return(uint port_index)
 	return _return_network.read(port_index);
 }
 
-}}
\ No newline at end of file
+bool UnitCache::functional_access(const MemoryRequest& request, MemoryReturn& ret)
+{
+	bool cached = !(request.flags.omit_cache & (0x1 << _level));
+	bool write = request.type == MemoryRequest::Type::STORE || _is_amo(request.type);
+	if(!cached || (request.type != MemoryRequest::Type::LOAD && !write))
+		return _get_mem_higher(request.paddr)->functional_access(request, ret);
+
+	//same tag and replacement updates as a detailed access so the cache is warm when timing resumes, but nothing is logged
+	paddr_t sector_addr = _get_sector_addr(request.paddr);
+	uint8_t* sector_data = _read_sector(sector_addr, request.flags);
+	if(!sector_data && request.type == MemoryRequest::Type::STORE && request.size == _sector_size)
+	{
+		_functional_write_back(_allocate_block(sector_addr, request.flags));
+		_write_sector(sector_addr, request.data, true);
+		_functional_write_back_compacted();
+		ret = MemoryReturn(request);
+		return true;
+	}
+
+	if(!sector_data)
+	{
+		MemoryRequest fill_req;
+		fill_req.type = MemoryRequest::Type::LOAD;
+		fill_req.paddr = sector_addr;
+		fill_req.size = _sector_size;
+		fill_req.flags.hint = request.flags.hint;
+
+		MemoryReturn fill_ret;
+		if(!_get_mem_higher(sector_addr)->functional_access(fill_req, fill_ret)) return false;
+
+		_functional_write_back(_allocate_block(sector_addr, request.flags));
+		sector_data = _write_sector(sector_addr, fill_ret.data, false);
+		_functional_write_back_compacted();
+	}
+
+	if(request.type == MemoryRequest::Type::STORE) ret = MemoryReturn(request);
+	else                                           ret = MemoryReturn(request, sector_data + _get_sector_offset(request.paddr));
+
+	if(write)
+	{
+		_apply_store(sector_data, request);
+		_functional_write_back_compacted();
+	}
+	return true;
+}
+
+void UnitCache::functional_flush()
+{
+	for(uint i = 0; i < _tags.size(); ++i)
+	{
+		if(!(_valid[i] & _dirty[i])) continue;
+
+		Victim victim;
+		victim.addr = _get_block_addr(_tags[i], i / _associativity);
+		victim.data = _data_array.data() + i * _block_size;
+		victim.dirty = _dirty[i];
+		victim.valid = _valid[i];
+		_functional_write_back(victim);
+		_dirty[i] = 0;
+	}
+}
+
+//queues a store for every dirty sector of an evicted block. The data is copied out now since the block is about to be
+//refilled
+void UnitCache::_write_back(Slice& slice, const Victim& victim)
+{
+	uint8_t sectors = victim.valid & victim.dirty;
+	for(uint i = 0; sectors; ++i, sectors >>= 1)
+	{
+		if(!(sectors & 0x1)) continue;
+
+		MemoryRequest write_back_req;
+		write_back_req.type = MemoryRequest::Type::STORE;
+		write_back_req.paddr = victim.addr + i * _sector_size;
+		write_back_req.size = _sector_size;
+		write_back_req.port = slice.mem_higher_port;
+		std::memcpy(write_back_req.data, victim.data + i * _sector_size, _sector_size);
+		slice.mem_higher_request_queue.push(write_back_req);
+
+		log.write_backs++;
+		log.bytes_written_back += _sector_size;
+	}
+
+	log.useless_prefetches += popcnt((uint64_t)(victim.valid & victim.prefetched));
+}
+
+void UnitCache::_functional_write_back(const Victim& victim)
+{
+	uint8_t sectors = victim.valid & victim.dirty;
+	for(uint i = 0; sectors; ++i, sectors >>= 1)
+	{
+		if(!(sectors & 0x1)) continue;
+
+		MemoryRequest write_back_req;
+		write_back_req.type = MemoryRequest::Type::STORE;
+		write_back_req.paddr = victim.addr + i * _sector_size;
+		write_back_req.size = _sector_size;
+		std::memcpy(write_back_req.data, victim.data + i * _sector_size, _sector_size);
+
+		MemoryReturn write_back_ret;
+		_get_mem_higher(write_back_req.paddr)->functional_access(write_back_req, write_back_ret);
+	}
+}
+
+//writes back blocks squeezed out of a compressed set. Their ways are free so this has to happen before the next allocation
+void UnitCache::_write_back_compacted(Slice& slice)
+{
+	for(const Victim& victim : _compaction_victims)
+		_write_back(slice, victim);
+
+	log.compaction_evictions += _compaction_victims.size();
+	_compaction_victims.clear();
+}
+
+void UnitCache::_functional_write_back_compacted()
+{
+	for(const Victim& victim : _compaction_victims)
+		_functional_write_back(victim);
+
+	_compaction_victims.clear();
+}
+
+void UnitCache::_log_compression(paddr_t sector_addr)
+{
+	uint size = _compressed_size(sector_addr);
+	if(!size) return;
+
+	uint region = RegionMap::get_instance().find(sector_addr, _partition);
+	log.bytes_compressed += _sector_size;
+	log.compressed_bytes += size;
+	log.region_bytes_compressed[region] += _sector_size;
+	log.region_compressed_bytes[region] += size;
+}
+
+template<typename S, typename U>
+static void apply_amo(MemoryRequest::Type type, uint8_t* data, const uint8_t* operand_data)
+{
+	S value, operand;
+	std::memcpy(&value, data, sizeof(S));
+	std::memcpy(&operand, operand_data, sizeof(S));
+
+	switch(type)
+	{
+	case MemoryRequest::Type::AMO_ADD:  value = (S)((U)value + (U)operand); break;
+	case MemoryRequest::Type::AMO_XOR:  value ^= operand; break;
+	case MemoryRequest::Type::AMO_OR:   value |= operand; break;
+	case MemoryRequest::Type::AMO_AND:  value &= operand; break;
+	case MemoryRequest::Type::AMO_MIN:  value = std::min(value, operand); break;
+	case MemoryRequest::Type::AMO_MAX:  value = std::max(value, operand); break;
+	case MemoryRequest::Type::AMO_MINU: value = (S)std::min((U)value, (U)operand); break;
+	case MemoryRequest::Type::AMO_MAXU: value = (S)std::max((U)value, (U)operand); break;
+	default: _assert(false);
+	}
+
+	std::memcpy(data, &value, sizeof(S));
+}
+
+//writes a store or applies an AMO to a valid sector and marks it dirty
+void UnitCache::_apply_store(uint8_t* sector_data, const MemoryRequest& request)
+{
+	uint8_t* data = sector_data + _get_sector_offset(request.paddr);
+	if(request.type == MemoryRequest::Type::STORE) std::memcpy(data, request.data, request.size);
+	else if(request.size == 8)                     apply_amo<int64_t, uint64_t>(request.type, data, request.data);
+	else                                           apply_amo<int32_t, uint32_t>(request.type, data, request.data);
+
+	_set_dirty(_get_sector_addr(request.paddr));
+}
+
+}}
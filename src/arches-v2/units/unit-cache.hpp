@@ -2,7 +2,11 @@
 #include "stdafx.hpp"
 
 #include "util/arbitration.hpp"
+#include "util/memory-map.hpp"
 #include "unit-cache-base.hpp"
+#include "unit-cache-mshr.hpp"
+#include "unit-cache-prefetcher.hpp"
+#include "unit-cache-reuse-profiler.hpp"
 #include "units/dual-streaming/unit-scene-buffer.hpp"
 
 namespace Arches {
@@ -35,6 +39,25 @@ public:
 
 		uint64_t slice_select_mask;
 		uint64_t bank_select_mask;
+		AddressHash::Configuration bank_hash; //interleaving of blocks across the slices and banks
+
+		//prefetchers are off when their degree is 0
+		uint bvh_prefetch_degree{0};
+		paddr_t node_base_addr{0x0};
+		paddr_t tri_base_addr{0x0};
+		uint tri_size{0};
+
+		uint stream_prefetch_degree{0};
+		uint stream_prefetch_distance{1};
+		uint num_streams{16};
+
+		uint prefetch_queue_size{32};
+
+		float reuse_sample_rate{0.0f}; //fraction of blocks the reuse distance profiler tracks, 0 disables it
+
+		bool compressed{false}; //BDI/FPC compressed data array with twice the tags
+
+		uint partition{~0u}; //partition whose address bits were stripped before this cache, ~0u for global addresses
 
 		std::vector<UnitMemoryBase*> mem_highers{nullptr};
 		uint                         mem_higher_port{0};
@@ -55,6 +78,9 @@ public:
 
 	void clock_rise() override;
 	void clock_fall() override;
+	cycles_t next_event_cycle() override;
+	void skip_cycles(cycles_t cycles) override;
+	bool checkpoint(Checkpoint& checkpoint) override;
 
 	bool request_port_write_valid(uint port_index) override;
 	void write_request(const MemoryRequest& request) override;
@@ -63,6 +89,11 @@ public:
 	const MemoryReturn& peek_return(uint port_index) override;
 	const MemoryReturn read_return(uint port_index) override;
 
+	bool functional_access(const MemoryRequest& request, MemoryReturn& ret) override;
+
+	//writes every dirty sector back to the next level with functional accesses so memory holds the final data
+	void functional_flush();
+
 protected:
 	struct Bank
 	{
@@ -70,13 +101,16 @@ protected:
 		FIFO<MemoryReturn> return_queue;
 		LatencyFIFO<MemoryRequest> request_pipline;
 		LatencyFIFO<MemoryReturn> return_pipline;
+		uint decompress_cycles{0}; //cycles the request at the head of the pipeline has spent decompressing
 		Bank(Configuration config);
-	};
 
-	struct MSHR //Miss Status Handling Register
-	{
-		std::queue<MemoryRequest> subentries;
-		MSHR() = default;
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(return_queue);
+			checkpoint.io(request_pipline);
+			checkpoint.io(return_pipline);
+			checkpoint.io(decompress_cycles);
+		}
 	};
 
 	struct Slice
@@ -85,12 +119,22 @@ protected:
 
 		//miss path (per partition)
 		Cascade<MemoryRequest> miss_network;
-		std::map<paddr_t, MSHR> mshrs;
+		MSHRFile mshrs;
 
 		std::queue<MemoryRequest> mem_higher_request_queue;
+		std::queue<paddr_t> prefetch_queue;
 		uint mem_higher_port;
 
 		Slice(Configuration config);
+
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(banks);
+			checkpoint.io(miss_network);
+			checkpoint.io(mshrs);
+			checkpoint.io(mem_higher_request_queue);
+			checkpoint.io(prefetch_queue);
+		}
 	};
 
 	std::vector<UnitMemoryBase*> _mem_highers;
@@ -100,19 +144,50 @@ protected:
 	ReturnCrossBar _return_network;
 
 	uint _level;
-	uint _num_mshr;
-	uint _num_subentries;
+	uint _partition;
+	uint _num_uncached_returns{0};
+	cycles_t _mshr_sample_cycle{0}; //first cycle not yet counted in the MSHR occupancy histogram
 	bool _block_prefetch;
 	bool _miss_alloc;
 
+	BVHPrefetcher* _bvh_prefetcher{nullptr};
+	StreamPrefetcher* _stream_prefetcher{nullptr};
+	uint _prefetch_queue_size;
+
+	ReuseProfiler* _reuse_profiler{nullptr};
+
+	AddressHash _bank_hash; //same interleaving as the request crossbar
+
 	uint _get_bank(paddr_t addr)
 	{
-		return (addr / _block_size) % _slices[0].banks.size();
+		return _bank_hash.index(addr) % _slices[0].banks.size();
+	}
+
+	uint _get_slice(paddr_t addr)
+	{
+		return _bank_hash.index(addr) / _slices[0].banks.size();
 	}
 
+	bool _prefetching() { return _block_prefetch || _bvh_prefetcher || _stream_prefetcher; }
+
 	void _recive_return();
 	void _recive_request();
 	void _send_request();
+	void _issue_prefetches();
+	bool _idle();
+
+	void _run_prefetchers(const MemoryRequest& request, bool miss);
+	void _prefetch_children(paddr_t node_addr);
+	void _queue_prefetch(paddr_t addr, uint size);
+
+	void _write_back(Slice& slice, const Victim& victim);
+	void _functional_write_back(const Victim& victim);
+	void _write_back_compacted(Slice& slice);
+	void _functional_write_back_compacted();
+	void _log_compression(paddr_t sector_addr);
+	void _apply_store(uint8_t* sector_data, const MemoryRequest& request);
+
+	static bool _is_amo(MemoryRequest::Type type) { return type >= MemoryRequest::Type::AMO_ADD && type <= MemoryRequest::Type::AMO_MAXU; }
 
 	virtual UnitMemoryBase* _get_mem_higher(paddr_t addr) { return _mem_highers[0]; }
 
@@ -120,7 +195,10 @@ public:
 	class Log
 	{
 	public:
-		const static uint NUM_COUNTERS = 10;
+		const static uint NUM_COUNTERS = 27;
+		const static uint MSHR_BUCKETS = 9;
+		const static uint REUSE_EXACT = 16; //stack distances below this get their own bucket
+		const static uint REUSE_BUCKETS = REUSE_EXACT + 8 * 28; //then 8 buckets per power of two
 		union
 		{
 			struct
@@ -130,14 +208,39 @@ public:
 				uint64_t half_misses;
 				uint64_t uncached_requests;
 				uint64_t mshr_stalls;
+				uint64_t mshr_full_stalls;
+				uint64_t subentry_stalls;
 				uint64_t bytes_read;
 				uint64_t tag_array_access;
 				uint64_t data_array_reads;
 				uint64_t data_array_writes;
+				uint64_t stores;
+				uint64_t amos;
+				uint64_t bytes_written;
+				uint64_t write_backs;
+				uint64_t bytes_written_back;
+				uint64_t prefetches;
+				uint64_t prefetch_hits; //first demand use of a prefetched sector
+				uint64_t late_prefetches; //demand miss merged into a prefetch still in flight
+				uint64_t useless_prefetches; //evicted before use
+				uint64_t prefetch_drops; //prefetch queue full
+				uint64_t bytes_compressed; //filled sectors before compression
+				uint64_t compressed_bytes; //and after
+				uint64_t compaction_evictions; //blocks evicted to fit a compressed sector that grew
+				uint64_t decompressions;
+				uint64_t decompression_stalls;
+				uint64_t compression_hits; //hits to blocks an uncompressed cache would have replaced
 			};
 			uint64_t counters[NUM_COUNTERS];
 		};
-		std::map<paddr_t, uint64_t> profile_counters;
+		uint64_t mshr_occupancy[MSHR_BUCKETS]; //slice cycles with no MSHRs in use then each eighth of the MSHR file
+		uint64_t mshr_peak;
+		uint64_t reuse_histogram[REUSE_BUCKETS]; //sampled accesses by block stack distance
+		uint64_t reuse_cold;
+		RegionLog regions; //demand traffic by registered data structure
+		uint64_t region_bytes_compressed[RegionMap::MAX_REGIONS];
+		uint64_t region_compressed_bytes[RegionMap::MAX_REGIONS];
+		uint64_t region_compression_hits[RegionMap::MAX_REGIONS];
 
 	public:
 		Log() { reset(); }
@@ -147,7 +250,19 @@ public:
 			for(uint i = 0; i < NUM_COUNTERS; ++i)
 				counters[i] = 0;
 
-			profile_counters.clear();
+			for(uint i = 0; i < MSHR_BUCKETS; ++i)
+				mshr_occupancy[i] = 0;
+
+			mshr_peak = 0;
+
+			for(uint i = 0; i < REUSE_BUCKETS; ++i)
+				reuse_histogram[i] = 0;
+
+			reuse_cold = 0;
+			regions.reset();
+
+			for(uint i = 0; i < RegionMap::MAX_REGIONS; ++i)
+				region_bytes_compressed[i] = region_compressed_bytes[i] = region_compression_hits[i] = 0;
 		}
 
 		void accumulate(const Log& other)
@@ -155,8 +270,138 @@ public:
 			for(uint i = 0; i < NUM_COUNTERS; ++i)
 				counters[i] += other.counters[i];
 
-			for(auto& a : other.profile_counters)
-				profile_counters[a.first] += a.second;
+			for(uint i = 0; i < MSHR_BUCKETS; ++i)
+				mshr_occupancy[i] += other.mshr_occupancy[i];
+
+			mshr_peak = std::max(mshr_peak, other.mshr_peak);
+
+			for(uint i = 0; i < REUSE_BUCKETS; ++i)
+				reuse_histogram[i] += other.reuse_histogram[i];
+
+			reuse_cold += other.reuse_cold;
+
+			regions.accumulate(other.regions);
+
+			for(uint i = 0; i < RegionMap::MAX_REGIONS; ++i)
+			{
+				region_bytes_compressed[i] += other.region_bytes_compressed[i];
+				region_compressed_bytes[i] += other.region_compressed_bytes[i];
+				region_compression_hits[i] += other.region_compression_hits[i];
+			}
+		}
+
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(counters);
+			checkpoint.io(mshr_occupancy);
+			checkpoint.io(mshr_peak);
+			checkpoint.io(reuse_histogram);
+			checkpoint.io(reuse_cold);
+			regions.checkpoint(checkpoint);
+			checkpoint.io(region_bytes_compressed);
+			checkpoint.io(region_compressed_bytes);
+			checkpoint.io(region_compression_hits);
+		}
+
+		void sample_mshrs(uint used, uint capacity, uint64_t cycles = 1)
+		{
+			uint bucket = used == 0 ? 0 : 1 + (used - 1) * (MSHR_BUCKETS - 1) / capacity;
+			mshr_occupancy[bucket] += cycles;
+			mshr_peak = std::max<uint64_t>(mshr_peak, used);
+		}
+
+		static uint reuse_bucket(uint64_t distance)
+		{
+			if(distance < REUSE_EXACT) return (uint)distance;
+			return std::min<uint>(REUSE_EXACT + (uint)((std::log2((double)distance) - log2i(REUSE_EXACT)) * 8), REUSE_BUCKETS - 1);
+		}
+
+		static double reuse_distance(uint bucket)
+		{
+			if(bucket < REUSE_EXACT) return bucket;
+			return std::exp2(log2i(REUSE_EXACT) + (bucket - REUSE_EXACT + 0.5) / 8);
+		}
+
+		void sample_reuse(uint64_t distance)
+		{
+			if(distance == ReuseProfiler::COLD) reuse_cold++;
+			else                                reuse_histogram[reuse_bucket(distance)]++;
+		}
+
+		//Chance an LRU cache of blocks lines hits an access with the given stack distance. The blocks touched since the last
+		//access are assumed to land in its set independently so the count that do is binomial (Smith 1978). 0 ways is fully
+		//associative
+		static double lru_hit_probability(double distance, uint64_t blocks, uint associativity)
+		{
+			if(associativity == 0 || associativity >= blocks) return distance < blocks ? 1.0 : 0.0;
+
+			double p = (double)associativity / blocks;
+			double term = std::exp(distance * std::log1p(-p));
+			double sum = 0.0;
+			for(uint k = 0; k < associativity && k < distance + 1.0; ++k)
+			{
+				sum += term;
+				term *= (distance - k) / (k + 1) * p / (1.0 - p);
+			}
+
+			return std::min(sum, 1.0);
+		}
+
+		double miss_ratio(uint64_t blocks, uint associativity)
+		{
+			uint64_t samples = reuse_cold;
+			double misses = reuse_cold;
+			for(uint i = 0; i < REUSE_BUCKETS; ++i)
+			{
+				if(!reuse_histogram[i]) continue;
+				samples += reuse_histogram[i];
+				misses += reuse_histogram[i] * (1.0 - lru_hit_probability(reuse_distance(i), blocks, associativity));
+			}
+
+			return samples ? misses / samples : 0.0;
+		}
+
+		void print_miss_ratio_curve(uint block_size)
+		{
+			const static uint ways[] = {1, 2, 4, 8, 16, 32, 0};
+
+			uint64_t samples = reuse_cold;
+			for(uint i = 0; i < REUSE_BUCKETS; ++i)
+				samples += reuse_histogram[i];
+			if(!samples) return;
+
+			printf("\nLRU Miss Ratio Curve (%lld sampled accesses)\n", samples);
+			printf("%10s", "Size");
+			for(uint w : ways)
+				if(w) printf("%8u-way", w);
+				else  printf("%12s", "Full");
+			printf("\n");
+
+			for(uint64_t size = 4 << 10; size <= 256 << 20; size <<= 1)
+			{
+				if(size < 1 << 20) printf("%8lldKB", size >> 10);
+				else               printf("%8lldMB", size >> 20);
+
+				for(uint w : ways)
+					printf("%11.2f%%", 100.0 * miss_ratio(size / block_size, w));
+				printf("\n");
+			}
+		}
+
+		//compression ratio and the hit rate the extra tags added for each data structure
+		void print_compression_regions()
+		{
+			if(RegionMap::get_instance().num_regions() < 2) return;
+
+			printf("\n%-16s%10s%10s%10s\n", "Region", "Ratio", "Hit Rate", "Gain");
+			for(uint i = 0; i < RegionMap::get_instance().num_regions(); ++i)
+			{
+				if(!regions.accesses[i]) continue;
+
+				double ratio = region_compressed_bytes[i] ? (double)region_bytes_compressed[i] / region_compressed_bytes[i] : 0.0;
+				printf("%-16s%10.2f%9.2f%%%9.2f%%\n", RegionMap::get_instance().region_name(i).c_str(), ratio,
+					100.0 * regions.hits[i] / regions.accesses[i], 100.0 * region_compression_hits[i] / regions.accesses[i]);
+			}
 		}
 
 		uint64_t get_total() { return hits + half_misses + misses; }
@@ -172,7 +417,52 @@ public:
 			printf("\n");
 			printf("Uncached Requests: %lld\n", uncached_requests / units);
 			printf("\n");
+			printf("Stores: %lld\n", stores / units);
+			printf("AMOs: %lld\n", amos / units);
+			printf("Bytes Written: %lld\n", bytes_written / units);
+			printf("Write Backs: %lld\n", write_backs / units);
+			printf("Bytes Written Back: %lld\n", bytes_written_back / units);
+			printf("\n");
+			if(prefetches)
+			{
+				uint64_t covered = prefetch_hits + late_prefetches;
+				printf("Prefetches: %lld\n", prefetches / units);
+				printf("Prefetch Hits: %lld\n", prefetch_hits / units);
+				printf("Late Prefetches: %lld\n", late_prefetches / units);
+				printf("Useless Prefetches: %lld\n", useless_prefetches / units);
+				printf("Dropped Prefetches: %lld\n", prefetch_drops / units);
+				printf("Prefetch Accuracy: %.2f%%\n", 100.0 * covered / prefetches);
+				printf("Prefetch Coverage: %.2f%%\n", 100.0 * covered / (covered + misses));
+				printf("Prefetch Lateness: %.2f%%\n", 100.0 * late_prefetches / std::max<uint64_t>(covered, 1));
+				printf("\n");
+			}
+			if(bytes_compressed)
+			{
+				printf("Compression Ratio: %.2f\n", (double)bytes_compressed / compressed_bytes);
+				printf("Compaction Evictions: %lld\n", compaction_evictions / units);
+				printf("Decompressions: %lld\n", decompressions / units);
+				printf("Decompression Stalls: %lld\n", decompression_stalls / units);
+				printf("Compression Hits: %lld (+%.2f%% hit rate)\n", compression_hits / units, 100.0 * compression_hits / total);
+				print_compression_regions();
+				printf("\n");
+			}
 			printf("MSHR Stalls: %lld\n", mshr_stalls / units);
+			printf("MSHR Full Stalls: %lld\n", mshr_full_stalls / units);
+			printf("Subentry Full Stalls: %lld\n", subentry_stalls / units);
+			printf("MSHR Merge Rate: %.2f%%\n", 100.0 * half_misses / std::max<uint64_t>(misses + half_misses, 1));
+			printf("MSHR Peak Occupancy: %lld\n", mshr_peak);
+
+			uint64_t samples = 0;
+			for(uint i = 0; i < MSHR_BUCKETS; ++i)
+				samples += mshr_occupancy[i];
+
+			if(samples)
+			{
+				printf("MSHR Occupancy:\n");
+				printf("  0%%: %.2f%%\n", 100.0 * mshr_occupancy[0] / samples);
+				for(uint i = 1; i < MSHR_BUCKETS; ++i)
+					printf("  <=%.1f%%: %.2f%%\n", 100.0 * i / (MSHR_BUCKETS - 1), 100.0 * mshr_occupancy[i] / samples);
+			}
 			printf("\n");
 			printf("Tag Array Access: %lld\n", tag_array_access / units);
 			printf("Data Array Reads: %lld\n", data_array_reads / units);
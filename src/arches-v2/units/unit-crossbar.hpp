@@ -2,12 +2,16 @@
 #include "stdafx.hpp"
 
 #include "util/bit-manipulation.hpp"
+#include "util/address-hash.hpp"
 #include "unit-base.hpp"
 #include "unit-main-memory-base.hpp"
 
 namespace Arches { namespace Units {
 
-class UnitCrossbar : public UnitMemoryBase, public CrossBar<MemoryRequest>, CrossBar<MemoryReturn>
+//Network between the clients and the slices of the memory partitions. Addresses are interleaved across partitions
+//every partition_stride bytes and across the slices of a partition every slice_stride bytes, by modulo or by one of
+//the AddressHash functions.
+class UnitPartitionInterconnect : public UnitMemoryBase
 {
 public:
 	struct Configuration
@@ -17,64 +21,133 @@ public:
 		uint partition_stride{1};
 		uint num_slices{1};
 		uint slice_stride{1};
+		AddressHash::Configuration partition_hash;
+		AddressHash::Configuration slice_hash;
 		std::vector<UnitMemoryBase*> mem_highers;
 	};
 
-private:
+protected:
+	uint _num_clients{1};
 	uint _num_partitions{1};
 	uint _partition_stride{1};
 	uint _num_slices{1};
 	uint _slice_stride{1};
-
-	std::vector<MemoryRequest> _request_regs;
-	std::vector<MemoryReturn> _return_regs;
+	AddressHash _partition_hash;
+	AddressHash _slice_hash;
 	std::vector<UnitMemoryBase*> _mem_highers;
 
+	std::vector<uint64_t> _slice_requests; //requests delivered to each slice for the imbalance report
+
 public:
-	UnitCrossbar(Configuration config) : UnitMemoryBase(),
-		CrossBar<MemoryRequest>(config.num_clients, config.num_partitions * config.num_slices, 64, 64),
-		CrossBar<MemoryReturn>(config.num_partitions * config.num_slices, config.num_clients, 64, 64),
-		_num_partitions(config.num_partitions), _partition_stride(config.partition_stride), 
+	UnitPartitionInterconnect(const Configuration& config) : UnitMemoryBase(),
+		_num_clients(config.num_clients), _num_partitions(config.num_partitions), _partition_stride(config.partition_stride),
 		_num_slices(config.num_slices), _slice_stride(config.slice_stride),
-		_request_regs(_num_partitions * _num_slices),
-		_return_regs(_num_partitions * _num_slices),
-		_mem_highers(config.mem_highers)
+		_partition_hash(config.num_partitions, config.partition_stride, config.partition_hash), _slice_hash(config.num_slices, config.slice_stride, config.slice_hash),
+		_mem_highers(config.mem_highers), _slice_requests(config.num_partitions * config.num_slices, 0)
 	{
 		_assert(_mem_highers.size() == _num_partitions);
+	}
 
-		for(uint i = 0; i < _request_regs.size(); ++i)
-			_request_regs[i].paddr = ~0x0ull;
-		for(uint i = 0; i < _return_regs.size(); ++i)
-			_return_regs[i].paddr = ~0x0ull;
+	virtual ~UnitPartitionInterconnect() = default;
+
+	const AddressHash& partition_hash() const { return _partition_hash; }
+
+	paddr_t get_partition(paddr_t paddr)
+	{
+		return _partition_hash.index(paddr);
 	}
 
-	uint get_sink(const MemoryRequest& request) override
+	paddr_t strip_partition_bits(paddr_t paddr)
+	{
+		return _partition_hash.strip(paddr);
+	}
+
+	paddr_t inject_partition_bits(paddr_t paddr, uint partition)
+	{
+		return _partition_hash.inject(paddr, partition);
+	}
+
+	//index of the slice across all partitions
+	uint get_slice(paddr_t paddr)
 	{
-		paddr_t paddr = request.paddr;
 		uint partition = get_partition(paddr);
-		paddr = strip_partition_bits(paddr);
-		uint slice = paddr / _slice_stride % _num_slices;
+		uint slice = _slice_hash.index(strip_partition_bits(paddr));
 		return partition * _num_slices + slice;
 	}
 
-	uint get_sink(const MemoryReturn& request) override
+	bool functional_access(const MemoryRequest& request, MemoryReturn& ret) override
 	{
-		return request.port;
+		uint partition = get_partition(request.paddr);
+		MemoryRequest partition_request = request;
+		partition_request.paddr = strip_partition_bits(request.paddr);
+		if(!_mem_highers[partition]->functional_access(partition_request, ret)) return false;
+
+		ret.paddr = request.paddr;
+		return true;
 	}
 
-	paddr_t get_partition(paddr_t paddr)
+	virtual void print_stats(cycles_t cycles) {}
+
+	//Busiest partition and slice against the mean, 1.0 is perfectly even. Camping on a few partitions shows up here
+	//long before it shows up as lost bandwidth.
+	void print_balance()
 	{
-		return paddr / _partition_stride % _num_partitions;
+		uint64_t total = 0, max_partition = 0, max_slice = 0;
+		for(uint partition = 0; partition < _num_partitions; ++partition)
+		{
+			uint64_t partition_requests = 0;
+			for(uint slice = 0; slice < _num_slices; ++slice)
+			{
+				uint64_t slice_requests = _slice_requests[partition * _num_slices + slice];
+				partition_requests += slice_requests;
+				max_slice = std::max(max_slice, slice_requests);
+			}
+			total += partition_requests;
+			max_partition = std::max(max_partition, partition_requests);
+		}
+		if(total == 0) return;
+
+		printf("Partition Imbalance: %.2fx\n", (double)max_partition * _num_partitions / total);
+		printf("Slice Imbalance: %.2fx\n", (double)max_slice * _num_partitions * _num_slices / total);
+		printf("Partition Requests:");
+		for(uint partition = 0; partition < _num_partitions; ++partition)
+		{
+			uint64_t partition_requests = 0;
+			for(uint slice = 0; slice < _num_slices; ++slice)
+				partition_requests += _slice_requests[partition * _num_slices + slice];
+			printf(" %.1f%%", 100.0 * partition_requests / total);
+		}
+		printf("\n");
 	}
+};
 
-	paddr_t strip_partition_bits(paddr_t paddr)
+class UnitCrossbar : public UnitPartitionInterconnect, public CrossBar<MemoryRequest>, CrossBar<MemoryReturn>
+{
+private:
+	std::vector<MemoryRequest> _request_regs;
+	std::vector<MemoryReturn> _return_regs;
+
+public:
+	UnitCrossbar(const Configuration& config) : UnitPartitionInterconnect(config),
+		CrossBar<MemoryRequest>(config.num_clients, config.num_partitions * config.num_slices, 64, 64),
+		CrossBar<MemoryReturn>(config.num_partitions * config.num_slices, config.num_clients, 64, 64),
+		_request_regs(_num_partitions * _num_slices),
+		_return_regs(_num_partitions * _num_slices)
 	{
-		return (paddr / _partition_stride / _num_partitions) * _partition_stride + (paddr % _partition_stride);
+		for(uint i = 0; i < _request_regs.size(); ++i)
+			_request_regs[i].paddr = ~0x0ull;
+		for(uint i = 0; i < _return_regs.size(); ++i)
+			_return_regs[i].paddr = ~0x0ull;
 	}
 
-	paddr_t inject_partition_bits(paddr_t paddr, uint partition)
+	uint get_sink(const MemoryRequest& request) override
 	{
-		return (paddr / _partition_stride * _num_partitions + partition) * _partition_stride + (paddr % _partition_stride);
+		return get_slice(request.paddr);
+	}
+
+	uint get_sink(const MemoryReturn& request) override
+	{
+		return request.port;
 	}
 
 	void clock_rise() override
@@ -109,6 +182,7 @@ public:
 			uint slice = i % _num_slices;
 			if(_request_regs[i].paddr == ~0x0ull || !_mem_highers[partition]->request_port_write_valid(slice)) continue;
 
+			_slice_requests[i]++;
 			_request_regs[i].paddr = strip_partition_bits(_request_regs[i].paddr);
 			_request_regs[i].dst.push(_request_regs[i].port, 9);
 			_request_regs[i].port = slice;
@@ -132,6 +206,38 @@ public:
 		CrossBar<MemoryReturn>::clock();
 	}
 
+	//Nothing inside the crossbar is timed so it only has work while a transaction is buffered
+	cycles_t next_event_cycle() override
+	{
+		if(!CrossBar<MemoryRequest>::empty() || !CrossBar<MemoryReturn>::empty())
+			return simulator->current_cycle + 1;
+
+		for(uint i = 0; i < _request_regs.size(); ++i)
+			if(_request_regs[i].paddr != ~0x0ull || _return_regs[i].paddr != ~0x0ull)
+				return simulator->current_cycle + 1;
+
+		return Simulator::NO_EVENT;
+	}
+
+	const CrossBar<MemoryRequest>::AllocatorLog& request_allocator_log() const { return CrossBar<MemoryRequest>::allocator_log(); }
+	const CrossBar<MemoryReturn>::AllocatorLog& return_allocator_log() const { return CrossBar<MemoryReturn>::allocator_log(); }
+
+	void print_stats(cycles_t cycles) override
+	{
+		printf("Grant Efficiency: %.2f%%/%.2f%% (Request/Return)\n", 100.0 * request_allocator_log().grant_efficiency(), 100.0 * return_allocator_log().grant_efficiency());
+		print_balance();
+	}
+
+	bool checkpoint(Checkpoint& checkpoint) override
+	{
+		CrossBar<MemoryRequest>::checkpoint(checkpoint);
+		CrossBar<MemoryReturn>::checkpoint(checkpoint);
+		checkpoint.io(_request_regs);
+		checkpoint.io(_return_regs);
+		checkpoint.io(_slice_requests);
+		return true;
+	}
+
 	bool request_port_write_valid(uint port_index) override
 	{
 		return CrossBar<MemoryRequest>::is_write_valid(port_index);
@@ -0,0 +1,481 @@
+#include "unit-dram-fast.hpp"
+
+#include <yaml-cpp/yaml.h>
+
+namespace Arches { namespace Units {
+
+//Mirrors the GDDR6A presets in ramulator/unit-GDDR6.cpp so both models read the same config files
+static const std::map<std::string, DRAMTimingModel::Organization> org_presets =
+{
+	//  name                   density   DQ  Ch Ra Bg Ba  Ro     Co
+	{"GDDR6_8Gb_x8",       {8  << 10, 8,  2, 1, 4, 4, 1 << 14, 1 << 11}},
+	{"GDDR6_8Gb_x16",      {8  << 10, 16, 2, 1, 4, 4, 1 << 14, 1 << 10}},
+	{"GDDR6_16Gb_x8",      {16 << 10, 8,  2, 1, 4, 4, 1 << 15, 1 << 11}},
+	{"GDDR6_16Gb_x16",     {16 << 10, 16, 2, 1, 4, 4, 1 << 14, 1 << 11}},
+	{"GDDR6_32Gb_x8",      {32 << 10, 8,  2, 1, 4, 4, 1 << 16, 1 << 11}},
+	{"GDDR6_32Gb_x16",     {32 << 10, 16, 2, 1, 4, 4, 1 << 15, 1 << 11}},
+	{"GDDR6_16Gb_x16_pch", {16 << 10, 16, 1, 1, 4, 4, 1 << 15, 1 << 11}},
+};
+
+static const std::map<std::string, DRAMTimingModel::Timing> timing_presets =
+{
+	//  name                         rate   nBL nCL nRCDRD nRCDWD nRP nRAS nRC nWR nRTP nCWL nCCDS nCCDL nRRDS nRRDL nWTRS nWTRL nFAW nRFC nRFCpb nRREFD nREFI
+	{"GDDR6_16000_1350mV_double", {16000, 8,  24, 26,    16,    26, 53,  79, 26, 4,   6,   4,    6,    7,    7,    9,    11,   28,  210, 105,   14,    3333}},
+	{"GDDR6_16000_1250mV_double", {16000, 8,  24, 30,    19,    30, 60,  89, 30, 4,   6,   4,    6,    11,   11,   9,    11,   42,  210, 105,   21,    3333}},
+	{"GDDR6_16000_1350mV_quad",   {16000, 4,  24, 26,    16,    26, 53,  79, 26, 4,   6,   4,    6,    7,    7,    9,    11,   28,  210, 105,   14,    3333}},
+	{"GDDR6_12000_1250mV_quad",   {12000, 4,  24, 24,    20,    24, 54,  78, 16, 3,   6,   3,    4,    9,    9,    7,    7,    32,  210, 105,   21,    3333}},
+	{"GDDR6_14000_1250mV_quad",   {14000, 4,  24, 27,    20,    27, 57,  84, 23, 4,   6,   4,    5,    10,   10,   8,    9,    37,  210, 105,   21,    3333}},
+	{"GDDR6_16000_1250mV_quad",   {16000, 4,  24, 30,    19,    30, 60,  89, 30, 4,   6,   4,    6,    11,   11,   9,    11,   42,  210, 105,   21,    3333}},
+	{"GDDR6x_21000_1350mV_quad",  {21000, 4,  24, 40,    19,    40, 79,  89, 40, 4,   6,   4,    6,    11,   11,   9,    11,   55,  210, 105,   21,    3333}},
+};
+
+static uint jedec_rounding(float t_ns, uint tCK_ps)
+{
+	uint64_t t_ps = t_ns * 1000;
+	return (t_ps * 1000 / tCK_ps + 974) / 1000;
+}
+
+DRAMTimingModel::DRAMTimingModel(const std::string& config_path, uint bank_queue_size) : _bank_queue_size(bank_queue_size)
+{
+	YAML::Node yaml = YAML::LoadFile(config_path)["MemorySystem"];
+	YAML::Node dram = yaml["DRAM"];
+
+	std::string org_preset = dram["org"]["preset"].as<std::string>();
+	std::string timing_preset = dram["timing"]["preset"].as<std::string>();
+	_assert(org_presets.count(org_preset) && timing_presets.count(timing_preset));
+	organization = org_presets.at(org_preset);
+	timing = timing_presets.at(timing_preset);
+
+	//refresh is set from the density like ramulator does, then any timing in the config overrides the preset
+	uint tCK_ps = 1000000 / (timing.rate / 8);
+	const static uint tRFC[] = {260, 360, 550, 750};
+	timing.nRFC = jedec_rounding(tRFC[log2i(organization.density >> 12)], tCK_ps);
+	timing.nREFI = jedec_rounding(7800, tCK_ps);
+
+	std::pair<const char*, uint*> timing_params[] =
+	{
+		{"nBL", &timing.nBL}, {"nCL", &timing.nCL}, {"nRCDRD", &timing.nRCDRD}, {"nRCDWD", &timing.nRCDWD}, {"nRP", &timing.nRP},
+		{"nRAS", &timing.nRAS}, {"nRC", &timing.nRC}, {"nWR", &timing.nWR}, {"nRTP", &timing.nRTP}, {"nCWL", &timing.nCWL},
+		{"nCCDS", &timing.nCCDS}, {"nCCDL", &timing.nCCDL}, {"nRRDS", &timing.nRRDS}, {"nRRDL", &timing.nRRDL},
+		{"nWTRS", &timing.nWTRS}, {"nWTRL", &timing.nWTRL}, {"nFAW", &timing.nFAW}, {"nRFC", &timing.nRFC}, {"nREFI", &timing.nREFI},
+	};
+	for(auto& param : timing_params)
+		if(dram["timing"][param.first]) *param.second = dram["timing"][param.first].as<uint>();
+
+	uint channel_width = dram["org"]["channel_width"].as<uint>();
+	_tx_offset = log2i(INTERNAL_PREFETCH * channel_width / 8);
+	_column_bits = log2i(organization.columns) - log2i(INTERNAL_PREFETCH);
+	_channel_bits = log2i(organization.channels);
+	_rank_bits = log2i(organization.ranks);
+	_bank_bits = log2i(organization.banks);
+	_bankgroup_bits = log2i(organization.bankgroups);
+
+	std::string mapper = yaml["AddrMapper"]["impl"].as<std::string>();
+	_assert(mapper == "RoBgBaRaChCo" || mapper == "RoBgBaRaChCoX" || mapper == "RoRaBaChCo");
+	_bankgroup_high = mapper != "RoRaBaChCo";
+	_permute = mapper == "RoBgBaRaChCoX";
+
+	//ramulator drains its 64 entry write buffer in batches between the watermarks, each batch pays one pair of bus
+	//turnarounds
+	float low_watermark = yaml["Controller"]["wr_low_watermark"] ? yaml["Controller"]["wr_low_watermark"].as<float>() : 0.2f;
+	float high_watermark = yaml["Controller"]["wr_high_watermark"] ? yaml["Controller"]["wr_high_watermark"].as<float>() : 0.8f;
+	_write_batch = std::max(1u, (uint)((high_watermark - low_watermark) * 64));
+
+	//nRRDS and nFAW become a minimum spacing between a channel's activates which also covers nRRDL in every preset
+	_act_spacing = std::max(timing.nRRDS, (timing.nFAW + 3) / 4);
+
+	reset();
+}
+
+void DRAMTimingModel::reset()
+{
+	uint num_bankgroups = organization.channels * organization.ranks * organization.bankgroups;
+	_channels.assign(organization.channels, Channel());
+	_bankgroups.assign(num_bankgroups, BankGroup());
+	_banks.assign(num_bankgroups * organization.banks, Bank());
+	_bank_queues.assign(_banks.size(), std::queue<cycles_t>());
+}
+
+void DRAMTimingModel::checkpoint(Checkpoint& checkpoint)
+{
+	checkpoint.io(_channels);
+	checkpoint.io(_bankgroups);
+	checkpoint.io(_banks);
+	checkpoint.io(_bank_queues);
+}
+
+uint DRAMTimingModel::_bank_index(paddr_t address, uint& channel_index, uint& bankgroup_index, uint64_t& row)
+{
+	uint64_t addr = address >> _tx_offset;
+	addr >>= _column_bits;
+	channel_index = addr & generate_nbit_mask(_channel_bits); addr >>= _channel_bits;
+
+	uint rank, bank, bankgroup;
+	if(_bankgroup_high)
+	{
+		rank = addr & generate_nbit_mask(_rank_bits); addr >>= _rank_bits;
+		bank = addr & generate_nbit_mask(_bank_bits); addr >>= _bank_bits;
+		bankgroup = addr & generate_nbit_mask(_bankgroup_bits); addr >>= _bankgroup_bits;
+	}
+	else
+	{
+		bankgroup = addr & generate_nbit_mask(_bankgroup_bits); addr >>= _bankgroup_bits;
+		rank = addr & generate_nbit_mask(_rank_bits); addr >>= _rank_bits;
+		bank = addr & generate_nbit_mask(_bank_bits); addr >>= _bank_bits;
+	}
+	row = addr & (organization.rows - 1);
+
+	//same fields of the row bits in the same order as ramulator's RoBgBaRaChCoX
+	if(_permute)
+	{
+		uint64_t row_bits = row;
+		channel_index ^= row_bits & generate_nbit_mask(_channel_bits); row_bits >>= _channel_bits;
+		bank ^= row_bits & generate_nbit_mask(_bank_bits); row_bits >>= _bank_bits;
+		bankgroup ^= row_bits & generate_nbit_mask(_bankgroup_bits);
+	}
+
+	bankgroup_index = (channel_index * organization.ranks + rank) * organization.bankgroups + bankgroup;
+	return bankgroup_index * organization.banks + bank;
+}
+
+//all bank refresh blocks the channel for nRFC at the start of every nREFI interval
+cycles_t DRAMTimingModel::_skip_refresh(cycles_t cycle) const
+{
+	if(cycle < timing.nREFI) return cycle;
+	cycles_t phase = cycle % timing.nREFI;
+	return phase < timing.nRFC ? cycle + timing.nRFC - phase : cycle;
+}
+
+//first run of length free slots at or after earliest. Slots behind the newest arrival are recycled for the window
+cycles_t DRAMTimingModel::SlotRing::find(cycles_t earliest, uint length, cycles_t cycle)
+{
+	if(cycle - base >= WINDOW)
+	{
+		for(uint64_t& word : slots) word = 0;
+		base = cycle;
+	}
+	for(; base < cycle; ++base)
+	{
+		if(base % 64 == 0 && base + 64 <= cycle)
+		{
+			slots[base % WINDOW / 64] = 0;
+			base += 63;
+		}
+		else slots[base % WINDOW / 64] &= ~(1ull << (base % 64));
+	}
+
+	cycles_t start = earliest;
+	for(cycles_t slot = start; slot < start + length && slot < cycle + WINDOW; ++slot)
+		if((slots[slot % WINDOW / 64] >> (slot % 64)) & 0x1) start = slot + 1;
+
+	return start;
+}
+
+void DRAMTimingModel::SlotRing::reserve(cycles_t start, uint length, cycles_t cycle)
+{
+	for(cycles_t slot = std::max(start, cycle); slot < start + length && slot < cycle + WINDOW; ++slot)
+		slots[slot % WINDOW / 64] |= 1ull << (slot % 64);
+}
+
+bool DRAMTimingModel::can_accept(paddr_t address, cycles_t cycle)
+{
+	uint channel_index, bankgroup_index;
+	uint64_t row;
+	std::queue<cycles_t>& queue = _bank_queues[_bank_index(address, channel_index, bankgroup_index, row)];
+	while(!queue.empty() && queue.front() <= cycle)
+		queue.pop();
+
+	return queue.size() < _bank_queue_size;
+}
+
+DRAMTimingModel::Result DRAMTimingModel::access(paddr_t address, bool write, cycles_t cycle)
+{
+	uint channel_index, bankgroup_index;
+	uint64_t row;
+	uint bank_index = _bank_index(address, channel_index, bankgroup_index, row);
+	Channel& channel = _channels[channel_index];
+	BankGroup& bankgroup = _bankgroups[bankgroup_index];
+	Bank& bank = _banks[bank_index];
+
+	cycles_t start = _skip_refresh(std::max(cycle + 1, bank.next_cmd));
+	if(bank.open_row != ~0ull && start / timing.nREFI > bank.act_cycle / timing.nREFI)
+		bank.open_row = ~0ull; //closed by a refresh
+
+	Result result;
+	cycles_t cas = start;
+	if(bank.open_row == row)
+	{
+		result.access = Access::ROW_HIT;
+	}
+	else
+	{
+		cycles_t act = start;
+		if(bank.open_row != ~0ull)
+		{
+			result.access = Access::ROW_CONFLICT;
+			act = std::max(start, bank.next_pre) + timing.nRP;
+		}
+		else result.access = Access::ROW_CLOSED;
+
+		act = _skip_refresh(std::max(act, bank.next_act));
+		act = _skip_refresh(channel.act.find(act, _act_spacing, cycle));
+		channel.act.reserve(act, _act_spacing, cycle);
+
+		bank.open_row = row;
+		bank.act_cycle = act;
+		bank.next_act = act + timing.nRC;
+		bank.next_pre = act + timing.nRAS;
+
+		cas = act + (write ? timing.nRCDWD : timing.nRCDRD);
+	}
+
+	//a write batch pays for turning the bus around to write and back to read
+	uint data_latency = write ? timing.nCWL : timing.nCL;
+	uint bus_cycles = timing.nBL;
+	if(write && channel.writes++ % _write_batch == 0)
+		bus_cycles += (timing.nCL + timing.nBL + 4 - timing.nCWL) + (timing.nCWL + timing.nWTRS);
+
+	//column commands to a bank group are nCCDL apart and their data needs a free slot on the channel's bus
+	while(true)
+	{
+		cas = bankgroup.cas.find(cas, timing.nCCDL, cycle);
+		cycles_t data = channel.bus.find(cas + data_latency, bus_cycles, cycle);
+		if(data == cas + data_latency) break;
+		cas = data - data_latency;
+	}
+	bankgroup.cas.reserve(cas, timing.nCCDL, cycle);
+	channel.bus.reserve(cas + data_latency, bus_cycles, cycle);
+
+	result.cas_cycle = cas;
+	result.return_cycle = cas + data_latency + timing.nBL;
+
+	if(write) bank.next_pre = std::max(bank.next_pre, cas + timing.nCWL + timing.nBL + timing.nWR);
+	else      bank.next_pre = std::max(bank.next_pre, cas + timing.nRTP);
+
+	bank.next_cmd = cas;
+	std::queue<cycles_t>& queue = _bank_queues[bank_index];
+	while(!queue.empty() && queue.front() <= cycle)
+		queue.pop();
+	queue.push(cas);
+
+	return result;
+}
+
+UnitDRAMFast::UnitDRAMFast(Configuration config) : UnitMainMemoryBase(config.size),
+	_partition_mask(config.partition_stride), _partition(config.partition), _request_network(config.num_ports, config.num_controllers), _return_network(config.num_controllers, config.num_ports)
+{
+	DRAMTimingModel timing_model(config.config_path, config.bank_queue_size);
+	_controllers.resize(config.num_controllers, MemoryController(config.latency, timing_model));
+}
+
+UnitDRAMFast::~UnitDRAMFast() /*override*/
+{
+
+}
+
+bool UnitDRAMFast::request_port_write_valid(uint port_index)
+{
+	return _request_network.is_write_valid(port_index);
+}
+
+void UnitDRAMFast::write_request(const MemoryRequest& request)
+{
+	_request_network.write(request, request.port);
+}
+
+bool UnitDRAMFast::return_port_read_valid(uint port_index)
+{
+	return _return_network.is_read_valid(port_index);
+}
+
+const MemoryReturn& UnitDRAMFast::peek_return(uint port_index)
+{
+	return _return_network.peek(port_index);
+}
+
+const MemoryReturn UnitDRAMFast::read_return(uint port_index)
+{
+	return _return_network.read(port_index);
+}
+
+void UnitDRAMFast::_log_access(DRAMTimingModel::Access access)
+{
+	if(access == DRAMTimingModel::Access::ROW_HIT)         log.row_hits++;
+	else if(access == DRAMTimingModel::Access::ROW_CLOSED) log.row_misses++;
+	else                                                   log.row_conflicts++;
+}
+
+bool UnitDRAMFast::_load(const MemoryRequest& request, uint channel_index)
+{
+	MemoryController& controller = _controllers[channel_index];
+	paddr_t address = _convert_address(request.paddr);
+	if(!controller.timing_model.can_accept(address, _current_cycle)) return false;
+
+	uint return_id = ~0;
+	if (_free_return_ids.empty())
+	{
+		return_id = _returns.size();
+		_returns.emplace_back();
+	}
+	else
+	{
+		return_id = _free_return_ids.top();
+		_free_return_ids.pop();
+	}
+
+	DRAMTimingModel::Result result = controller.timing_model.access(address, false, _current_cycle);
+	controller.return_queue.push({result.return_cycle, return_id});
+	_returns[return_id] = MemoryReturn(request, _data_u8 + request.paddr);
+
+	log.loads++;
+	log.load_cycles += result.return_cycle - _current_cycle;
+	_log_access(result.access);
+	log.regions.log(RegionMap::get_instance().find(request.paddr, _partition), request.size, false);
+
+	return true;
+}
+
+bool UnitDRAMFast::_store(const MemoryRequest& request, uint channel_index)
+{
+	MemoryController& controller = _controllers[channel_index];
+	paddr_t address = _convert_address(request.paddr);
+	if(!controller.timing_model.can_accept(address, _current_cycle)) return false;
+
+	DRAMTimingModel::Result result = controller.timing_model.access(address, true, _current_cycle);
+
+	//Masked write
+	std::memcpy(&_data_u8[request.paddr], request.data, request.size);
+	log.stores++;
+	log.bytes_written += request.size;
+	_log_access(result.access);
+	log.regions.log(RegionMap::get_instance().find(request.paddr, _partition), request.size, false);
+
+	return true;
+}
+
+void UnitDRAMFast::clock_rise()
+{
+	_request_network.clock();
+
+	bool busy = _pending_requests > 0;
+	for(uint controller_index = 0; controller_index < _controllers.size(); ++controller_index)
+	{
+		MemoryController& controller = _controllers[controller_index];
+		if(_request_network.is_read_valid(controller_index) && controller.req_pipline.is_write_valid())
+			controller.req_pipline.write(_request_network.read(controller_index));
+		controller.req_pipline.clock();
+
+		if(!controller.req_pipline.empty()) busy = true;
+		if(!controller.req_pipline.is_read_valid()) continue;
+		const MemoryRequest& request = controller.req_pipline.peek();
+
+		if (request.type == MemoryRequest::Type::STORE)
+		{
+			if (_store(request, controller_index))
+			{
+				controller.req_pipline.read();
+			}
+		}
+		else if (request.type == MemoryRequest::Type::LOAD)
+		{
+			if (_load(request, controller_index))
+			{
+				controller.req_pipline.read();
+				_pending_requests++;
+			}
+		}
+	}
+
+	if(busy)
+	{
+		if(!_busy)
+		{
+			_busy = true;
+			simulator->units_executing++;
+		}
+	}
+	else
+	{
+		if(_busy)
+		{
+			_busy = false;
+			simulator->units_executing--;
+		}
+	}
+}
+
+void UnitDRAMFast::clock_fall()
+{
+	++_current_cycle;
+
+	for(uint controller_index = 0; controller_index < _controllers.size(); ++controller_index)
+	{
+		MemoryController& controller = _controllers[controller_index];
+		if(controller.return_queue.empty() || controller.return_queue.top().return_cycle > _current_cycle) continue;
+
+		const FastReturn& fast_return = controller.return_queue.top();
+		const MemoryReturn& ret = _returns[fast_return.return_id];
+		if(_return_network.is_write_valid(controller_index))
+		{
+			log.bytes_read += ret.size;
+			_return_network.write(ret, controller_index);
+			_free_return_ids.push(fast_return.return_id);
+			controller.return_queue.pop();
+			_pending_requests--;
+		}
+	}
+
+	_return_network.clock();
+}
+
+//Nothing ticks between accesses so the unit can sleep until its next return is due. A request stalled on a full bank
+//queue retries every cycle.
+cycles_t UnitDRAMFast::next_event_cycle()
+{
+	cycles_t current_cycle = simulator->domain_cycle(clock_domain);
+	if(!_request_network.empty() || !_return_network.empty()) return current_cycle + 1;
+
+	cycles_t next_event = Simulator::NO_EVENT;
+	for(MemoryController& controller : _controllers)
+	{
+		if(!controller.return_queue.empty())
+		{
+			cycles_t return_cycle = controller.return_queue.top().return_cycle;
+			next_event = std::min(next_event, current_cycle + (return_cycle > _current_cycle ? return_cycle - _current_cycle : 1));
+		}
+		if(!controller.req_pipline.empty()) next_event = std::min(next_event, current_cycle + std::max<cycles_t>(controller.req_pipline.cycles_until_read_valid(), 1));
+	}
+
+	return next_event;
+}
+
+void UnitDRAMFast::skip_cycles(cycles_t cycles)
+{
+	_current_cycle += cycles;
+	for(MemoryController& controller : _controllers)
+		controller.req_pipline.skip(cycles);
+}
+
+bool UnitDRAMFast::checkpoint(Checkpoint& checkpoint)
+{
+	_checkpoint_memory(checkpoint);
+	checkpoint.io(_request_network);
+	checkpoint.io(_return_network);
+	checkpoint.io(_returns);
+	checkpoint.io(_free_return_ids);
+	checkpoint.io(_pending_requests);
+	checkpoint.io(_busy);
+	checkpoint.io(_current_cycle);
+	checkpoint.io(log);
+
+	for(MemoryController& controller : _controllers)
+	{
+		checkpoint.io(controller.req_pipline);
+		checkpoint.io(controller.timing_model);
+		checkpoint.io(controller.return_queue);
+	}
+
+	return true;
+}
+
+}}
@@ -0,0 +1,256 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "unit-main-memory-base.hpp"
+#include "util/arbitration.hpp"
+#include "util/memory-map.hpp"
+
+namespace Arches { namespace Units {
+
+//Closed form GDDR6 timing. Each access is scheduled on arrival against per bank open rows and per channel data bus
+//reservations instead of ticking a command level model. A cycle is one tick of a ramulator memory system so the same
+//latency and clock domain work for both. Organization, timing and address mapping come from the ramulator config.
+class DRAMTimingModel
+{
+public:
+	struct Timing
+	{
+		uint rate, nBL, nCL, nRCDRD, nRCDWD, nRP, nRAS, nRC, nWR, nRTP, nCWL, nCCDS, nCCDL, nRRDS, nRRDL, nWTRS, nWTRL, nFAW, nRFC, nRFCpb, nRREFD, nREFI;
+	};
+
+	struct Organization
+	{
+		uint density, dq;
+		uint channels, ranks, bankgroups, banks, rows, columns;
+	};
+
+	enum class Access : uint8_t
+	{
+		ROW_HIT,
+		ROW_CLOSED,
+		ROW_CONFLICT,
+	};
+
+	struct Result
+	{
+		cycles_t cas_cycle;
+		cycles_t return_cycle; //last data beat
+		Access access;
+	};
+
+	Timing timing;
+	Organization organization;
+
+private:
+	const static uint INTERNAL_PREFETCH = 16;
+
+	//Cycles reserved on a shared resource. Accesses to different banks don't have to reserve in time order so one
+	//waiting on a slow row conflict doesn't hold back row hits behind it the way a next free cycle would.
+	struct SlotRing
+	{
+		const static uint WINDOW = 4096; //cycles tracked past the newest arrival, later reservations aren't checked
+
+		cycles_t base{0};
+		uint64_t slots[WINDOW / 64]{};
+
+		cycles_t find(cycles_t earliest, uint length, cycles_t cycle);
+		void reserve(cycles_t start, uint length, cycles_t cycle);
+	};
+
+	struct Bank
+	{
+		uint64_t open_row{~0ull};
+		cycles_t act_cycle{0};
+		cycles_t next_cmd{0}; //accesses to a bank are served in order
+		cycles_t next_act{0};
+		cycles_t next_pre{0};
+	};
+
+	struct BankGroup
+	{
+		SlotRing cas;
+	};
+
+	struct Channel
+	{
+		SlotRing act;
+		SlotRing bus;
+		uint writes{0};
+	};
+
+	uint _tx_offset, _column_bits, _channel_bits, _rank_bits, _bank_bits, _bankgroup_bits;
+	bool _bankgroup_high; //RoBgBaRaChCo, RoRaBaChCo otherwise
+	bool _permute; //RoBgBaRaChCoX
+	uint _write_batch;
+	uint _act_spacing;
+	uint _bank_queue_size;
+
+	std::vector<Channel> _channels;
+	std::vector<BankGroup> _bankgroups;
+	std::vector<Bank> _banks;
+	std::vector<std::queue<cycles_t>> _bank_queues; //cas cycles of accesses still waiting on their bank
+
+public:
+	DRAMTimingModel(const std::string& config_path, uint bank_queue_size = 8);
+
+	//Arrival cycles must not decrease between calls
+	bool can_accept(paddr_t address, cycles_t cycle);
+	Result access(paddr_t address, bool write, cycles_t cycle);
+
+	void reset();
+	void checkpoint(Checkpoint& checkpoint);
+
+private:
+	uint _bank_index(paddr_t address, uint& channel_index, uint& bankgroup_index, uint64_t& row);
+	cycles_t _skip_refresh(cycles_t cycle) const;
+};
+
+class UnitDRAMFast : public UnitMainMemoryBase
+{
+public:
+	struct Configuration
+	{
+		std::string config_path;
+		uint64_t size{1ull << 30};
+		uint latency{1}; //in DRAM clock cycles, the unit runs in whatever clock domain it is registered with
+		uint num_ports{1};
+		uint num_controllers{1};
+		uint64_t partition_stride{0x0ull};
+		uint partition{~0u}; //partition whose address bits were stripped before this unit, ~0u for global addresses
+		uint bank_queue_size{8};
+	};
+
+private:
+	struct FastReturn
+	{
+		cycles_t return_cycle;
+		uint return_id;
+
+		friend bool operator<(const FastReturn& l, const FastReturn& r)
+		{
+			return l.return_cycle > r.return_cycle;
+		}
+	};
+
+	struct MemoryController
+	{
+		LatencyFIFO<MemoryRequest> req_pipline;
+		DRAMTimingModel timing_model;
+		std::priority_queue<FastReturn> return_queue;
+
+		MemoryController(uint latency, const DRAMTimingModel& timing_model) : req_pipline(latency), timing_model(timing_model) {}
+	};
+
+	uint _pending_requests = 0;
+	bool _busy{false};
+
+	paddr_t _partition_mask{0x0ull};
+	uint _partition;
+
+	cycles_t _current_cycle{ 0 };
+
+	std::vector<MemoryController> _controllers;
+	RequestCascade _request_network;
+	ReturnCascade _return_network;
+
+	std::vector<MemoryReturn> _returns;
+	std::stack<uint> _free_return_ids;
+
+public:
+	UnitDRAMFast(Configuration config);
+	virtual ~UnitDRAMFast() override;
+
+	bool request_port_write_valid(uint port_index) override;
+	void write_request(const MemoryRequest& request) override;
+
+	bool return_port_read_valid(uint port_index) override;
+	const MemoryReturn& peek_return(uint port_index) override;
+	const MemoryReturn read_return(uint port_index) override;
+
+	void clock_rise() override;
+	void clock_fall() override;
+	cycles_t next_event_cycle() override;
+	void skip_cycles(cycles_t cycles) override;
+	bool checkpoint(Checkpoint& checkpoint) override;
+
+	void print_stats(uint32_t const, cycles_t) {}
+	float total_power() { return 0.0f; }
+
+	class Log
+	{
+	public:
+		const static uint NUM_COUNTERS = 8;
+		union
+		{
+			struct
+			{
+				uint64_t loads;
+				uint64_t stores;
+				uint64_t bytes_read;
+				uint64_t bytes_written;
+				uint64_t row_hits;
+				uint64_t row_misses;
+				uint64_t row_conflicts;
+				uint64_t load_cycles;
+			};
+			uint64_t counters[NUM_COUNTERS];
+		};
+		RegionLog regions;
+
+		Log() { reset(); }
+
+		void reset()
+		{
+			for (uint i = 0; i < NUM_COUNTERS; ++i)
+				counters[i] = 0;
+			regions.reset();
+		}
+
+		void accumulate(const Log& other)
+		{
+			for (uint i = 0; i < NUM_COUNTERS; ++i)
+				counters[i] += other.counters[i];
+			regions.accumulate(other.regions);
+		}
+
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(counters);
+			regions.checkpoint(checkpoint);
+		}
+
+		void print_short()
+		{
+			uint64_t total = loads + stores;
+			if (total == 0) return;
+
+			printf("DRAM Row Hit/Miss/Conflict: %3.1f%%/%3.1f%%/%3.1f%%\n", 100.0 * row_hits / total, 100.0 * row_misses / total, 100.0 * row_conflicts / total);
+			printf("DRAM Load Latency: %.1f cycles\n", (double)load_cycles / loads);
+		}
+
+		void print(cycles_t, uint units = 1)
+		{
+			uint64_t total = loads + stores;
+
+			printf("Total: %lld\n", total / units);
+			printf("Loads: %lld\n", loads / units);
+			printf("Stores: %lld\n", stores / units);
+			printf("\n");
+			printf("Row Hit/Miss/Conflict: %.1f%%/%.1f%%/%.1f%%\n", 100.0 * row_hits / total, 100.0 * row_misses / total, 100.0 * row_conflicts / total);
+			printf("Average Load Latency: %.1f cycles\n", (double)load_cycles / loads);
+		}
+	}
+	log;
+
+private:
+	bool _load(const MemoryRequest& request, uint channel_index);
+	bool _store(const MemoryRequest& request, uint channel_index);
+	void _log_access(DRAMTimingModel::Access access);
+	paddr_t _convert_address(paddr_t address)
+	{
+		address &= ~generate_nbit_mask(log2i(CACHE_SECTOR_SIZE));
+		return pext(address, ~_partition_mask);
+	}
+};
+
+}}
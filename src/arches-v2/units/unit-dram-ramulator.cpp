@@ -5,11 +5,12 @@ namespace Arches { namespace Units {
 #define ENABLE_DRAM_DEBUG_PRINTS 0
 
 UnitDRAMRamulator::UnitDRAMRamulator(Configuration config) : UnitMainMemoryBase(config.size),
-	_request_network(config.num_ports, config.num_controllers), _return_network(config.num_controllers, config.num_ports), _partition_mask(config.partition_stride)
+	_request_network(config.num_ports, config.num_controllers), _return_network(config.num_controllers, config.num_ports), _partition_mask(config.partition_stride), _partition(config.partition)
 {
 	YAML::Node yaml = Ramulator::Config::parse_config_file(config.config_path, {});
 
 	_controllers.resize(config.num_controllers, config.latency);
+	uint num_channels = 0, banks_per_channel = 0;
 	for(uint i = 0; i < config.num_controllers; ++i)
 	{
 		_controllers[i].ramulator2_frontend = Ramulator::Factory::create_frontend(yaml);
@@ -20,9 +21,36 @@ UnitDRAMRamulator::UnitDRAMRamulator(Configuration config) : UnitMainMemoryBase(
 
 		_controllers[i].ramulator2_frontend->connect_memory_system(_controllers[i].ramulator2_memorysystem);
 		_controllers[i].ramulator2_memorysystem->connect_frontend(_controllers[i].ramulator2_frontend);
+
+		//memory systems can only skip idle cycles if every channel runs our controller and refresh manager
+		_controllers[i].ramulator2_controllers = Ramulator::GenericDRAMControllerA::get_controllers(_controllers[i].ramulator2_memorysystem);
+		for(Ramulator::GenericDRAMControllerA* channel_controller : _controllers[i].ramulator2_controllers)
+			_controllers[i].settle_cycles = std::max<cycles_t>(_controllers[i].settle_cycles, channel_controller->settle_cycles());
+
+		_controllers[i].channel_base = num_channels;
+		num_channels += _controllers[i].ramulator2_controllers.size();
+		if(!_controllers[i].ramulator2_controllers.empty()) banks_per_channel = _controllers[i].ramulator2_controllers[0]->get_num_banks();
+	}
+
+	//channels only write their own entries so memory systems ticking in parallel don't share counters
+	log.resize(num_channels, banks_per_channel);
+	for(MemoryController& controller : _controllers)
+	{
+		for(uint j = 0; j < controller.ramulator2_controllers.size(); ++j)
+		{
+			uint bank_base = (controller.channel_base + j) * banks_per_channel;
+			controller.ramulator2_controllers[j]->set_row_outcome_callback([this, bank_base](int bank, Ramulator::GenericDRAMControllerA::RowOutcome outcome)
+			{
+				Log::Bank& log_bank = log.banks[bank_base + bank];
+				if     (outcome == Ramulator::GenericDRAMControllerA::RowOutcome::Hit)      log_bank.row_hits++;
+				else if(outcome == Ramulator::GenericDRAMControllerA::RowOutcome::Conflict) log_bank.row_conflicts++;
+				else                                                                        log_bank.row_misses++;
+			});
+		}
 	}
 
-	_clock_ratio = config.clock_ratio;
+	if(config.calibrate)
+		_calibration_models.resize(config.num_controllers, DRAMTimingModel(config.config_path));
 }
 
 UnitDRAMRamulator::~UnitDRAMRamulator() /*override*/
@@ -62,6 +90,7 @@ void UnitDRAMRamulator::print_stats(
 {
 	for(auto& controller : _controllers)
 	{
+		_catch_up(controller);
 		controller.ramulator2_frontend->finalize();
 		controller.ramulator2_memorysystem->finalize();
 	}
@@ -89,14 +118,7 @@ bool UnitDRAMRamulator::_load(const MemoryRequest& request, uint channel_index)
 		_free_return_ids.pop();
 	}
 
-	bool enqueue_success = _controllers[channel_index].ramulator2_frontend->receive_external_requests(0, _convert_address(request.paddr), return_id, [this, channel_index](Ramulator::Request& req)
-	{
-		// your read request callback 
-#if ENABLE_DRAM_DEBUG_PRINTS
-		printf("Load: 0x%llx(%d, %d, %d, %d, %d): %d cycles\n", req.addr, req.addr_vec[0], req.addr_vec[1], req.addr_vec[2], req.addr_vec[3], req.addr_vec[4], (req.depart - req.arrive) / _clock_ratio);
-#endif
-		_controllers[channel_index].return_queue.push({ req.depart, (uint)req.source_id });
-	});
+	bool enqueue_success = _issue_load(request.paddr, return_id, channel_index);
 
 	if (enqueue_success)
 	{
@@ -104,16 +126,51 @@ bool UnitDRAMRamulator::_load(const MemoryRequest& request, uint channel_index)
 		MemoryReturn& ret = _returns[return_id];
 		ret = MemoryReturn(request, _data_u8 + request.paddr);
 		log.loads++;
-		if(_load_map[request.paddr]++ == 0) log.unique_loads++;
-		if(_row_map[request.paddr & ~0x1fff]++ == 0) log.unique_rows++;
+		log.unique_loads.add(_unique_key(request.paddr));
+		log.unique_rows.add(_unique_key(request.paddr & ~0x1fffull));
+		if(_load_issue_cycles.size() < _returns.size()) _load_issue_cycles.resize(_returns.size());
+		_load_issue_cycles[return_id] = _current_cycle;
+		log.regions.log(RegionMap::get_instance().find(request.paddr, _partition), request.size, false);
+
+		if(!_calibration_models.empty())
+		{
+			cycles_t fast_return_cycle = _calibration_models[channel_index].access(_convert_address(request.paddr), false, _current_cycle).return_cycle;
+			if(_calibration_loads.size() < _returns.size()) _calibration_loads.resize(_returns.size());
+			_calibration_loads[return_id] = {_current_cycle, fast_return_cycle};
+
+			cycles_t busy_start = std::max(_current_cycle, _fast_busy_until);
+			if(fast_return_cycle > busy_start) log.fast_busy_cycles += fast_return_cycle - busy_start;
+			_fast_busy_until = std::max(_fast_busy_until, fast_return_cycle);
+		}
 	}
+	else _free_return_ids.push(return_id); //retried next cycle, don't leak the id
+
+	return enqueue_success;
+}
+
+bool UnitDRAMRamulator::_issue_load(paddr_t paddr, uint return_id, uint channel_index)
+{
+	MemoryController& controller = _controllers[channel_index];
+	_catch_up(controller);
+
+	bool enqueue_success = controller.ramulator2_frontend->receive_external_requests(0, _convert_address(paddr), return_id, [this, channel_index](Ramulator::Request& req)
+	{
+		// your read request callback 
+#if ENABLE_DRAM_DEBUG_PRINTS
+		printf("Load: 0x%llx(%d, %d, %d, %d, %d): %d cycles\n", req.addr, req.addr_vec[0], req.addr_vec[1], req.addr_vec[2], req.addr_vec[3], req.addr_vec[4], (req.depart - req.arrive));
+#endif
+		_controllers[channel_index].return_queue.push({ req.depart, (uint)req.source_id });
+		_controllers[channel_index].pending_loads--;
+	});
 
+	if(enqueue_success) controller.pending_loads++;
 	return enqueue_success;
 }
 
 bool UnitDRAMRamulator::_store(const MemoryRequest& request, uint channel_index)
 {
 	//interface with ramulator
+	_catch_up(_controllers[channel_index]);
 	bool enqueue_success = _controllers[channel_index].ramulator2_frontend->receive_external_requests(1, _convert_address(request.paddr), -1, [this](Ramulator::Request& req)
 	{	// your read request callback 
 #if ENABLE_DRAM_DEBUG_PRINTS
@@ -127,6 +184,10 @@ bool UnitDRAMRamulator::_store(const MemoryRequest& request, uint channel_index)
 		std::memcpy(&_data_u8[request.paddr], request.data, request.size);
 		log.stores++;
 		log.bytes_written += request.size;
+		log.regions.log(RegionMap::get_instance().find(request.paddr, _partition), request.size, false);
+
+		if(!_calibration_models.empty())
+			_calibration_models[channel_index].access(_convert_address(request.paddr), true, _current_cycle);
 	}
 
 	return enqueue_success;
@@ -183,18 +244,210 @@ void UnitDRAMRamulator::clock_rise()
 	}
 }
 
-void UnitDRAMRamulator::clock_fall()
+void UnitDRAMRamulator::_tick_ramulator()
+{
+	PROFILE_SECTION(RAMULATOR);
+
+	++_current_cycle;
+
+	//memory systems are independent so ones with work can tick in parallel, settled ones only count the cycle
+	uint num_ticking = 0;
+	for(MemoryController& controller : _controllers)
+		if(!_settled(controller)) num_ticking++;
+
+#ifndef _DEBUG
+	if(num_ticking >= PARALLEL_TICK_CONTROLLERS && simulator->engine_threads() > 1)
+	{
+		tbb::parallel_for(tbb::blocked_range<uint>(0, _controllers.size()), [&](tbb::blocked_range<uint> r)
+		{
+			for(uint i = r.begin(); i < r.end(); ++i)
+				_tick_controller(_controllers[i]);
+		});
+	}
+	else
+#endif
+	{
+		for(MemoryController& controller : _controllers)
+			_tick_controller(controller);
+	}
+}
+
+//Only touches the controller's own state, the load callbacks included, so it's safe to run concurrently
+void UnitDRAMRamulator::_tick_controller(MemoryController& controller)
 {
-	double delta = _fractional_cycle + _clock_ratio;
-	uint clock_cycles = (uint)delta;
-	_fractional_cycle = std::fmod(delta, 1.0);
-	for(uint i = 0; i < clock_cycles; ++i)
+	if(_settled(controller) && (controller.next_refresh_cycle == -1 || _current_cycle < controller.next_refresh_cycle))
+	{
+		controller.skipped_cycles++;
+		return;
+	}
+
+	_catch_up(controller);
+	controller.ramulator2_memorysystem->tick();
+
+	for(uint j = 0; j < controller.ramulator2_controllers.size(); ++j)
 	{
-		++_current_cycle;
-		for(uint j = 0; j < _controllers.size(); ++j)
-			_controllers[j].ramulator2_memorysystem->tick();
+		Ramulator::GenericDRAMControllerA* channel_controller = controller.ramulator2_controllers[j];
+		log.sample_channel(controller.channel_base + j, channel_controller->get_read_queue_size(), channel_controller->get_write_queue_size(), channel_controller->get_queue_capacity(), channel_controller->get_busy_banks());
 	}
 
+	bool idle = controller.pending_loads == 0 && !controller.ramulator2_controllers.empty();
+	controller.next_refresh_cycle = -1;
+	for(Ramulator::GenericDRAMControllerA* channel_controller : controller.ramulator2_controllers)
+	{
+		idle = idle && channel_controller->can_skip();
+
+		cycles_t next_refresh_cycle = channel_controller->next_refresh_cycle();
+		if(next_refresh_cycle != -1 && (controller.next_refresh_cycle == -1 || next_refresh_cycle < controller.next_refresh_cycle))
+			controller.next_refresh_cycle = next_refresh_cycle;
+	}
+	controller.idle_cycles = idle ? controller.idle_cycles + 1 : 0;
+}
+
+//Pays the cycles a settled memory system skipped in one step. Its DRAM isn't ticked for them, once settled it has no
+//timing left to resolve and only compares against its own clock. Any use of the memory system ends the settled span.
+void UnitDRAMRamulator::_catch_up(MemoryController& controller)
+{
+	if(controller.skipped_cycles > 0)
+	{
+		for(uint j = 0; j < controller.ramulator2_controllers.size(); ++j)
+		{
+			controller.ramulator2_controllers[j]->skip(controller.skipped_cycles);
+			log.sample_channel(controller.channel_base + j, 0, 0, 1, 0, controller.skipped_cycles);
+		}
+		controller.skipped_cycles = 0;
+	}
+	controller.idle_cycles = 0;
+}
+
+//Ramulator only calls back once a load's depart cycle has passed so anything in a return queue is due now. Loads still
+//inside ramulator call back no earlier than their channel's first read depart, ramulator is ticked for skipped cycles so
+//the callback lands on the same cycle it would without skipping. Queued stores, settling and refreshes also tick while
+//skipping until every memory system has settled, then the rest of the span is skipped in one step, so the next refresh
+//bounds how far ahead the unit can sleep.
+cycles_t UnitDRAMRamulator::next_event_cycle()
+{
+	cycles_t current_cycle = simulator->domain_cycle(clock_domain);
+	if(!_request_network.empty() || !_return_network.empty()) return current_cycle + 1;
+
+	cycles_t next_event = Simulator::NO_EVENT;
+	bool loads_bounded = false;
+	for(MemoryController& controller : _controllers)
+	{
+		if(!controller.return_queue.empty()) return current_cycle + 1;
+		if(!controller.req_pipline.empty()) next_event = std::min(next_event, current_cycle + std::max<cycles_t>(controller.req_pipline.cycles_until_read_valid(), 1));
+		if(controller.next_refresh_cycle != -1) next_event = std::min(next_event, current_cycle + std::max<cycles_t>(controller.next_refresh_cycle - _current_cycle, 1));
+
+		for(Ramulator::GenericDRAMControllerA* channel_controller : controller.ramulator2_controllers)
+		{
+			cycles_t next_read_depart = channel_controller->next_read_depart();
+			if(next_read_depart == -1) continue;
+			next_event = std::min(next_event, current_cycle + std::max<cycles_t>(next_read_depart - _current_cycle, 1));
+			loads_bounded = true;
+		}
+	}
+
+	//loads in a memory system without GenericDRAMControllerA channels can't be bounded
+	if(_pending_requests > 0 && !loads_bounded) return current_cycle + 1;
+	return next_event;
+}
+
+void UnitDRAMRamulator::skip_cycles(cycles_t cycles)
+{
+	for(cycles_t i = 0; i < cycles; ++i)
+	{
+		bool settled = true;
+		for(MemoryController& controller : _controllers)
+			settled = settled && _settled(controller);
+
+		if(settled)
+		{
+			_current_cycle += cycles - i;
+			for(MemoryController& controller : _controllers)
+				controller.skipped_cycles += cycles - i;
+			break;
+		}
+
+		_tick_ramulator();
+	}
+
+	for(MemoryController& controller : _controllers)
+		controller.req_pipline.skip(cycles);
+}
+
+//Ramulator's internal state can't be saved so a restore starts with fresh controllers. Loads that were inside ramulator
+//are issued again and pay their full latency a second time, returns already out of ramulator are due immediately and
+//stores that were still queued in ramulator are dropped since their data was already written.
+bool UnitDRAMRamulator::checkpoint(Checkpoint& checkpoint)
+{
+	_checkpoint_memory(checkpoint);
+	checkpoint.io(_request_network);
+	checkpoint.io(_return_network);
+	checkpoint.io(_returns);
+	checkpoint.io(_free_return_ids);
+	checkpoint.io(_pending_requests);
+	checkpoint.io(_busy);
+	checkpoint.io(log);
+
+	for(MemoryController& controller : _controllers)
+	{
+		checkpoint.io(controller.req_pipline);
+		checkpoint.io(controller.return_queue);
+	}
+
+	if(checkpoint.restoring())
+	{
+		_current_cycle = 0;
+		for(MemoryController& controller : _controllers)
+		{
+			controller.pending_loads = 0;
+			controller.idle_cycles = 0;
+			controller.skipped_cycles = 0;
+			controller.next_refresh_cycle = -1;
+		}
+
+		//the timing models restart with ramulator, loads already in flight are left out of the calibration
+		for(DRAMTimingModel& calibration_model : _calibration_models)
+			calibration_model.reset();
+		_calibration_loads.clear();
+		_fast_busy_until = 0;
+
+		//latency of loads in flight counts from the restore like the calibration restarting
+		_load_issue_cycles.assign(_returns.size(), 0);
+
+		std::vector<bool> in_flight(_returns.size(), true);
+		std::stack<uint> free_return_ids = _free_return_ids;
+		for(; !free_return_ids.empty(); free_return_ids.pop())
+			in_flight[free_return_ids.top()] = false;
+
+		for(MemoryController& controller : _controllers)
+		{
+			std::priority_queue<RamulatorReturn> return_queue;
+			for(; !controller.return_queue.empty(); controller.return_queue.pop())
+			{
+				in_flight[controller.return_queue.top().return_id] = false;
+				return_queue.push({0, controller.return_queue.top().return_id});
+			}
+			controller.return_queue = return_queue;
+		}
+
+		uint ports_per_controller = (_return_network.num_sinks() + _controllers.size() - 1) / _controllers.size();
+		for(uint return_id = 0; return_id < _returns.size(); ++return_id)
+		{
+			if(!in_flight[return_id]) continue;
+
+			uint channel_index = _returns[return_id].port / ports_per_controller;
+			if(!_issue_load(_returns[return_id].paddr, return_id, channel_index))
+				_controllers[channel_index].return_queue.push({0, return_id});
+		}
+	}
+
+	return true;
+}
+
+void UnitDRAMRamulator::clock_fall()
+{
+	_tick_ramulator();
+
 	for(uint controller_index = 0; controller_index < _controllers.size(); ++controller_index)
 	{
 		MemoryController& controller = _controllers[controller_index];
@@ -209,6 +462,8 @@ void UnitDRAMRamulator::clock_fall()
 			#endif
 				_assert(_current_cycle >= ramulator_return.return_cycle);
 				log.bytes_read += ret.size;
+				log.log_load_latency(_current_cycle - _load_issue_cycles[ramulator_return.return_id]);
+				if(!_calibration_models.empty()) _log_calibration(ramulator_return);
 				_return_network.write(ret, controller_index);
 				_free_return_ids.push(ramulator_return.return_id);
 				controller.return_queue.pop();
@@ -217,9 +472,27 @@ void UnitDRAMRamulator::clock_fall()
 		}
 	}
 
+	if(!_calibration_models.empty() && _pending_requests > 0) log.ramulator_busy_cycles++;
+
 	_return_network.clock();
 }
 
+void UnitDRAMRamulator::_log_calibration(const RamulatorReturn& ramulator_return)
+{
+	//loads issued again after a restore aren't tracked
+	if(ramulator_return.return_id >= _calibration_loads.size()) return;
+	CalibrationLoad& load = _calibration_loads[ramulator_return.return_id];
+	if(load.issue_cycle == -1) return;
+
+	cycles_t ramulator_cycles = ramulator_return.return_cycle - load.issue_cycle;
+	cycles_t fast_cycles = load.fast_return_cycle - load.issue_cycle;
+	log.calibration_loads++;
+	log.ramulator_load_cycles += ramulator_cycles;
+	log.fast_load_cycles += fast_cycles;
+	log.load_cycle_error += ramulator_cycles > fast_cycles ? ramulator_cycles - fast_cycles : fast_cycles - ramulator_cycles;
+	load.issue_cycle = -1;
+}
+
 
 
 }}
\ No newline at end of file
@@ -2,7 +2,10 @@
 #include "stdafx.hpp"
 
 #include "unit-main-memory-base.hpp"
+#include "unit-dram-fast.hpp"
 #include "util/arbitration.hpp"
+#include "util/memory-map.hpp"
+#include "util/hyper-log-log.hpp"
 
 
 #include <ramulator2/src/base/base.h>
@@ -32,11 +35,12 @@ public:
 	{
 		std::string config_path;
 		uint64_t size{1ull << 30};
-		uint latency{1};
+		uint latency{1}; //in DRAM clock cycles, the unit runs in whatever clock domain it is registered with
 		uint num_ports{1};
 		uint num_controllers{1};
 		uint64_t partition_stride{0x0ull};
-		double clock_ratio;
+		uint partition{~0u}; //partition whose address bits were stripped before this unit, ~0u for global addresses
+		bool calibrate{false}; //runs a DRAMTimingModel beside ramulator on the same requests and logs how far it is off
 	};
 
 private:
@@ -51,13 +55,24 @@ private:
 		}
 	};
 
+	//Tick a memory system's controllers in parallel once this many of them have work
+	const static uint PARALLEL_TICK_CONTROLLERS = 4;
+
 	struct MemoryController
 	{
 		LatencyFIFO<MemoryRequest> req_pipline;
 		Ramulator::IFrontEnd* ramulator2_frontend;
 		Ramulator::IMemorySystem* ramulator2_memorysystem;
+		std::vector<Ramulator::GenericDRAMControllerA*> ramulator2_controllers;
+		uint channel_base{0}; //index of its first channel in the log
 		std::priority_queue<RamulatorReturn> return_queue;
 
+		uint pending_loads{0};
+		cycles_t idle_cycles{0}; //consecutive ticks with every channel idle
+		cycles_t settle_cycles{0};
+		cycles_t skipped_cycles{0}; //ticks owed to a settled memory system, paid in one step before it's used again
+		cycles_t next_refresh_cycle{-1};
+
 		MemoryController(uint latency) : req_pipline(latency) {}
 	};
 
@@ -65,9 +80,8 @@ private:
 	bool _busy{false};
 
 	paddr_t _partition_mask{0x0ull};
+	uint _partition;
 
-	double _clock_ratio{0.0};
-	double _fractional_cycle{0.0};
 	cycles_t _current_cycle{ 0 };
 
 	std::vector<MemoryController> _controllers;
@@ -77,8 +91,17 @@ private:
 	std::vector<MemoryReturn> _returns;
 	std::stack<uint> _free_return_ids;
 
-	std::map<paddr_t, uint> _load_map;
-	std::map<paddr_t, uint> _row_map;
+	std::vector<cycles_t> _load_issue_cycles; //indexed by return id
+
+	struct CalibrationLoad
+	{
+		cycles_t issue_cycle{-1};
+		cycles_t fast_return_cycle;
+	};
+
+	std::vector<DRAMTimingModel> _calibration_models;
+	std::vector<CalibrationLoad> _calibration_loads; //indexed by return id
+	cycles_t _fast_busy_until{0};
 
 public:
 	UnitDRAMRamulator(Configuration config);
@@ -93,6 +116,9 @@ public:
 
 	void clock_rise() override;
 	void clock_fall() override;
+	cycles_t next_event_cycle() override;
+	void skip_cycles(cycles_t cycles) override;
+	bool checkpoint(Checkpoint& checkpoint) override;
 
 	void print_stats(uint32_t const word_size, cycles_t cycle_count);
 	float total_power();
@@ -100,7 +126,12 @@ public:
 	class Log
 	{
 	public:
-		const static uint NUM_COUNTERS = 8;
+		const static uint NUM_COUNTERS = 10;
+		const static uint QUEUE_BUCKETS = 9; //empty then each eighth of the buffer
+		const static uint BANK_BUCKETS = 17; //banks with a request waiting, the last bucket holds 16 or more
+		const static uint LATENCY_EXACT = 16;
+		const static uint LATENCY_BUCKETS = LATENCY_EXACT + 8 * 14; //exact below LATENCY_EXACT then 8 per octave
+
 		union
 		{
 			struct
@@ -109,24 +140,207 @@ public:
 				uint64_t stores;
 				uint64_t bytes_read;
 				uint64_t bytes_written;
-				uint64_t unique_loads;
-				uint64_t unique_rows;
+				uint64_t calibration_loads;
+				uint64_t ramulator_load_cycles;
+				uint64_t fast_load_cycles;
+				uint64_t load_cycle_error;
+				uint64_t ramulator_busy_cycles; //cycles with a load in flight
+				uint64_t fast_busy_cycles;
 			};
 			uint64_t counters[NUM_COUNTERS];
 		};
+		uint64_t load_latency[LATENCY_BUCKETS];
+		HyperLogLog<> unique_loads;
+		HyperLogLog<> unique_rows;
+
+		struct Channel
+		{
+			uint64_t read_queue[QUEUE_BUCKETS]; //cycles by read buffer occupancy
+			uint64_t write_queue[QUEUE_BUCKETS];
+			uint64_t busy_banks[BANK_BUCKETS];
+			uint64_t read_queue_sum;
+			uint64_t write_queue_sum;
+		};
+
+		struct Bank
+		{
+			uint64_t row_hits;
+			uint64_t row_misses;
+			uint64_t row_conflicts;
+		};
+
+		//Indexed by the unit's channels and their banks. Logs of several units add up channel by channel.
+		std::vector<Channel> channels;
+		std::vector<Bank> banks;
+		RegionLog regions;
 
 		Log() { reset(); }
 
+		void resize(uint num_channels, uint banks_per_channel)
+		{
+			channels.resize(num_channels, Channel{});
+			banks.resize(num_channels * banks_per_channel, Bank{});
+		}
+
 		void reset()
 		{
 			for (uint i = 0; i < NUM_COUNTERS; ++i)
 				counters[i] = 0;
+
+			for (uint i = 0; i < LATENCY_BUCKETS; ++i)
+				load_latency[i] = 0;
+
+			unique_loads.reset();
+			unique_rows.reset();
+
+			for (Channel& channel : channels)
+				channel = Channel{};
+
+			for (Bank& bank : banks)
+				bank = Bank{};
+
+			regions.reset();
 		}
 
 		void accumulate(const Log& other)
 		{
 			for (uint i = 0; i < NUM_COUNTERS; ++i)
 				counters[i] += other.counters[i];
+
+			for (uint i = 0; i < LATENCY_BUCKETS; ++i)
+				load_latency[i] += other.load_latency[i];
+
+			unique_loads.merge(other.unique_loads);
+			unique_rows.merge(other.unique_rows);
+
+			if (channels.size() < other.channels.size()) channels.resize(other.channels.size(), Channel{});
+			for (uint i = 0; i < other.channels.size(); ++i)
+			{
+				for (uint j = 0; j < QUEUE_BUCKETS; ++j)
+				{
+					channels[i].read_queue[j] += other.channels[i].read_queue[j];
+					channels[i].write_queue[j] += other.channels[i].write_queue[j];
+				}
+
+				for (uint j = 0; j < BANK_BUCKETS; ++j)
+					channels[i].busy_banks[j] += other.channels[i].busy_banks[j];
+
+				channels[i].read_queue_sum += other.channels[i].read_queue_sum;
+				channels[i].write_queue_sum += other.channels[i].write_queue_sum;
+			}
+
+			if (banks.size() < other.banks.size()) banks.resize(other.banks.size(), Bank{});
+			for (uint i = 0; i < other.banks.size(); ++i)
+			{
+				banks[i].row_hits += other.banks[i].row_hits;
+				banks[i].row_misses += other.banks[i].row_misses;
+				banks[i].row_conflicts += other.banks[i].row_conflicts;
+			}
+
+			regions.accumulate(other.regions);
+		}
+
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(counters);
+			checkpoint.io(load_latency);
+			checkpoint.io(unique_loads);
+			checkpoint.io(unique_rows);
+			checkpoint.io(channels);
+			checkpoint.io(banks);
+			regions.checkpoint(checkpoint);
+		}
+
+		static uint latency_bucket(uint64_t cycles)
+		{
+			if (cycles < LATENCY_EXACT) return (uint)cycles;
+			uint octave = log2i(cycles);
+			uint bucket = LATENCY_EXACT + (octave - log2i(LATENCY_EXACT)) * 8 + (uint)((cycles >> (octave - 3)) & 0x7);
+			return std::min(bucket, LATENCY_BUCKETS - 1);
+		}
+
+		//lowest latency that falls in the bucket
+		static uint64_t latency_bucket_start(uint bucket)
+		{
+			if (bucket < LATENCY_EXACT) return bucket;
+			uint octave = log2i(LATENCY_EXACT) + (bucket - LATENCY_EXACT) / 8;
+			return (8ull + (bucket - LATENCY_EXACT) % 8) << (octave - 3);
+		}
+
+		void log_load_latency(uint64_t cycles)
+		{
+			load_latency[latency_bucket(cycles)]++;
+		}
+
+		void sample_channel(uint channel_index, uint read_queue, uint write_queue, uint queue_capacity, uint busy_banks, uint64_t cycles = 1)
+		{
+			Channel& channel = channels[channel_index];
+			channel.read_queue[read_queue == 0 ? 0 : 1 + (std::min(read_queue, queue_capacity) - 1) * (QUEUE_BUCKETS - 1) / queue_capacity] += cycles;
+			channel.write_queue[write_queue == 0 ? 0 : 1 + (std::min(write_queue, queue_capacity) - 1) * (QUEUE_BUCKETS - 1) / queue_capacity] += cycles;
+			channel.busy_banks[std::min(busy_banks, BANK_BUCKETS - 1)] += cycles;
+			channel.read_queue_sum += read_queue * cycles;
+			channel.write_queue_sum += write_queue * cycles;
+		}
+
+		uint64_t latency_percentile(double percentile) const
+		{
+			uint64_t samples = 0;
+			for (uint i = 0; i < LATENCY_BUCKETS; ++i)
+				samples += load_latency[i];
+
+			uint64_t rank = (uint64_t)std::ceil(percentile / 100.0 * samples), seen = 0;
+			for (uint i = 0; i < LATENCY_BUCKETS; ++i)
+				if ((seen += load_latency[i]) >= rank && seen > 0) return latency_bucket_start(i);
+
+			return 0;
+		}
+
+		Bank total_row_outcomes() const
+		{
+			Bank total{};
+			for (const Bank& bank : banks)
+			{
+				total.row_hits += bank.row_hits;
+				total.row_misses += bank.row_misses;
+				total.row_conflicts += bank.row_conflicts;
+			}
+			return total;
+		}
+
+		//mean banks with a request waiting over the cycles any bank has one
+		static double bank_parallelism(const uint64_t (&busy_banks)[BANK_BUCKETS])
+		{
+			uint64_t busy_cycles = 0, bank_cycles = 0;
+			for (uint i = 1; i < BANK_BUCKETS; ++i)
+			{
+				busy_cycles += busy_banks[i];
+				bank_cycles += busy_banks[i] * i;
+			}
+			return busy_cycles ? (double)bank_cycles / busy_cycles : 0.0;
+		}
+
+		void print_short()
+		{
+			Bank rows = total_row_outcomes();
+			uint64_t accesses = rows.row_hits + rows.row_misses + rows.row_conflicts;
+			if (accesses == 0) return;
+
+			Channel total{};
+			uint64_t cycles = 0;
+			for (const Channel& channel : channels)
+			{
+				for (uint i = 0; i < BANK_BUCKETS; ++i)
+				{
+					total.busy_banks[i] += channel.busy_banks[i];
+					cycles += channel.busy_banks[i];
+				}
+				total.read_queue_sum += channel.read_queue_sum;
+				total.write_queue_sum += channel.write_queue_sum;
+			}
+
+			printf("DRAM Row Hit/Miss/Conflict: %3.1f%%/%3.1f%%/%3.1f%%\n", 100.0 * rows.row_hits / accesses, 100.0 * rows.row_misses / accesses, 100.0 * rows.row_conflicts / accesses);
+			printf("DRAM Bank Parallelism: %.2f  Queue Read/Write: %.1f/%.1f\n", bank_parallelism(total.busy_banks), (double)total.read_queue_sum / cycles, (double)total.write_queue_sum / cycles);
+			printf("DRAM Load Latency p50/p99: %lld/%lld cycles\n", latency_percentile(50.0), latency_percentile(99.0));
 		}
 
 		void print(cycles_t cycles, uint units = 1)
@@ -137,16 +351,108 @@ public:
 			printf("Loads: %lld\n", loads / units);
 			printf("Stores: %lld\n", stores / units);
 			printf("\n");
-			printf("Unique Loads: %lld\n", unique_loads / units);
-			printf("Unique Rows: %lld\n", unique_rows / units);
-			printf("Unique Loads/Row: %lld\n", unique_loads / unique_rows);
+
+			double unique_load_estimate = unique_loads.estimate();
+			double unique_row_estimate = unique_rows.estimate();
+			printf("Unique Loads: ~%.0f\n", unique_load_estimate / units);
+			printf("Unique Rows: ~%.0f\n", unique_row_estimate / units);
+			printf("Unique Loads/Row: %.1f\n", unique_load_estimate / unique_row_estimate);
+
+			Bank rows = total_row_outcomes();
+			uint64_t accesses = rows.row_hits + rows.row_misses + rows.row_conflicts;
+			if (accesses > 0)
+			{
+				printf("\n");
+				printf("Row Hit/Miss/Conflict: %.1f%%/%.1f%%/%.1f%%\n", 100.0 * rows.row_hits / accesses, 100.0 * rows.row_misses / accesses, 100.0 * rows.row_conflicts / accesses);
+				printf("Load Latency p50/p90/p99/p99.9: %lld/%lld/%lld/%lld cycles\n", latency_percentile(50.0), latency_percentile(90.0), latency_percentile(99.0), latency_percentile(99.9));
+				printf("\n");
+
+				//busiest bank against the mean shows how unevenly the address mapping spreads a channel's traffic
+				uint banks_per_channel = banks.size() / channels.size();
+				printf("%8s%12s%10s%10s%10s%10s%10s%10s%10s\n", "Channel", "Accesses", "Hit", "Miss", "Conflict", "Max/Mean", "BLP", "Read Q", "Write Q");
+				for (uint i = 0; i < channels.size(); ++i)
+				{
+					const Channel& channel = channels[i];
+
+					Bank channel_rows{};
+					uint64_t max_bank_accesses = 0;
+					for (uint j = i * banks_per_channel; j < (i + 1) * banks_per_channel; ++j)
+					{
+						channel_rows.row_hits += banks[j].row_hits;
+						channel_rows.row_misses += banks[j].row_misses;
+						channel_rows.row_conflicts += banks[j].row_conflicts;
+						max_bank_accesses = std::max(max_bank_accesses, banks[j].row_hits + banks[j].row_misses + banks[j].row_conflicts);
+					}
+
+					uint64_t channel_accesses = channel_rows.row_hits + channel_rows.row_misses + channel_rows.row_conflicts;
+					uint64_t channel_cycles = 0;
+					for (uint j = 0; j < BANK_BUCKETS; ++j)
+						channel_cycles += channel.busy_banks[j];
+
+					if (channel_accesses == 0) continue;
+					printf("%8u%12lld%9.1f%%%9.1f%%%9.1f%%%10.2f%10.2f%10.1f%10.1f\n", i, channel_accesses,
+						100.0 * channel_rows.row_hits / channel_accesses, 100.0 * channel_rows.row_misses / channel_accesses, 100.0 * channel_rows.row_conflicts / channel_accesses,
+						(double)max_bank_accesses * banks_per_channel / channel_accesses, bank_parallelism(channel.busy_banks),
+						(double)channel.read_queue_sum / channel_cycles, (double)channel.write_queue_sum / channel_cycles);
+				}
+
+				Channel all{};
+				uint64_t samples = 0;
+				for (const Channel& channel : channels)
+				{
+					for (uint i = 0; i < QUEUE_BUCKETS; ++i)
+					{
+						all.read_queue[i] += channel.read_queue[i];
+						all.write_queue[i] += channel.write_queue[i];
+						samples += channel.read_queue[i];
+					}
+					for (uint i = 0; i < BANK_BUCKETS; ++i)
+						all.busy_banks[i] += channel.busy_banks[i];
+				}
+
+				if (samples)
+				{
+					printf("\n");
+					printf("Queue Occupancy (Read/Write):\n");
+					printf("  0%%: %.2f%%/%.2f%%\n", 100.0 * all.read_queue[0] / samples, 100.0 * all.write_queue[0] / samples);
+					for (uint i = 1; i < QUEUE_BUCKETS; ++i)
+						printf("  <=%.1f%%: %.2f%%/%.2f%%\n", 100.0 * i / (QUEUE_BUCKETS - 1), 100.0 * all.read_queue[i] / samples, 100.0 * all.write_queue[i] / samples);
+
+					printf("Busy Banks:\n");
+					for (uint i = 0; i < BANK_BUCKETS; ++i)
+						if (all.busy_banks[i]) printf("  %u%s: %.2f%%\n", i, i == BANK_BUCKETS - 1 ? "+" : "", 100.0 * all.busy_banks[i] / samples);
+				}
+			}
+
+			if(calibration_loads == 0) return;
+
+			//both models see the same loads so bandwidth only differs by how long each one takes to serve them
+			double ramulator_latency = (double)ramulator_load_cycles / calibration_loads;
+			double fast_latency = (double)fast_load_cycles / calibration_loads;
+			double ramulator_bandwidth = (double)bytes_read / ramulator_busy_cycles;
+			double fast_bandwidth = (double)bytes_read / fast_busy_cycles;
+			printf("\n");
+			printf("Calibration Loads: %lld\n", calibration_loads / units);
+			printf("Load Latency: %.1f fast vs %.1f ramulator cycles (%+.1f%%, %.1f cycles mean absolute error)\n", fast_latency, ramulator_latency, 100.0 * (fast_latency / ramulator_latency - 1.0), (double)load_cycle_error / calibration_loads);
+			printf("Busy Bandwidth: %.2f fast vs %.2f ramulator B/cycle (%+.1f%%)\n", fast_bandwidth, ramulator_bandwidth, 100.0 * (fast_bandwidth / ramulator_bandwidth - 1.0));
 		}
 	}
 	log;
 
 private:
+	void _tick_ramulator();
+	void _tick_controller(MemoryController& controller);
+	void _catch_up(MemoryController& controller);
+	bool _settled(const MemoryController& controller) const { return controller.idle_cycles > 0 && controller.idle_cycles >= controller.settle_cycles; }
 	bool _load(const MemoryRequest& request_item, uint channel_index);
+	bool _issue_load(paddr_t paddr, uint return_id, uint channel_index);
 	bool _store(const MemoryRequest& request_item, uint channel_index);
+	void _log_calibration(const RamulatorReturn& ramulator_return);
+	//addresses are partition relative so the partition is folded in for sketches merged across partitions
+	uint64_t _unique_key(paddr_t address) const
+	{
+		return address ^ ((uint64_t)_partition << 56);
+	}
 	paddr_t _convert_address(paddr_t address)
 	{
 		address &= ~generate_nbit_mask(log2i(CACHE_SECTOR_SIZE));
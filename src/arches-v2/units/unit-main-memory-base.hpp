@@ -47,12 +47,54 @@ public:
 		memcpy(_data_u8 + paddr, data, size);
 	}
 
+	bool functional_access(const MemoryRequest& request, MemoryReturn& ret) override
+	{
+		if(request.type == MemoryRequest::Type::STORE)
+		{
+			direct_write(request.data, request.size, request.paddr);
+			ret = MemoryReturn(request);
+		}
+		else if(request.type == MemoryRequest::Type::LOAD)
+		{
+			ret = MemoryReturn(request, _data_u8 + request.paddr);
+		}
+		else _assert(false);
+		return true;
+	}
+
 	void dump_as_png_uint8(paddr_t from_paddr, size_t width, size_t height, std::string const& path)
 	{
 		uint8_t const* src = _data_u8 + from_paddr;
 		stbi_flip_vertically_on_write(true);
 		stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, src, 0);
 	}
+
+protected:
+	//Only pages with non zero data are saved since most of the backing store is never touched
+	void _checkpoint_memory(Checkpoint& checkpoint)
+	{
+		const size_t page_size = 4096;
+
+		std::vector<uint64_t> pages;
+		if(checkpoint.saving())
+		{
+			for(size_t offset = 0; offset < size_bytes; offset += page_size)
+			{
+				size_t size = std::min(page_size, size_bytes - offset);
+				for(size_t i = 0; i < size; ++i)
+					if(_data_u8[offset + i])
+					{
+						pages.push_back(offset);
+						break;
+					}
+			}
+		}
+		else clear();
+
+		checkpoint.io(pages);
+		for(uint64_t offset : pages)
+			checkpoint.io_bytes(_data_u8 + offset, std::min(page_size, size_bytes - offset));
+	}
 };
 
 }}
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "unit-base.hpp"
 #include "simulator/interconnects.hpp"
 #include "simulator/transactions.hpp"
+#include "util/address-hash.hpp"
 
 namespace Arches { namespace Units {
 
@@ -14,14 +15,15 @@ public:
 	class RequestCrossBar : public CasscadedCrossBar<MemoryRequest>
 	{
 	private:
-		uint _stride;
+		AddressHash _hash;
 
 	public:
-		RequestCrossBar(uint ports, uint banks, uint stride, uint width = 64) : CasscadedCrossBar<MemoryRequest>(ports, banks, width, width, 64, 64), _stride(stride) {}
+		RequestCrossBar(uint ports, uint banks, uint stride, uint width = 64, const AddressHash::Configuration& hash = AddressHash::Configuration()) :
+			CasscadedCrossBar<MemoryRequest>(ports, banks, width, width, 64, 64), _hash(banks, stride, hash) {}
 
 		uint get_sink(const MemoryRequest& request) override
 		{
-			uint bank = (request.paddr / _stride) % num_sinks();
+			uint bank = _hash.index(request.paddr);
 			_assert(bank < num_sinks());
 			return bank;
 		}
@@ -66,6 +68,15 @@ public:
 	virtual bool return_port_read_valid(uint port_index) = 0;
 	virtual const MemoryReturn& peek_return(uint port_index) = 0;
 	virtual const MemoryReturn read_return(uint port_index) = 0;
+
+	//Sampled simulation fast forward. Services the request immediately with no timing and fills ret for anything that
+	//returns data. Returns false if the unit can't take the request right now, the caller retries next cycle. Units on
+	//the path of a fast forwarded request have to override this.
+	virtual bool functional_access(const MemoryRequest& request, MemoryReturn& ret)
+	{
+		_assert(false);
+		return false;
+	}
 };
 
 class MemoryMap
@@ -0,0 +1,613 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "util/bit-manipulation.hpp"
+#include "util/ring-buffer.hpp"
+#include "simulator/transaction-pool.hpp"
+#include "unit-crossbar.hpp"
+
+namespace Arches { namespace Units {
+
+//Network on chip between the clients and the memory partition slices. Routers sit on a 2D mesh with XY routing or on a
+//bidirectional ring with shortest path routing, clients and slices are spread evenly over the routers. Requests and
+//returns travel on separate physical networks so they can't deadlock each other.
+//Packets move through routers whole (virtual cut through). Each network input has num_vcs virtual channels of vc_depth
+//flits, upstream routers track free flits with credits that come back the cycle after a packet leaves the buffer. A
+//packet takes link_latency + router_latency cycles per hop and holds its output link for one cycle per flit. The ring
+//splits its virtual channels in two around a dateline on the wrap link to stay deadlock free.
+class UnitNoC : public UnitPartitionInterconnect
+{
+public:
+	enum class Topology : uint8_t
+	{
+		MESH,
+		RING,
+	};
+
+	struct Configuration : UnitPartitionInterconnect::Configuration
+	{
+		Topology topology{Topology::MESH};
+		uint num_routers{16};
+		uint mesh_width{4};
+		uint router_latency{2};
+		uint link_latency{1};
+		uint link_width{32}; //bytes per flit
+		uint num_vcs{2};
+		uint vc_depth{8}; //flits
+		uint endpoint_depth{8}; //packets in each injection and ejection queue
+
+		Configuration() = default;
+		Configuration(const UnitPartitionInterconnect::Configuration& config) : UnitPartitionInterconnect::Configuration(config) {}
+	};
+
+	class Log
+	{
+	public:
+		const static uint NUM_COUNTERS = 5;
+		union
+		{
+			struct
+			{
+				uint64_t packets;
+				uint64_t flits;
+				uint64_t hops;
+				uint64_t latency;
+				uint64_t link_flits;
+			};
+			uint64_t counters[NUM_COUNTERS];
+		};
+
+		Log() { reset(); }
+
+		void reset()
+		{
+			for(uint i = 0; i < NUM_COUNTERS; ++i)
+				counters[i] = 0;
+		}
+
+		void accumulate(const Log& other)
+		{
+			for(uint i = 0; i < NUM_COUNTERS; ++i)
+				counters[i] += other.counters[i];
+		}
+
+		void print(cycles_t cycles, uint num_links)
+		{
+			printf("Packets: %lld\n", packets);
+			printf("Avg Latency: %.2f cycles\n", (double)latency / std::max(packets, (uint64_t)1));
+			printf("Avg Hops: %.2f\n", (double)hops / std::max(packets, (uint64_t)1));
+			printf("Avg Flits: %.2f\n", (double)flits / std::max(packets, (uint64_t)1));
+			printf("Link Utilization: %.2f%%\n", 100.0 * link_flits / std::max((uint64_t)num_links * cycles, (uint64_t)1));
+		}
+	};
+
+private:
+	constexpr static uint HEADER_SIZE = 8;
+	constexpr static uint MESH_PORTS = 4; //+x, -x, +y, -y
+	constexpr static uint RING_PORTS = 2; //+1, -1
+
+	template<typename T>
+	class Network
+	{
+	private:
+		typedef TransactionPool<T> Pool;
+
+		struct Packet
+		{
+			typename Pool::Handle handle;
+			cycles_t ready_cycle;
+			cycles_t inject_cycle;
+			uint16_t dst_router;
+			uint16_t dst_output;
+			uint8_t flits;
+			uint8_t vc_class;
+			uint8_t hops;
+		};
+
+		struct Output
+		{
+			uint router{~0u}; //downstream router or ~0u for an ejection port or a missing mesh edge link
+			uint input{~0u};
+			uint sink{~0u};
+			std::vector<uint> credits; //free flits of each downstream virtual channel
+			cycles_t busy_until{0};
+			uint8_t priority{0};
+		};
+
+		struct Router
+		{
+			std::vector<std::vector<RingBuffer<Packet>>> inputs; //network inputs first then one injection queue per source
+			std::vector<Output> outputs; //network outputs first then one ejection port per sink
+			uint network_packets{0};
+		};
+
+		struct Credit
+		{
+			uint router;
+			uint output;
+			uint vc;
+			uint flits;
+		};
+
+		Configuration _config;
+		uint _num_ports;
+		std::vector<Router> _routers;
+		std::vector<uint> _source_routers, _source_inputs;
+		std::vector<uint> _sink_routers, _sink_outputs;
+		std::vector<RingBuffer<Packet>> _ejection_queues;
+		uint _ejection_occupancy{0}; //counted at the end of clock() since sinks on other threads pop the ejection queues
+		std::vector<Credit> _returned_credits;
+		std::vector<uint64_t> _requests; //scratch, per output the input vcs requesting it
+
+		uint _route(uint router_index, const Packet& packet) const
+		{
+			if(router_index == packet.dst_router) return packet.dst_output;
+
+			if(_config.topology == Topology::MESH)
+			{
+				uint x = router_index % _config.mesh_width, y = router_index / _config.mesh_width;
+				uint dst_x = packet.dst_router % _config.mesh_width, dst_y = packet.dst_router / _config.mesh_width;
+				if(dst_x != x) return dst_x > x ? 0 : 1;
+				return dst_y > y ? 2 : 3;
+			}
+
+			uint clockwise_distance = (packet.dst_router + _config.num_routers - router_index) % _config.num_routers;
+			return clockwise_distance <= _config.num_routers / 2 ? 0 : 1;
+		}
+
+		//ring packets switch to the upper half of the virtual channels once they cross the wrap link
+		uint _next_vc_class(uint router_index, uint output_index, uint vc_class) const
+		{
+			if(_config.topology != Topology::RING) return vc_class;
+			if(output_index == 0 && router_index == _config.num_routers - 1) return 1;
+			if(output_index == 1 && router_index == 0) return 1;
+			return vc_class;
+		}
+
+		//downstream virtual channel with the most credits that fits the packet or ~0u
+		uint _select_vc(const Output& output, uint vc_class, uint flits) const
+		{
+			uint first_vc = 0, last_vc = _config.num_vcs;
+			if(_config.topology == Topology::RING)
+			{
+				first_vc = vc_class ? _config.num_vcs / 2 : 0;
+				last_vc = vc_class ? _config.num_vcs : _config.num_vcs / 2;
+			}
+
+			uint best_vc = ~0u;
+			for(uint vc = first_vc; vc < last_vc; ++vc)
+				if(output.credits[vc] >= flits && (best_vc == ~0u || output.credits[vc] > output.credits[best_vc]))
+					best_vc = vc;
+			return best_vc;
+		}
+
+		void _checkpoint_queue(Checkpoint& checkpoint, RingBuffer<Packet>& queue)
+		{
+			uint size = queue.size();
+			checkpoint.io(size);
+			if(checkpoint.restoring())
+			{
+				for(; !queue.empty(); queue.pop())
+					Pool::free(queue.front().handle);
+			}
+
+			for(uint i = 0; i < size; ++i)
+			{
+				Packet packet;
+				T transaction;
+				if(checkpoint.saving())
+				{
+					packet = queue[i];
+					transaction = Pool::get(packet.handle);
+				}
+
+				checkpoint.io_bytes(&packet, sizeof(Packet));
+				checkpoint.io(transaction);
+
+				if(checkpoint.restoring())
+				{
+					packet.handle = Pool::allocate(transaction);
+					queue.push(packet);
+				}
+			}
+		}
+
+	public:
+		Log log;
+
+		Network(const Configuration& config, const std::vector<uint>& source_routers, const std::vector<uint>& sink_routers) :
+			_config(config), _num_ports(config.topology == Topology::MESH ? MESH_PORTS : RING_PORTS), _routers(config.num_routers),
+			_source_routers(source_routers), _source_inputs(source_routers.size()), _sink_routers(sink_routers), _sink_outputs(sink_routers.size()),
+			_ejection_queues(sink_routers.size(), RingBuffer<Packet>(config.endpoint_depth))
+		{
+			for(uint i = 0; i < _routers.size(); ++i)
+			{
+				Router& router = _routers[i];
+				router.inputs.resize(_num_ports, std::vector<RingBuffer<Packet>>(_config.num_vcs, RingBuffer<Packet>(_config.vc_depth)));
+				router.outputs.resize(_num_ports);
+
+				for(uint port = 0; port < _num_ports; ++port)
+				{
+					uint neighbor = ~0u;
+					if(_config.topology == Topology::MESH)
+					{
+						uint x = i % _config.mesh_width, y = i / _config.mesh_width, height = _config.num_routers / _config.mesh_width;
+						if(port == 0 && x + 1 < _config.mesh_width) neighbor = i + 1;
+						if(port == 1 && x > 0)                      neighbor = i - 1;
+						if(port == 2 && y + 1 < height)             neighbor = i + _config.mesh_width;
+						if(port == 3 && y > 0)                      neighbor = i - _config.mesh_width;
+					}
+					else if(_config.num_routers > 1)
+					{
+						neighbor = (i + (port == 0 ? 1 : _config.num_routers - 1)) % _config.num_routers;
+					}
+
+					//packets arrive on the port facing back the way they came
+					router.outputs[port].router = neighbor;
+					router.outputs[port].input = port ^ 0x1;
+					router.outputs[port].credits.resize(_config.num_vcs, _config.vc_depth);
+				}
+			}
+
+			for(uint source = 0; source < _source_routers.size(); ++source)
+			{
+				Router& router = _routers[_source_routers[source]];
+				_source_inputs[source] = router.inputs.size();
+				router.inputs.emplace_back(1, RingBuffer<Packet>(_config.endpoint_depth));
+			}
+
+			for(uint sink = 0; sink < _sink_routers.size(); ++sink)
+			{
+				Router& router = _routers[_sink_routers[sink]];
+				_sink_outputs[sink] = router.outputs.size();
+				router.outputs.emplace_back();
+				router.outputs.back().sink = sink;
+			}
+
+			uint max_outputs = 0;
+			for(Router& router : _routers)
+			{
+				_assert(router.inputs.size() * _config.num_vcs <= 64);
+				max_outputs = std::max<uint>(max_outputs, router.outputs.size());
+			}
+			_requests.resize(max_outputs);
+		}
+
+		~Network()
+		{
+			for(Router& router : _routers)
+				for(auto& input : router.inputs)
+					for(RingBuffer<Packet>& queue : input)
+						for(; !queue.empty(); queue.pop())
+							Pool::free(queue.front().handle);
+
+			for(RingBuffer<Packet>& queue : _ejection_queues)
+				for(; !queue.empty(); queue.pop())
+					Pool::free(queue.front().handle);
+		}
+
+		uint num_links() const
+		{
+			uint links = 0;
+			for(const Router& router : _routers)
+				for(uint port = 0; port < _num_ports; ++port)
+					links += router.outputs[port].router != ~0u;
+			return links;
+		}
+
+		//Source interface. Only the NoC injects, on its own clock, so the injection queues are never touched by other threads.
+		bool can_inject(uint source) const
+		{
+			return !_routers[_source_routers[source]].inputs[_source_inputs[source]][0].full();
+		}
+
+		void inject(const T& transaction, uint source, uint sink, uint flits, cycles_t cycle)
+		{
+			_assert(flits <= _config.vc_depth);
+
+			Packet packet;
+			packet.handle = Pool::allocate(transaction);
+			packet.ready_cycle = cycle + _config.router_latency;
+			packet.inject_cycle = cycle;
+			packet.dst_router = _sink_routers[sink];
+			packet.dst_output = _sink_outputs[sink];
+			packet.flits = flits;
+			packet.vc_class = 0;
+			packet.hops = 0;
+			_routers[_source_routers[source]].inputs[_source_inputs[source]][0].push(packet);
+		}
+
+		//Sink interface. Each sink only touches its own ejection queue so sinks can run on any thread.
+		bool can_eject(uint sink) const
+		{
+			return !_ejection_queues[sink].empty();
+		}
+
+		const T& peek(uint sink)
+		{
+			return Pool::get(_ejection_queues[sink].front().handle);
+		}
+
+		T eject(uint sink)
+		{
+			typename Pool::Handle handle = _ejection_queues[sink].front().handle;
+			T transaction = Pool::get(handle);
+			Pool::free(handle);
+			_ejection_queues[sink].pop();
+			return transaction;
+		}
+
+		//Ejected packets count as of the last clock(), sinks popping them since only makes this conservative
+		bool empty() const
+		{
+			if(_ejection_occupancy) return false;
+			for(const Router& router : _routers)
+			{
+				if(router.network_packets) return false;
+				for(uint input = _num_ports; input < router.inputs.size(); ++input)
+					if(!router.inputs[input][0].empty()) return false;
+			}
+
+			return true;
+		}
+
+		void clock(cycles_t cycle)
+		{
+			for(const Credit& credit : _returned_credits)
+				_routers[credit.router].outputs[credit.output].credits[credit.vc] += credit.flits;
+			_returned_credits.clear();
+
+			for(uint router_index = 0; router_index < _routers.size(); ++router_index)
+			{
+				Router& router = _routers[router_index];
+
+				//route the ready head of every input virtual channel
+				bool requesting = false;
+				for(uint output = 0; output < router.outputs.size(); ++output)
+					_requests[output] = 0;
+
+				uint first_input = router.network_packets ? 0 : _num_ports;
+				for(uint input = first_input; input < router.inputs.size(); ++input)
+				{
+					for(uint vc = 0; vc < router.inputs[input].size(); ++vc)
+					{
+						RingBuffer<Packet>& queue = router.inputs[input][vc];
+						if(queue.empty() || queue.front().ready_cycle > cycle) continue;
+
+						_requests[_route(router_index, queue.front())] |= 0x1ull << (input * _config.num_vcs + vc);
+						requesting = true;
+					}
+				}
+				if(!requesting) continue;
+
+				//each output takes one packet per cycle round robin and each input sends at most one packet per cycle
+				uint64_t inputs_used = 0;
+				uint64_t vc_mask = generate_nbit_mask(_config.num_vcs);
+				for(uint output_index = 0; output_index < router.outputs.size(); ++output_index)
+				{
+					Output& output = router.outputs[output_index];
+					uint64_t requests = _requests[output_index] & ~inputs_used;
+					if(!requests || output.busy_until > cycle) continue;
+					if(output.sink != ~0u && _ejection_queues[output.sink].full()) continue;
+
+					while(requests)
+					{
+						uint index = (output.priority + ctz(rotr(requests, output.priority))) % 64;
+						uint input = index / _config.num_vcs, vc = index % _config.num_vcs;
+						RingBuffer<Packet>& queue = router.inputs[input][vc];
+						Packet packet = queue.front();
+
+						uint next_vc = 0;
+						if(output.sink == ~0u)
+						{
+							packet.vc_class = _next_vc_class(router_index, output_index, packet.vc_class);
+							next_vc = _select_vc(output, packet.vc_class, packet.flits);
+							if(next_vc == ~0u)
+							{
+								requests &= ~(0x1ull << index);
+								continue;
+							}
+						}
+
+						queue.pop();
+						output.priority = (index + 1) % 64;
+						output.busy_until = cycle + packet.flits;
+						inputs_used |= vc_mask << (input * _config.num_vcs);
+
+						if(input < _num_ports)
+						{
+							//the upstream router is the neighbor on the input's side and sent through its opposite port
+							router.network_packets--;
+							_returned_credits.push_back({router.outputs[input].router, input ^ 0x1, vc, packet.flits});
+						}
+
+						if(output.sink != ~0u)
+						{
+							log.packets++;
+							log.flits += packet.flits;
+							log.hops += packet.hops;
+							log.latency += cycle - packet.inject_cycle;
+							_ejection_queues[output.sink].push(packet);
+						}
+						else
+						{
+							output.credits[next_vc] -= packet.flits;
+							log.link_flits += packet.flits;
+							packet.hops++;
+							packet.ready_cycle = cycle + _config.link_latency + _config.router_latency;
+
+							Router& downstream = _routers[output.router];
+							downstream.inputs[output.input][next_vc].push(packet);
+							downstream.network_packets++;
+						}
+						break;
+					}
+				}
+			}
+
+			_ejection_occupancy = 0;
+			for(const RingBuffer<Packet>& queue : _ejection_queues)
+				_ejection_occupancy += queue.size();
+		}
+
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			for(Router& router : _routers)
+			{
+				for(auto& input : router.inputs)
+					for(RingBuffer<Packet>& queue : input)
+						_checkpoint_queue(checkpoint, queue);
+
+				for(Output& output : router.outputs)
+				{
+					checkpoint.io(output.credits);
+					checkpoint.io(output.busy_until);
+					checkpoint.io(output.priority);
+				}
+				checkpoint.io(router.network_packets);
+			}
+
+			for(RingBuffer<Packet>& queue : _ejection_queues)
+				_checkpoint_queue(checkpoint, queue);
+
+			checkpoint.io(_returned_credits);
+			checkpoint.io(_ejection_occupancy);
+			checkpoint.io(log);
+		}
+	};
+
+	Configuration _config;
+	FIFOArray<MemoryRequest> _client_requests; //clients write here so their writes are counted and wake the NoC
+	Network<MemoryRequest> _request_network;
+	Network<MemoryReturn> _return_network;
+
+	static std::vector<uint> _place(uint endpoints, uint routers, uint offset)
+	{
+		std::vector<uint> placement(endpoints);
+		for(uint i = 0; i < endpoints; ++i)
+			placement[i] = (i * routers / endpoints + offset) % routers;
+		return placement;
+	}
+
+	uint _flits(uint payload)
+	{
+		return (HEADER_SIZE + payload + _config.link_width - 1) / _config.link_width;
+	}
+
+public:
+	//clients spread from the first router and slices from half a spacing in so they don't crowd the same routers
+	UnitNoC(const Configuration& config) : UnitPartitionInterconnect(config), _config(config), _client_requests(config.num_clients, config.endpoint_depth),
+		_request_network(config, _place(config.num_clients, config.num_routers, 0), _place(config.num_partitions * config.num_slices, config.num_routers, config.num_routers / (config.num_partitions * config.num_slices) / 2)),
+		_return_network(config, _place(config.num_partitions * config.num_slices, config.num_routers, config.num_routers / (config.num_partitions * config.num_slices) / 2), _place(config.num_clients, config.num_routers, 0))
+	{
+		_assert(config.num_routers > 0);
+		_assert(config.topology != Topology::MESH || config.num_routers % config.mesh_width == 0);
+		_assert(config.topology != Topology::RING || config.num_vcs >= 2);
+		_assert(_flits(MemoryRequest::MAX_SIZE) <= config.vc_depth);
+		_client_requests.set_owner(this);
+	}
+
+	void clock_rise() override
+	{
+		_client_requests.clock();
+		for(uint i = 0; i < _config.num_clients; ++i)
+		{
+			if(!_client_requests.is_read_valid(i) || !_request_network.can_inject(i)) continue;
+
+			const MemoryRequest& request = _client_requests.peek(i);
+			bool has_payload = request.type != MemoryRequest::Type::LOAD && request.type != MemoryRequest::Type::PREFECTH;
+			_request_network.inject(request, i, get_slice(request.paddr), _flits(has_payload ? request.size : 0), simulator->current_cycle);
+			_client_requests.read(i);
+		}
+
+		_request_network.clock(simulator->current_cycle);
+
+		for(uint i = 0; i < _num_partitions * _num_slices; ++i)
+		{
+			uint partition = i / _num_slices;
+			uint slice = i % _num_slices;
+			if(!_mem_highers[partition]->return_port_read_valid(slice) || !_return_network.can_inject(i)) continue;
+
+			MemoryReturn ret = _mem_highers[partition]->read_return(slice);
+			ret.paddr = inject_partition_bits(ret.paddr, partition);
+			ret.port = ret.dst.pop(9);
+			_return_network.inject(ret, i, ret.port, _flits(ret.size), simulator->current_cycle);
+		}
+	}
+
+	void clock_fall() override
+	{
+		for(uint i = 0; i < _num_partitions * _num_slices; ++i)
+		{
+			uint partition = i / _num_slices;
+			uint slice = i % _num_slices;
+			if(!_request_network.can_eject(i) || !_mem_highers[partition]->request_port_write_valid(slice)) continue;
+
+			MemoryRequest request = _request_network.eject(i);
+			_slice_requests[i]++;
+			request.paddr = strip_partition_bits(request.paddr);
+			request.dst.push(request.port, 9);
+			request.port = slice;
+			_mem_highers[partition]->write_request(request);
+		}
+
+		_return_network.clock(simulator->current_cycle);
+	}
+
+	//Only reads state the NoC owns or recounts on its own clock since clients use their ports during this phase. Returns
+	//waiting in an ejection queue keep the NoC at the next cycle so a skip can't jump past a client that has yet to see them.
+	cycles_t next_event_cycle() override
+	{
+		if(!_client_requests.empty() || !_request_network.empty() || !_return_network.empty())
+			return simulator->current_cycle + 1;
+
+		return Simulator::NO_EVENT;
+	}
+
+	bool checkpoint(Checkpoint& checkpoint) override
+	{
+		_client_requests.checkpoint(checkpoint);
+		_request_network.checkpoint(checkpoint);
+		_return_network.checkpoint(checkpoint);
+		checkpoint.io(_slice_requests);
+		return true;
+	}
+
+	void print_stats(cycles_t cycles) override
+	{
+		printf("Request Network\n");
+		_request_network.log.print(cycles, _request_network.num_links());
+		printf("\nReturn Network\n");
+		_return_network.log.print(cycles, _return_network.num_links());
+		printf("\n");
+		print_balance();
+	}
+
+	//clients write on clock fall, the request network picks the packet up from the next clock rise
+	bool request_port_write_valid(uint port_index) override
+	{
+		return _client_requests.is_write_valid(port_index);
+	}
+
+	void write_request(const MemoryRequest& request) override
+	{
+		_client_requests.write(request, request.port);
+	}
+
+	bool return_port_read_valid(uint port_index) override
+	{
+		return _return_network.can_eject(port_index);
+	}
+
+	const MemoryReturn& peek_return(uint port_index) override
+	{
+		return _return_network.peek(port_index);
+	}
+
+	const MemoryReturn read_return(uint port_index) override
+	{
+		return _return_network.eject(port_index);
+	}
+};
+
+}}
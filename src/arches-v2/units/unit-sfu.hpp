@@ -30,6 +30,7 @@ public:
 	UnitSFU(uint num_piplines, uint latency, uint cpi, uint num_clients) :
 		request_crossbar(num_clients, num_piplines), return_crossbar(num_piplines, num_clients), piplines(num_piplines, {latency})
 	{
+		request_crossbar.set_owner(this);
 	}
 
 	//Should only be used on clock fall
@@ -87,6 +88,45 @@ public:
 		}
 
 		return_crossbar.clock();
+
+		if(request_crossbar.empty() && return_crossbar.empty() && _piplines_empty())
+			sleep();
+	}
+
+	cycles_t next_event_cycle() override
+	{
+		if(!request_crossbar.empty() || !return_crossbar.empty())
+			return simulator->current_cycle + 1;
+
+		//piplines are read before they are clocked on fall so an entry needs one more cycle than its remaining latency
+		cycles_t next_event = Simulator::NO_EVENT;
+		for(uint pipline_index = 0; pipline_index < piplines.size(); ++pipline_index)
+			if(!piplines[pipline_index].empty())
+				next_event = std::min(next_event, simulator->current_cycle + 1 + piplines[pipline_index].cycles_until_read_valid());
+
+		return next_event;
+	}
+
+	void skip_cycles(cycles_t cycles) override
+	{
+		for(uint pipline_index = 0; pipline_index < piplines.size(); ++pipline_index)
+			piplines[pipline_index].skip(cycles);
+	}
+
+	bool checkpoint(Checkpoint& checkpoint) override
+	{
+		checkpoint.io(request_crossbar);
+		checkpoint.io(piplines);
+		checkpoint.io(return_crossbar);
+		return true;
+	}
+
+private:
+	bool _piplines_empty()
+	{
+		for(uint pipline_index = 0; pipline_index < piplines.size(); ++pipline_index)
+			if(!piplines[pipline_index].empty()) return false;
+		return true;
 	}
 };
 
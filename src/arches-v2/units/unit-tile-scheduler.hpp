@@ -96,6 +96,27 @@ public:
 		_return_network.clock();
 	}
 
+	//While stalled the atomic regfile reports the return as its own event
+	cycles_t next_event_cycle() override
+	{
+		if(!_request_network.empty() || !_return_network.empty() || (_current_request_valid && !_stalled_for_atomic_reg))
+			return simulator->current_cycle + 1;
+
+		return Simulator::NO_EVENT;
+	}
+
+	bool checkpoint(Checkpoint& checkpoint) override
+	{
+		checkpoint.io(_request_network);
+		checkpoint.io(_return_network);
+		checkpoint.io(_current_request_valid);
+		checkpoint.io(_current_request);
+		checkpoint.io(_stalled_for_atomic_reg);
+		checkpoint.io(_current_block);
+		checkpoint.io(_current_offset);
+		return true;
+	}
+
 	bool request_port_write_valid(uint port_index) override
 	{
 		return _request_network.is_write_valid(port_index);
@@ -120,6 +141,32 @@ public:
 	{
 		return _return_network.read(port_index);
 	}
+
+	//Hands out indices from the same blocks as the detailed path. A request already in flight owns the block counters so
+	//functional requests wait for it.
+	bool functional_access(const MemoryRequest& request, MemoryReturn& ret) override
+	{
+		if(_stalled_for_atomic_reg || _current_request_valid) return false;
+
+		if(_current_offset == _block_size)
+		{
+			MemoryRequest block_request;
+			block_request.type = MemoryRequest::Type::AMO_ADD;
+			block_request.size = sizeof(uint32_t);
+			block_request.port = _tm_index;
+			block_request.paddr = 0x0ull;
+			block_request.data_u32 = _block_size;
+
+			MemoryReturn block_return;
+			if(!_atomic_regs->functional_access(block_request, block_return)) return false;
+			_current_block = block_return.data_u32;
+			_current_offset = 0;
+		}
+
+		uint32_t index = _current_block + _current_offset++;
+		ret = MemoryReturn(request, &index);
+		return true;
+	}
 };
 
 }
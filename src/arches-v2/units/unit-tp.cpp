@@ -12,17 +12,19 @@ namespace Units {
 #endif
 
 UnitTP::UnitTP(const Configuration& config) :
-	_unit_table(*config.unit_table), 
-	_unique_mems(*config.unique_mems), 
-	_unique_sfus(*config.unique_sfus), 
+	_tp_index(config.tp_index),
+	_tm_index(config.tm_index),
+	_num_tps_per_i_cache(config.num_tps_per_i_cache),
+	_stack_mask(generate_nbit_mask(log2i(config.stack_size))),
+	_store_omit_cache(config.store_omit_cache),
+	_amo_omit_cache(config.amo_omit_cache),
 	_cheat_memory(config.cheat_memory),
 	_num_threads(config.num_threads), 
 	_thread_exec_arbiter(config.num_threads),
 	_thread_data(config.num_threads),
-	_stack_mask(generate_nbit_mask(log2i(config.stack_size))),
-	_tp_index(config.tp_index),
-	_tm_index(config.tm_index),
-	_num_tps_per_i_cache(config.num_tps_per_i_cache),
+	_unit_table(*config.unit_table), 
+	_unique_sfus(*config.unique_sfus), 
+	_unique_mems(*config.unique_mems), 
 	log()
 {
 	for(uint i = 0; i < _thread_data.size(); i++)
@@ -63,6 +65,17 @@ void UnitTP::reset()
 	simulator->units_executing++;
 }
 
+bool UnitTP::checkpoint(Checkpoint& checkpoint)
+{
+	checkpoint.io(_last_thread_id);
+	checkpoint.io(_num_halted_threads);
+	checkpoint.io(_thread_exec_arbiter);
+	checkpoint.io(_thread_data);
+	checkpoint.io(coalescing_buffer);
+	checkpoint.io(log);
+	return true;
+}
+
 void UnitTP::set_entry_point(uint64_t entry_point)
 {
 	for(uint i = 0; i < _thread_data.size(); i++)
@@ -157,6 +170,17 @@ uint8_t UnitTP::_check_dependancies(uint thread_id)
 	return 0;
 }
 
+bool UnitTP::_returns_pending()
+{
+	for(uint thread_id = 0; thread_id < _thread_data.size(); ++thread_id)
+	{
+		ThreadData& thread = _thread_data[thread_id];
+		for(uint i = 0; i < 32; ++i)
+			if((i != 0 && thread.int_regs_pending[i]) || thread.float_regs_pending[i]) return true;
+	}
+	return false;
+}
+
 void UnitTP::_set_dependancies(uint thread_id)
 {
 	ThreadData& thread = _thread_data[thread_id];
@@ -254,10 +278,33 @@ void UnitTP::clock_rise()
 		ISA::RISCV::DstReg dst_reg(ret.dst.pop(9));
 		_clear_register_pending(thread_id, dst_reg);
 	}
+
+	//Once every thread has halted and drained its returns nothing can wake us since we have no input ports
+	if(_num_halted_threads == _num_threads && !_returns_pending())
+		sleep();
+}
+
+//With no thread ready clock fall only logs a data stall against the last thread until a return arrives, and whoever
+//sends the return reports that as its own event
+cycles_t UnitTP::next_event_cycle()
+{
+	if(_thread_exec_arbiter.num_pending() == 0 && _check_dependancies(_last_thread_id) != 0)
+		return Simulator::NO_EVENT;
+
+	return simulator->current_cycle + 1;
+}
+
+void UnitTP::skip_cycles(cycles_t cycles)
+{
+	ThreadData& thread = _thread_data[_last_thread_id];
+	log.log_data_stall((ISA::RISCV::InstrType)_check_dependancies(_last_thread_id), thread.pc, cycles);
 }
 
 void UnitTP::clock_fall()
 {
+	//instructions are executed by functional_step() between steps while fast forwarding
+	if(simulator->fast_forward) return;
+
 	uint thread_id = _thread_exec_arbiter.get_index();
 	if(thread_id == ~0u) thread_id = _last_thread_id;
 	ThreadData& thread = _thread_data[thread_id];
@@ -335,31 +382,44 @@ void UnitTP::clock_fall()
 			req.dst.push(thread_id, 4);
 			req.port = _tp_index;
 			if(thread.instr_info.instr_type == ISA::RISCV::InstrType::STORE)
-				req.flags.omit_cache = 0b111;
+				req.flags.omit_cache = _store_omit_cache;
+			else if(thread.instr_info.instr_type == ISA::RISCV::InstrType::ATOMIC)
+				req.flags.omit_cache = _amo_omit_cache;
 			_set_dependancies(thread_id);
 
 			UnitMemoryBase* mem = (UnitMemoryBase*)_unit_table[(uint)thread.instr_info.instr_type];
 			mem->write_request(req);
 		}
-		else
-		{
-			if ((req.vaddr | _stack_mask) != ~0x0ull) printf("STACK OVERFLOW!!!\n"), _assert(false);
-			if (thread.instr_info.instr_type == ISA::RISCV::InstrType::LOAD)
-			{
-				//Because of forwarding instruction with latency 1 don't cause stalls so we don't need to set pending bit
-				paddr_t buffer_addr = req.vaddr & _stack_mask;
-				write_register(&thread.int_regs, &thread.float_regs, req.dst.pop(9), &thread.stack_mem[buffer_addr]);
-			}
-			else if (thread.instr_info.instr_type == ISA::RISCV::InstrType::STORE)
-			{
-				paddr_t buffer_addr = req.vaddr & _stack_mask;
-				std::memcpy(&thread.stack_mem[buffer_addr], req.data, req.size);
-			}
-			else _assert(false);
-		}
+		else _stack_access(thread_id, req);
 	}
 	else _assert(false);
 
+	_advance_thread(thread_id, jump);
+	_last_thread_id = thread_id;
+}
+
+void UnitTP::_stack_access(uint thread_id, MemoryRequest& req)
+{
+	ThreadData& thread = _thread_data[thread_id];
+	if ((req.vaddr | _stack_mask) != ~0x0ull) printf("STACK OVERFLOW!!!\n"), _assert(false);
+	if (thread.instr_info.instr_type == ISA::RISCV::InstrType::LOAD)
+	{
+		//Because of forwarding instruction with latency 1 don't cause stalls so we don't need to set pending bit
+		paddr_t buffer_addr = req.vaddr & _stack_mask;
+		write_register(&thread.int_regs, &thread.float_regs, req.dst.pop(9), &thread.stack_mem[buffer_addr]);
+	}
+	else if (thread.instr_info.instr_type == ISA::RISCV::InstrType::STORE)
+	{
+		paddr_t buffer_addr = req.vaddr & _stack_mask;
+		std::memcpy(&thread.stack_mem[buffer_addr], req.data, req.size);
+	}
+	else _assert(false);
+}
+
+//Moves the thread to its next instruction after an issue and halts it once it returns to 0
+void UnitTP::_advance_thread(uint thread_id, bool jump)
+{
+	ThreadData& thread = _thread_data[thread_id];
 	if(!jump) thread.pc += 4;
 	thread.int_regs.zero.u64 = 0x0ull; //Compilers generate instructions with zero register as target so we need to zero the register every cycle
 
@@ -377,8 +437,62 @@ void UnitTP::clock_fall()
 		if(_check_dependancies(thread_id) != 0)
 			_thread_exec_arbiter.remove(thread_id);
 	}
+}
 
-	_last_thread_id = thread_id;
+//Every ready thread executes one instruction with no timing. Memory goes through functional_access() so the caches on
+//the way stay warm. Threads still waiting on a return from the last detailed interval sit out until it arrives.
+void UnitTP::functional_step()
+{
+	for(uint thread_id = 0; thread_id < _num_threads; ++thread_id)
+	{
+		ThreadData& thread = _thread_data[thread_id];
+		if(thread.pc == 0x0ull || _check_dependancies(thread_id) != 0) continue;
+
+		ISA::RISCV::ExecutionItem exec_item = {thread.pc, &thread.int_regs, &thread.float_regs};
+
+		bool jump = false;
+		if (thread.instr_info.exec_type == ISA::RISCV::ExecType::CONTROL_FLOW)
+		{
+			if(thread.instr_info.execute_branch(exec_item, thread.instr))
+			{
+				jump = true;
+				thread.pc = exec_item.pc;
+			}
+		}
+		else if (thread.instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
+		{
+			thread.instr_info.execute(exec_item, thread.instr);
+		}
+		else if (thread.instr_info.exec_type == ISA::RISCV::ExecType::MEMORY)
+		{
+			MemoryRequest req = thread.instr_info.generate_request(exec_item, thread.instr);
+			if (req.vaddr < (~0x0ull << 20))
+			{
+				_assert(req.vaddr < 4ull * 1024ull * 1024ull * 1024ull);
+				req.port = _tp_index;
+				if(thread.instr_info.instr_type == ISA::RISCV::InstrType::STORE)
+					req.flags.omit_cache = _store_omit_cache;
+				else if(thread.instr_info.instr_type == ISA::RISCV::InstrType::ATOMIC)
+					req.flags.omit_cache = _amo_omit_cache;
+
+				MemoryReturn ret;
+				UnitMemoryBase* mem = (UnitMemoryBase*)_unit_table[(uint)thread.instr_info.instr_type];
+				if(!mem->functional_access(req, ret)) continue;
+
+				if(thread.instr_info.instr_type != ISA::RISCV::InstrType::STORE)
+				{
+					ISA::RISCV::DstReg dst_reg(ret.dst.pop(9));
+					for(uint offset = 0; offset < ret.size; offset += size(dst_reg.type), dst_reg.index++)
+						write_register(&thread.int_regs, &thread.float_regs, dst_reg, ret.data + offset);
+				}
+			}
+			else _stack_access(thread_id, req);
+		}
+		else _assert(false);
+
+		_log_instruction_issue(thread_id);
+		_advance_thread(thread_id, jump);
+	}
 }
 
 }
@@ -28,6 +28,8 @@ public:
 
 		uint num_threads{8};
 		uint stack_size{512};
+		uint8_t store_omit_cache{0b111}; //cache levels stores bypass, by default they go straight to memory
+		uint8_t amo_omit_cache{0b011}; //AMOs skip the private L1s so they are applied once at the shared L2
 
 		const std::vector<UnitBase*>* unit_table{nullptr};
 		const std::vector<UnitSFU*>* unique_sfus{nullptr};
@@ -55,12 +57,28 @@ protected:
 			paddr_t paddr;
 		}
 		i_buffer;
+
+		//instr_info holds function pointers so it is decoded again instead of saved
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(int_regs);
+			checkpoint.io(float_regs);
+			checkpoint.io(stack_mem);
+			checkpoint.io(pc);
+			checkpoint.io(float_regs_pending);
+			checkpoint.io(int_regs_pending);
+			checkpoint.io(instr);
+			checkpoint.io(i_buffer);
+			if(checkpoint.restoring()) instr_info = instr.get_info();
+		}
 	};
 
 	uint _tp_index;
 	uint _tm_index;
 	uint _num_tps_per_i_cache;
 	uint64_t _stack_mask;
+	uint8_t _store_omit_cache;
+	uint8_t _amo_omit_cache;
 	uint8_t* _cheat_memory;
 
 	uint _last_thread_id;
@@ -81,6 +99,10 @@ public:
 	void clock_rise() override;
 	void clock_fall() override;
 	void reset() override;
+	cycles_t next_event_cycle() override;
+	void skip_cycles(cycles_t cycles) override;
+	bool checkpoint(Checkpoint& checkpoint) override;
+	void functional_step() override;
 	void set_entry_point(uint64_t entry_point);
 
 protected:
@@ -95,9 +117,12 @@ protected:
 	bool _decode(uint thread_id, ISA::RISCV::InstrType& stalling_instr_type, DecodePhase& phase);
 	virtual uint8_t _check_dependancies(uint thread_id);
 	virtual void _set_dependancies(uint thread_id);
+	bool _returns_pending();
 	void _process_load_return(const MemoryReturn& ret);
 	void _clear_register_pending(uint thread_id, ISA::RISCV::DstReg dst);
 	void _log_instruction_issue(uint thread_id);
+	void _stack_access(uint thread_id, MemoryRequest& req);
+	void _advance_thread(uint thread_id, bool jump);
 
 public:
 	class Log
@@ -136,6 +161,22 @@ public:
 				_profile_counters[a.first] += a.second;
 		}
 
+		void checkpoint(Checkpoint& checkpoint)
+		{
+			checkpoint.io(instruction_counters);
+			checkpoint.io(_resource_stall_counters);
+			checkpoint.io(_data_stall_counters);
+			checkpoint.io(_profile_counters);
+		}
+
+		uint64_t get_instructions() const
+		{
+			uint64_t total = 0;
+			for(uint i = 0; i < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++i)
+				total += instruction_counters[i];
+			return total;
+		}
+
 		void profile_instruction(vaddr_t pc)
 		{
 		#if ENABLE_PROFILER
@@ -155,10 +196,12 @@ public:
 			profile_instruction(pc);
 		}
 
-		void log_data_stall(const ISA::RISCV::InstrType type, vaddr_t pc)
+		void log_data_stall(const ISA::RISCV::InstrType type, vaddr_t pc, uint64_t cycles = 1)
 		{
-			_data_stall_counters[(uint)type]++;
-			profile_instruction(pc);
+			_data_stall_counters[(uint)type] += cycles;
+		#if ENABLE_PROFILER
+			_profile_counters[pc] += cycles;
+		#endif
 		}
 
 		void print(uint num_units = 1)
@@ -0,0 +1,110 @@
+#pragma once
+#include "stdafx.hpp"
+#include "bit-manipulation.hpp"
+
+namespace Arches {
+
+//Interleaves addresses across num_ways units (partitions, slices, banks) every stride bytes. With plain modulo a
+//structure strided by a multiple of num_ways * stride lands on one unit. The hashes keep the modulo digit and
+//combine it with an offset computed from the bits above it, so stripping the digit and injecting it back still work.
+//The offset is XORed in for power of two ways and added modulo num_ways otherwise.
+class AddressHash
+{
+public:
+	enum class Function : uint8_t
+	{
+		MODULO,
+		XOR_FOLD, //offset is the upper bits folded down in log2(num_ways) bit chunks
+		PRIME, //offset is the upper bits times a prime (prime displacement, Kharbutli et al. 2004)
+		MATRIX, //offset bit i is the parity of the upper bits selected by matrix[i]
+	};
+
+	struct Configuration
+	{
+		Function function{Function::MODULO};
+		std::vector<uint64_t> matrix;
+	};
+
+private:
+	const static uint64_t PRIME_DISPLACEMENT = 9973;
+
+	uint _num_ways{1};
+	uint64_t _stride{1};
+	uint _way_bits{0};
+	bool _pow2{true};
+	Function _function{Function::MODULO};
+	std::vector<uint64_t> _matrix;
+
+public:
+	AddressHash(uint num_ways = 1, uint64_t stride = 1) : AddressHash(num_ways, stride, Configuration()) {}
+	AddressHash(uint num_ways, uint64_t stride, const Configuration& config) :
+		_num_ways(num_ways), _stride(stride), _function(config.function), _matrix(config.matrix)
+	{
+		_assert(_num_ways > 0 && _stride > 0);
+		_pow2 = (_num_ways & (_num_ways - 1)) == 0;
+		_way_bits = log2i(_num_ways - 1) + (_num_ways > 1); //bits needed to hold any way
+		_assert(_function != Function::MATRIX || (_pow2 && _matrix.size() == log2i(_num_ways)));
+	}
+
+	uint num_ways() const { return _num_ways; }
+	uint64_t stride() const { return _stride; }
+
+	uint index(paddr_t paddr) const
+	{
+		uint64_t chunk = paddr / _stride;
+		return _combine(chunk % _num_ways, _offset(chunk / _num_ways));
+	}
+
+	//address with the interleaving removed, consecutive within one way
+	paddr_t strip(paddr_t paddr) const
+	{
+		return (paddr / _stride / _num_ways) * _stride + (paddr % _stride);
+	}
+
+	paddr_t inject(paddr_t paddr, uint way) const
+	{
+		uint64_t upper = paddr / _stride;
+		return (upper * _num_ways + _separate(way, _offset(upper))) * _stride + (paddr % _stride);
+	}
+
+private:
+	uint _offset(uint64_t upper) const
+	{
+		switch(_function)
+		{
+		case Function::XOR_FOLD:
+		{
+			if(_way_bits == 0) return 0;
+			uint64_t fold = 0;
+			for(; upper; upper >>= _way_bits)
+				fold ^= upper & generate_nbit_mask(_way_bits);
+			return (uint)fold;
+		}
+		case Function::PRIME:
+			return (uint)((upper * PRIME_DISPLACEMENT) % _num_ways);
+		case Function::MATRIX:
+		{
+			uint offset = 0;
+			for(uint i = 0; i < _matrix.size(); ++i)
+				offset |= (popcnt(upper & _matrix[i]) & 0x1) << i;
+			return offset;
+		}
+		default:
+			return 0;
+		}
+	}
+
+	uint _combine(uint digit, uint offset) const
+	{
+		if(_pow2) return digit ^ (offset & (_num_ways - 1));
+		return (digit + offset) % _num_ways;
+	}
+
+	uint _separate(uint way, uint offset) const
+	{
+		if(_pow2) return way ^ (offset & (_num_ways - 1));
+		return (way + _num_ways - offset % _num_ways) % _num_ways;
+	}
+};
+
+}
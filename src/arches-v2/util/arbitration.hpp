@@ -61,6 +61,13 @@ public:
 		_priority_index = grant_index; //make the grant bit the highest priority bit so that it will continue to be granted until removed
 		return grant_index; 
 	}
+
+	template<typename CP>
+	void checkpoint(CP& checkpoint)
+	{
+		checkpoint.io_bytes(&_pending, sizeof(_pending)); //uint128_t has a user defined copy
+		checkpoint.io(_priority_index);
+	}
 };
 
 const static uint8_t _default_weight_table[128] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
@@ -122,5 +129,156 @@ public:
 		_priority_index = grant_index; //make the grant bit the highest priority bit so that it will continue to be granted until removed
 		return grant_index;
 	}
+
+	template<typename CP>
+	void checkpoint(CP& checkpoint)
+	{
+		checkpoint.io_bytes(&_pending, sizeof(_pending)); //uint128_t has a user defined copy
+		checkpoint.io(_priority_index);
+		checkpoint.io(_grant_counter);
+	}
 };
 
+
+//iSLIP allocator for up to sizeof(MASK_T) * 8 inputs and outputs. Each cycle inputs request any set of outputs, then for a
+//number of iterations every unmatched output grants the next requesting unmatched input after its grant pointer and every
+//input accepts the next granting output after its accept pointer. Pointers only move past grants accepted in the first
+//iteration which keeps them desynchronized under load, so a single pass per cycle gets close to a maximal matching.
+template<typename MASK_T = uint128_t>
+class ISLIPAllocator
+{
+public:
+	class Log
+	{
+	public:
+		uint64_t allocations;
+		uint64_t matches;
+		uint64_t bound; //per allocation the smaller of requesting inputs and requested outputs
+
+		Log() { reset(); }
+
+		void reset()
+		{
+			allocations = 0;
+			matches = 0;
+			bound = 0;
+		}
+
+		void accumulate(const Log& other)
+		{
+			allocations += other.allocations;
+			matches += other.matches;
+			bound += other.bound;
+		}
+
+		double grant_efficiency() const { return bound ? (double)matches / bound : 1.0; }
+	};
+
+private:
+	uint _num_inputs;
+	uint _num_outputs;
+	uint _iterations;
+
+	std::vector<MASK_T> _requests;         //per output, the inputs requesting it
+	std::vector<MASK_T> _grants;           //per input, the outputs granting it in the current iteration
+	std::vector<uint8_t> _grant_pointers;  //per output
+	std::vector<uint8_t> _accept_pointers; //per input
+	std::vector<uint> _matches;            //per input, the matched output or ~0u
+	std::vector<uint8_t> _output_matched;
+
+	//first set bit at or after pointer
+	static uint _next(MASK_T mask, uint pointer)
+	{
+		return (pointer + ctz(rotr(mask, pointer))) % (sizeof(MASK_T) * 8);
+	}
+
+public:
+	Log log;
+
+	ISLIPAllocator(uint inputs, uint outputs, uint iterations = 1) : _num_inputs(inputs), _num_outputs(outputs), _iterations(iterations),
+		_requests(outputs, MASK_T(0)), _grants(inputs, MASK_T(0)), _grant_pointers(outputs, 0), _accept_pointers(inputs, 0),
+		_matches(inputs, ~0u), _output_matched(outputs, 0)
+	{
+		_assert(inputs <= sizeof(MASK_T) * 8);
+		_assert(outputs <= sizeof(MASK_T) * 8);
+		_assert(iterations > 0);
+	}
+
+	void request(uint input, uint output)
+	{
+		_requests[output] |= MASK_T(1) << input;
+	}
+
+	//Matches the requests made since the last allocation and clears them
+	void allocate()
+	{
+		MASK_T requesting_inputs(0);
+		uint requested_outputs = 0;
+		for(uint output = 0; output < _num_outputs; ++output)
+		{
+			if(!_requests[output]) continue;
+			requesting_inputs |= _requests[output];
+			requested_outputs++;
+		}
+
+		for(uint input = 0; input < _num_inputs; ++input)
+			_matches[input] = ~0u;
+
+		log.allocations++;
+		if(requested_outputs == 0) return;
+		log.bound += std::min(popcnt(requesting_inputs), requested_outputs);
+
+		MASK_T unmatched_inputs = requesting_inputs;
+		for(uint iteration = 0; iteration < _iterations; ++iteration)
+		{
+			bool granted = false;
+			for(uint output = 0; output < _num_outputs; ++output)
+			{
+				if(_output_matched[output]) continue;
+
+				MASK_T requests = _requests[output];
+				requests &= unmatched_inputs;
+				if(!requests) continue;
+
+				_grants[_next(requests, _grant_pointers[output])] |= MASK_T(1) << output;
+				granted = true;
+			}
+			if(!granted) break;
+
+			for(uint input = 0; input < _num_inputs; ++input)
+			{
+				if(!_grants[input]) continue;
+
+				uint output = _next(_grants[input], _accept_pointers[input]);
+				_grants[input] = MASK_T(0);
+				_matches[input] = output;
+				_output_matched[output] = 1;
+				unmatched_inputs &= ~(MASK_T(1) << input);
+				log.matches++;
+
+				if(iteration == 0)
+				{
+					_grant_pointers[output] = (input + 1) % _num_inputs;
+					_accept_pointers[input] = (output + 1) % _num_outputs;
+				}
+			}
+		}
+
+		for(uint output = 0; output < _num_outputs; ++output)
+		{
+			_requests[output] = MASK_T(0);
+			_output_matched[output] = 0;
+		}
+	}
+
+	//output matched to the input by the last allocation or ~0u
+	uint match(uint input) const { return _matches[input]; }
+
+	template<typename CP>
+	void checkpoint(CP& checkpoint)
+	{
+		checkpoint.io(_grant_pointers);
+		checkpoint.io(_accept_pointers);
+		checkpoint.io(log);
+	}
+};
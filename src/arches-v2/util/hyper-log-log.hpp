@@ -0,0 +1,69 @@
+#pragma once
+#include "stdafx.hpp"
+#include "bit-manipulation.hpp"
+
+//Counts distinct keys in 2^P bytes (Flajolet et al. 2007) with about 1.04/sqrt(2^P) relative error. Merging two sketches
+//gives the sketch of the union of their keys so per interval logs still add up to the whole run.
+template<uint P = 12>
+class HyperLogLog
+{
+public:
+	const static uint NUM_REGISTERS = 1u << P;
+
+private:
+	uint8_t _registers[NUM_REGISTERS]; //longest run of leading zeros seen by each bucket plus one
+
+public:
+	HyperLogLog() { reset(); }
+
+	void reset()
+	{
+		for(uint i = 0; i < NUM_REGISTERS; ++i)
+			_registers[i] = 0;
+	}
+
+	void add(uint64_t key)
+	{
+		uint64_t hash = _mix(key);
+		uint index = (uint)(hash >> (64 - P));
+		uint64_t rest = hash << P;
+		uint8_t rank = rest ? clz(rest) + 1 : 64 - P + 1;
+		_registers[index] = std::max(_registers[index], rank);
+	}
+
+	void merge(const HyperLogLog& other)
+	{
+		for(uint i = 0; i < NUM_REGISTERS; ++i)
+			_registers[i] = std::max(_registers[i], other._registers[i]);
+	}
+
+	double estimate() const
+	{
+		double sum = 0.0;
+		uint zeros = 0;
+		for(uint i = 0; i < NUM_REGISTERS; ++i)
+		{
+			sum += std::ldexp(1.0, -(int)_registers[i]);
+			if(_registers[i] == 0) zeros++;
+		}
+
+		double m = NUM_REGISTERS;
+		double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+
+		//below a few keys per register the empty ones are the better estimate
+		if(estimate <= 2.5 * m && zeros > 0) return m * std::log(m / zeros);
+		return estimate;
+	}
+
+private:
+	//keys are mostly aligned addresses so every bit has to reach both the bucket index and the leading zeros
+	static uint64_t _mix(uint64_t key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdull;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ull;
+		key ^= key >> 33;
+		return key;
+	}
+};
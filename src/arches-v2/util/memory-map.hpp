@@ -1,2 +1,153 @@
 #pragma once
-#include "stdafx.hpp"
\ No newline at end of file
+#include "stdafx.hpp"
+#include "address-hash.hpp"
+
+namespace Arches {
+
+//Named address ranges of the workload's buffers so memory traffic can be attributed to data structures. Region 0 is
+//everything that isn't registered. Units behind the partition crossbar see addresses with the partition bits removed
+//so they look regions up with the index of their partition.
+class RegionMap
+{
+public:
+	constexpr static uint MAX_REGIONS = 16;
+
+	RegionMap(const RegionMap& other) = delete;
+
+	static RegionMap& get_instance()
+	{
+		if(!_instance) _instance = new RegionMap();
+		return *_instance;
+	}
+
+	uint add_region(const std::string& name, paddr_t start, paddr_t size)
+	{
+		_assert(_names.size() < MAX_REGIONS);
+		if(size == 0) return 0;
+
+		uint region = _names.size();
+		_names.push_back(name);
+
+		Range range{start, start + size, region};
+		auto it = std::upper_bound(_ranges.begin(), _ranges.end(), range, [](const Range& a, const Range& b) { return a.start < b.start; });
+		_assert(it == _ranges.end() || range.end <= it->start);
+		_assert(it == _ranges.begin() || (it - 1)->end <= range.start);
+		_ranges.insert(it, range);
+		return region;
+	}
+
+	void set_partitions(const AddressHash& partition_hash)
+	{
+		_partition_hash = partition_hash;
+	}
+
+	uint find(paddr_t addr, uint partition = ~0u) const
+	{
+		if(_ranges.empty()) return 0;
+		if(partition != ~0u) addr = _partition_hash.inject(addr, partition);
+
+		auto it = std::upper_bound(_ranges.begin(), _ranges.end(), addr, [](paddr_t a, const Range& b) { return a < b.start; });
+		if(it == _ranges.begin() || addr >= (it - 1)->end) return 0;
+		return (it - 1)->region;
+	}
+
+	uint num_regions() const { return _names.size(); }
+	const std::string& region_name(uint region) const { return _names[region]; }
+
+private:
+	struct Range
+	{
+		paddr_t start, end;
+		uint region;
+	};
+
+	inline static RegionMap* _instance{nullptr};
+
+	std::vector<std::string> _names{"other"};
+	std::vector<Range> _ranges;
+	AddressHash _partition_hash;
+
+	RegionMap() = default;
+};
+
+//Per region traffic counters units keep in their logs
+class RegionLog
+{
+public:
+	uint64_t accesses[RegionMap::MAX_REGIONS];
+	uint64_t hits[RegionMap::MAX_REGIONS];
+	uint64_t bytes[RegionMap::MAX_REGIONS];
+
+	RegionLog() { reset(); }
+
+	void reset()
+	{
+		for(uint i = 0; i < RegionMap::MAX_REGIONS; ++i)
+			accesses[i] = hits[i] = bytes[i] = 0;
+	}
+
+	void accumulate(const RegionLog& other)
+	{
+		for(uint i = 0; i < RegionMap::MAX_REGIONS; ++i)
+		{
+			accesses[i] += other.accesses[i];
+			hits[i] += other.hits[i];
+			bytes[i] += other.bytes[i];
+		}
+	}
+
+	template<typename CP>
+	void checkpoint(CP& checkpoint)
+	{
+		checkpoint.io(accesses);
+		checkpoint.io(hits);
+		checkpoint.io(bytes);
+	}
+
+	void log(uint region, uint size, bool hit)
+	{
+		accesses[region]++;
+		hits[region] += hit;
+		bytes[region] += size;
+	}
+
+	uint64_t total_bytes() const
+	{
+		uint64_t total = 0;
+		for(uint i = 0; i < RegionMap::MAX_REGIONS; ++i)
+			total += bytes[i];
+		return total;
+	}
+
+	//one line share of bytes per region for the interval printouts
+	void print_short(const char* name) const
+	{
+		uint64_t total = total_bytes();
+		if(!total || RegionMap::get_instance().num_regions() < 2) return;
+
+		printf("%s Bytes:", name);
+		for(uint i = 0; i < RegionMap::get_instance().num_regions(); ++i)
+			if(bytes[i]) printf(" %s %.1f%%", RegionMap::get_instance().region_name(i).c_str(), 100.0 * bytes[i] / total);
+		printf("\n");
+	}
+
+	void print(bool print_hits = true, uint units = 1) const
+	{
+		uint64_t total = total_bytes();
+		if(!total || RegionMap::get_instance().num_regions() < 2) return;
+
+		printf("\n%-16s%14s", "Region", "Accesses");
+		if(print_hits) printf("%10s", "Hit Rate");
+		printf("%16s%10s\n", "Bytes", "Share");
+		for(uint i = 0; i < RegionMap::get_instance().num_regions(); ++i)
+		{
+			if(!accesses[i]) continue;
+
+			printf("%-16s%14lld", RegionMap::get_instance().region_name(i).c_str(), accesses[i] / units);
+			if(print_hits) printf("%9.2f%%", 100.0 * hits[i] / accesses[i]);
+			printf("%16lld%9.2f%%\n", bytes[i] / units, 100.0 * bytes[i] / total);
+		}
+	}
+};
+
+}
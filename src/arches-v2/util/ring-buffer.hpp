@@ -0,0 +1,92 @@
+#pragma once
+#include "stdafx.hpp"
+
+//Fixed capacity FIFO with the std::queue interface. Storage is allocated once at construction and rounded up to a power
+//of two so indexing is a mask, pushing and popping never touch the heap.
+template<typename T>
+class RingBuffer
+{
+private:
+	std::vector<T> _data;
+	uint _mask;
+	uint _capacity;
+	uint _head{0};
+	uint _size{0};
+
+	static uint _storage_size(uint capacity)
+	{
+		uint size = 1;
+		while(size < capacity) size <<= 1;
+		return size;
+	}
+
+public:
+	RingBuffer(uint capacity = 1) : _data(_storage_size(capacity)), _mask(_data.size() - 1), _capacity(capacity) {}
+
+	uint capacity() const { return _capacity; }
+	uint size() const { return _size; }
+	bool empty() const { return _size == 0; }
+	bool full() const { return _size >= _capacity; }
+
+	T& front()
+	{
+		_assert(_size > 0);
+		return _data[_head];
+	}
+
+	const T& front() const
+	{
+		_assert(_size > 0);
+		return _data[_head];
+	}
+
+	T& back()
+	{
+		_assert(_size > 0);
+		return _data[(_head + _size - 1) & _mask];
+	}
+
+	//i entries behind the front
+	T& operator[](uint i)
+	{
+		_assert(i < _size);
+		return _data[(_head + i) & _mask];
+	}
+
+	void push(const T& entry)
+	{
+		_assert(_size < _capacity);
+		_data[(_head + _size) & _mask] = entry;
+		_size++;
+	}
+
+	void pop()
+	{
+		_assert(_size > 0);
+		_head = (_head + 1) & _mask;
+		_size--;
+	}
+
+	void clear()
+	{
+		_head = 0;
+		_size = 0;
+	}
+
+	//only live entries are saved, in order, so a restore starts at the front of the storage
+	template<typename CP>
+	void checkpoint(CP& checkpoint)
+	{
+		uint size = _size;
+		checkpoint.io(size);
+		if(checkpoint.restoring())
+		{
+			_assert(size <= _capacity);
+			_head = 0;
+			_size = size;
+		}
+
+		for(uint i = 0; i < _size; ++i)
+			checkpoint.io(_data[(_head + i) & _mask]);
+	}
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include "stdafx.hpp"
+#include "bit-manipulation.hpp"
+
+#include <immintrin.h>
+
+//Scans over the small per set arrays of the caches (tags, replacement state). SSE2 is always there on x64, the 256-bit
+//loops are only compiled when the build targets AVX2 (/arch:AVX2 or -mavx2, see ARCHES_AVX2 in CMake) since MSVC accepts
+//the intrinsics without it and the binary would then fault on hosts without AVX2. Scalar loops handle the tails.
+#if defined __AVX2__
+#define ENABLE_AVX2_SCANS 1
+#else
+#define ENABLE_AVX2_SCANS 0
+#endif
+
+//returns the index of the first value equal to value or ~0u
+inline uint scan_find(const uint64_t* values, uint count, uint64_t value)
+{
+	uint i = 0;
+
+#if ENABLE_AVX2_SCANS
+	__m256i key = _mm256_set1_epi64x(value);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(values + i)), key);
+		uint mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+		if(mask) return i + ctz(mask);
+	}
+#endif
+
+	for(; i < count; ++i)
+		if(values[i] == value) return i;
+
+	return ~0u;
+}
+
+inline uint scan_find(const uint8_t* values, uint count, uint8_t value)
+{
+	uint i = 0;
+
+#if ENABLE_AVX2_SCANS
+	__m256i key = _mm256_set1_epi8((char)value);
+	for(; i + 32 <= count; i += 32)
+	{
+		uint mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(values + i)), key));
+		if(mask) return i + ctz(mask);
+	}
+#endif
+
+	__m128i key128 = _mm_set1_epi8((char)value);
+	for(; i + 16 <= count; i += 16)
+	{
+		uint mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(values + i)), key128));
+		if(mask) return i + ctz(mask);
+	}
+
+	for(; i < count; ++i)
+		if(values[i] == value) return i;
+
+	return ~0u;
+}
+
+//increments every value below value. There is no unsigned byte compare so both sides have their sign bit flipped and the
+//all ones compare result is subtracted to add one
+inline void scan_increment_below(uint8_t* values, uint count, uint8_t value)
+{
+	uint i = 0;
+
+#if ENABLE_AVX2_SCANS
+	__m256i bias = _mm256_set1_epi8((char)0x80);
+	__m256i key = _mm256_set1_epi8((char)(value ^ 0x80));
+	for(; i + 32 <= count; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+		__m256i less = _mm256_cmpgt_epi8(key, _mm256_xor_si256(v, bias));
+		_mm256_storeu_si256((__m256i*)(values + i), _mm256_sub_epi8(v, less));
+	}
+#endif
+
+	__m128i bias128 = _mm_set1_epi8((char)0x80);
+	__m128i key128 = _mm_set1_epi8((char)(value ^ 0x80));
+	for(; i + 16 <= count; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+		__m128i less = _mm_cmpgt_epi8(key128, _mm_xor_si128(v, bias128));
+		_mm_storeu_si128((__m128i*)(values + i), _mm_sub_epi8(v, less));
+	}
+
+	for(; i < count; ++i)
+		if(values[i] < value)
+			values[i]++;
+}
+
+inline uint8_t scan_max(const uint8_t* values, uint count)
+{
+	uint i = 0;
+	uint8_t max = 0;
+
+	__m128i max128 = _mm_setzero_si128();
+	for(; i + 16 <= count; i += 16)
+		max128 = _mm_max_epu8(max128, _mm_loadu_si128((const __m128i*)(values + i)));
+
+	alignas(16) uint8_t lanes[16];
+	_mm_store_si128((__m128i*)lanes, max128);
+	for(uint j = 0; j < 16; ++j)
+		max = std::max(max, lanes[j]);
+
+	for(; i < count; ++i)
+		max = std::max(max, values[i]);
+
+	return max;
+}
+
+//adds delta to every value
+inline void scan_add(uint8_t* values, uint count, uint8_t delta)
+{
+	uint i = 0;
+
+	__m128i delta128 = _mm_set1_epi8((char)delta);
+	for(; i + 16 <= count; i += 16)
+		_mm_storeu_si128((__m128i*)(values + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*)(values + i)), delta128));
+
+	for(; i < count; ++i)
+		values[i] += delta;
+}
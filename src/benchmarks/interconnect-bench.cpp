@@ -0,0 +1,88 @@
+#include "stdafx.hpp"
+
+#include "simulator/interconnects.hpp"
+#include "simulator/transactions.hpp"
+
+//Drives a CasscadedCrossBar into one LatencyFIFO per sink with random traffic and reports the wall time per cycle. The
+//checksum covers the order requests leave the pipelines so runs on two builds can be checked for identical behavior.
+//Usage: interconnect-bench [sources] [sinks] [injection percent] [cycles]
+
+using namespace Arches;
+
+class BenchCrossBar : public CasscadedCrossBar<MemoryRequest>
+{
+private:
+	uint _num_sinks;
+
+public:
+	BenchCrossBar(uint sources, uint sinks) : CasscadedCrossBar<MemoryRequest>(sources, sinks), _num_sinks(sinks) {}
+
+	uint get_sink(const MemoryRequest& request) override
+	{
+		return (request.paddr >> 5) % _num_sinks;
+	}
+};
+
+static uint64_t xorshift(uint64_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+int main(int argc, char* argv[])
+{
+	uint num_sources = argc > 1 ? std::stoi(argv[1]) : 128;
+	uint num_sinks = argc > 2 ? std::stoi(argv[2]) : 16;
+	uint injection_rate = argc > 3 ? std::stoi(argv[3]) : 30;
+	cycles_t num_cycles = argc > 4 ? std::stoll(argv[4]) : 200000;
+	const uint pipeline_latency = 8;
+
+	BenchCrossBar crossbar(num_sources, num_sinks);
+	std::vector<LatencyFIFO<MemoryRequest>> pipelines(num_sinks, LatencyFIFO<MemoryRequest>(pipeline_latency));
+
+	uint64_t rng = 0x9e3779b97f4a7c15ull;
+	uint64_t injected = 0, delivered = 0, checksum = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for(cycles_t cycle = 0; cycle < num_cycles; ++cycle)
+	{
+		crossbar.clock();
+
+		for(uint sink = 0; sink < num_sinks; ++sink)
+		{
+			if(crossbar.is_read_valid(sink) && pipelines[sink].is_write_valid())
+				pipelines[sink].write(crossbar.read(sink));
+
+			pipelines[sink].clock();
+			if(pipelines[sink].is_read_valid())
+			{
+				MemoryRequest request = pipelines[sink].read();
+				checksum = (checksum ^ request.paddr) * 0x100000001b3ull;
+				delivered++;
+			}
+		}
+
+		for(uint source = 0; source < num_sources; ++source)
+		{
+			if(xorshift(rng) % 100 >= injection_rate || !crossbar.is_write_valid(source)) continue;
+
+			MemoryRequest request;
+			request.type = MemoryRequest::Type::LOAD;
+			request.size = 4;
+			request.port = source;
+			request.paddr = xorshift(rng) & 0xffffffe0ull;
+			crossbar.write(request, source);
+			injected++;
+		}
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	printf("Sources: %d, Sinks: %d, Injection: %d%%, Cycles: %lld\n", num_sources, num_sinks, injection_rate, num_cycles);
+	printf("Injected: %lld, Delivered: %lld, Checksum: 0x%llx\n", injected, delivered, checksum);
+	printf("Time: %.3f s, %.3f us/cycle\n", seconds, 1.0e6 * seconds / num_cycles);
+
+	return 0;
+}